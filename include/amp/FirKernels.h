@@ -0,0 +1,75 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+// Set on the architectures that have SIMD kernels. Elsewhere (ex: an ARM 
+// microcontroller without NEON) the CMSIS-DSP functions are usually the 
+// better choice since they are tuned for that core.
+#if defined(__x86_64__) || defined(__i386__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AMP_FIR_SIMD 1
+#endif
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * The Q15 FIR inner loop used by the resampling filters. The scalar
+ * version has the same arithmetic as arm_fir_q15()/arm_fir_decimate_q15()
+ * (64-bit accumulator, >> 15, saturate) and serves as the reference. The
+ * SIMD versions (SSE2/AVX2 on x86, NEON on ARM) produce bit-identical
+ * results. The best version supported by the CPU is chosen at runtime.
+ */
+struct FirKernels {
+
+    enum class Backend { SCALAR, SSE2, AVX2, NEON };
+
+    /**
+     * Computes n filter outputs:
+     *
+     *   out[i * outStride] = sat((sum(coeffs[k] * x[i * inStep + k])) >> 15)
+     *
+     * for k in [0, taps). x is oldest-first, so it must hold
+     * (n - 1) * inStep + taps samples. An inStep of M gives a decimate-by-M
+     * filter and an outStride of L writes one phase of an interpolator.
+     *
+     * NOTE: No coefficient may be -32768.
+     */
+    void (*fir)(int16_t* out, unsigned outStride, const int16_t* x, unsigned inStep,
+        const int16_t* coeffs, unsigned taps, unsigned n);
+
+    Backend backend;
+    const char* name;
+
+    /**
+     * @returns The best kernels for the CPU that we are running on.
+     * The selection is made on the first call.
+     */
+    static const FirKernels& get();
+
+    /**
+     * @returns The kernels for a specific backend. Only valid if
+     * isSupported(backend) is true. Mostly used for testing.
+     */
+    static const FirKernels& get(Backend backend);
+
+    static bool isSupported(Backend backend);
+};
+
+    }
+}
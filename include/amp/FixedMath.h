@@ -0,0 +1,66 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Fixed-point DSP profile
+ * -----------------------
+ * When AMP_FIXED_POINT is defined the audio pipeline avoids floating point
+ * (and the libm transcendentals) on the per-frame paths so that it runs
+ * on parts without an FPU (i.e. RP2040-class microcontrollers) without 
+ * soft-float. The integer versions are chosen at compile time; the
+ * default build is unchanged.
+ */
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * The level returned for silence.
+ */
+static const int32_t MIN_DB_Q8 = -200 * 256;
+
+/**
+ * @returns log2(x) in Q16, accurate to about 1 LSB. Uses a 256-entry 
+ * table with linear interpolation. x must be non-zero.
+ */
+int32_t log2Q16(uint64_t x);
+
+/**
+ * @returns 10 log10(num / den) in Q8 dB, or MIN_DB_Q8 if num is zero.
+ * den must be non-zero.
+ */
+int32_t powerRatioDbQ8(uint64_t num, uint64_t den);
+
+/**
+ * @returns 20 log10(num / den) in Q8 dB, or MIN_DB_Q8 if num is zero.
+ */
+inline int32_t amplitudeRatioDbQ8(uint64_t num, uint64_t den) {
+    return num ? 2 * powerRatioDbQ8(num, den) : MIN_DB_Q8;
+}
+
+/**
+ * @returns The amplitude gain 10^(dB / 20) as a fixed-point number with 
+ * the specified number of fractional bits (ex: 15 for Q15), saturated 
+ * to INT32_MAX.
+ */
+int32_t dbToGainQ(int32_t dbQ8, unsigned fracBits);
+
+    }
+}
@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * Estimates the network delay and its variation from the flight time of 
+ * each voice frame. Please see "Adaptive Playout Mechanisms for Packetized 
+ * Audio Applications in Wide-Area Networks" by Ramachandran Ramjee, et. al.
+ * This is the classic "Algorithm 1" method.
+ *
+ * In the fixed-point profile (AMP_FIXED_POINT) the averages are kept in 
+ * Q16 milliseconds and the results are rounded to whole milliseconds. 
+ * Otherwise floats are used.
+ */
+class JitterEstimator {
+public:
+
+#ifdef AMP_FIXED_POINT
+    typedef int32_t ms_t;
+#else
+    typedef float ms_t;
+#endif
+
+    /**
+     * Starts over with a delay estimate and no variation.
+     */
+    void reset(int64_t delayMs) {
+#ifdef AMP_FIXED_POINT
+        _d = delayMs * ONE;
+        _v = 0;
+#else
+        _d = delayMs;
+        _v = 0;
+#endif
+        _update();
+    }
+
+    /**
+     * @param ni The flight time of a frame in milliseconds.
+     */
+    void consume(int64_t ni) {
+#ifdef AMP_FIXED_POINT
+        const int64_t n = ni * ONE;
+        _d += ((n - _d) * GAIN_Q16) >> 16;
+        const int64_t dev = (_d > n) ? _d - n : n - _d;
+        _v += ((dev - _v) * GAIN_Q16) >> 16;
+#else
+        const float n = ni;
+        _d = _alpha * _d + (1 - _alpha) * n;
+        _v = _alpha * _v + (1 - _alpha) * fabs(_d - n);
+#endif
+        _update();
+    }
+
+    /**
+     * @returns The average delay (d)
+     */
+    ms_t getDelay() const { return _delay; }
+
+    /**
+     * @returns The delay plus a safety margin for the variation (d + beta * v)
+     */
+    ms_t getIdealDelay() const { return _idealDelay; }
+
+private:
+
+#ifdef AMP_FIXED_POINT
+    static const int64_t ONE = 1 << 16;
+    // (1 - 0.998002) in Q16
+    static const int64_t GAIN_Q16 = 131;
+    static const int64_t BETA = 5;
+
+    void _update() {
+        _delay = (_d + ONE / 2) >> 16;
+        _idealDelay = (_d + BETA * _v + ONE / 2) >> 16;
+    }
+
+    int64_t _d = 0;
+    int64_t _v = 0;
+#else
+    void _update() {
+        _delay = _d;
+        _idealDelay = _d + _beta * _v;
+    }
+
+    const float _alpha = 0.998002f;
+    const float _beta = 5.0f;
+    float _d = 0;
+    float _v = 0;
+#endif
+
+    ms_t _delay = 0;
+    ms_t _idealDelay = 0;
+};
+
+    }
+}
@@ -0,0 +1,77 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * The inner loops used for conference mixing. There is a plain scalar
+ * implementation that serves as the reference, plus SIMD versions
+ * (SSE2/AVX2 on x86, NEON on ARM) that produce bit-identical results.
+ * The best version supported by the CPU is chosen at runtime.
+ */
+struct MixKernels {
+
+    enum class Backend { SCALAR, SSE2, AVX2, NEON };
+
+    /**
+     * Scales a block of PCM16 and adds it to a 32-bit accumulator:
+     *
+     *   acc[i] += (((in[i] * scale_q15) >> 15) * scale_q11) >> 11
+     *
+     * The intermediate result after the q15 scale is always in the
+     * int16 range, which is what makes the SIMD versions exact.
+     */
+    void (*scaleAccumulate)(int32_t* acc, const int16_t* in, unsigned n,
+        int16_t scale_q15, int16_t scale_q11);
+
+    /**
+     * Converts a 32-bit accumulator to PCM16, saturating at the limits
+     * of the int16 range (rather than wrapping around).
+     */
+    void (*narrowSaturate)(int16_t* out, const int32_t* acc, unsigned n);
+
+    /**
+     * An equal blend of two PCM16 blocks: out[i] = (a[i] >> 1) + (b[i] >> 1).
+     * Each source is scaled before the add so this can never overflow.
+     * out may be the same as a or b.
+     */
+    void (*blendHalf)(int16_t* out, const int16_t* a, const int16_t* b, unsigned n);
+
+    Backend backend;
+    const char* name;
+
+    /**
+     * @returns The best kernels for the CPU that we are running on.
+     * The selection is made on the first call.
+     */
+    static const MixKernels& get();
+
+    /**
+     * @returns The kernels for a specific backend. Only valid if
+     * isSupported(backend) is true. Mostly used for testing.
+     */
+    static const MixKernels& get(Backend backend);
+
+    static bool isSupported(Backend backend);
+};
+
+    }
+}
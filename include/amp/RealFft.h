@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * FFT of a real signal. The N real samples are packed into an N/2 point
+ * complex FFT (iterative radix-2) and the result is split back into the
+ * N/2 + 1 non-redundant bins. The twiddle factors and the bit-reversal
+ * permutation are computed once in the constructor so a transform
+ * doesn't make any transcendental calls.
+ */
+class RealFft {
+public:
+
+    /**
+     * @param n The transform size, a power of 2 (at least 4).
+     */
+    RealFft(unsigned n);
+
+    unsigned size() const { return _n; }
+
+    /**
+     * @param in n real samples.
+     * @param re Receives n/2 + 1 real parts.
+     * @param im Receives n/2 + 1 imaginary parts.
+     */
+    void transform(const float* in, float* re, float* im);
+
+private:
+
+    const unsigned _n;
+    // exp(-2 pi j k / n) for k in [0, n/2)
+    std::vector<float> _cos, _sin;
+    // Bit-reversal permutation for the n/2 point complex FFT
+    std::vector<unsigned> _rev;
+    // Work area for the complex FFT
+    std::vector<float> _zr, _zi;
+};
+
+    }
+}
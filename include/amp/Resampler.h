@@ -24,6 +24,7 @@
 #include <arm_math.h>
 
 #include "amp/Ampersand.h"
+#include "amp/FirKernels.h"
 
 namespace kc1fsz {
     namespace amp {
@@ -86,17 +87,56 @@ public:
     // and an odd number this doesn't matter.
     static const int16_t F16_COEFFS[F16_TAPS];
 
+    // LPF used for up-sampling from 8K to 16K and down-sampling from 16K 
+    // to 8K. This runs at 16K.
+    static const unsigned F8_TAPS = 41;
+    // REMEMBER: These are in reverse order but since they are symmetrical
+    // and an odd number this doesn't matter.
+    static const int16_t F8_COEFFS[F8_TAPS];
+
 private:
 
     unsigned _getBlockSize(unsigned rate) const;
 
+    /**
+     * Builds the polyphase form of the up-sampling LPF. The input is
+     * held for factor samples (zero-order hold) and then filtered. The
+     * hold is folded into the phase filters, so the result is identical
+     * to holding and filtering at the high rate, but each output sample
+     * only needs one phase's taps (about taps/factor MACs).
+     */
+    void _initInterpolator(const int16_t* coeffs, unsigned taps, unsigned factor);
+
+    void _interpolate(const int16_t* inBlock, unsigned inSize, int16_t* outBlock);
+
+    void _initDecimator(const int16_t* coeffs, unsigned taps, unsigned factor,
+        unsigned blockSize);
+
+    void _decimate(const int16_t* inBlock, unsigned inSize, int16_t* outBlock);
+
     unsigned _inRate = 0, _outRate = 0;
 
-    arm_fir_instance_q15 _lpfFilter;
-    arm_fir_decimate_instance_q15 _lpfDecimationFilter;
     // Space for the largest possible filter
-    static constexpr unsigned MAX_TAPS = std::max(F1_TAPS, std::max(F2_TAPS, F16_TAPS));
+    static constexpr unsigned MAX_TAPS = std::max(std::max(F1_TAPS, F2_TAPS), 
+        std::max(F16_TAPS, F8_TAPS));
+    // The history of input samples used by the decimator or interpolator
     int16_t _lpfState[MAX_TAPS + BLOCK_SIZE_48K - 1];
+
+    static const unsigned MAX_UP_FACTOR = 6;
+    // The longest phase filter (F16 with 3 phases)
+    static const unsigned MAX_PHASE_TAPS = 25;
+    unsigned _upFactor = 0;
+    unsigned _phaseTaps = 0;
+    // _upFactor phase filters of _phaseTaps each, oldest sample first
+    int16_t _phaseCoeffs[MAX_UP_FACTOR * MAX_PHASE_TAPS];
+
+#ifdef AMP_FIR_SIMD
+    unsigned _downFactor = 0;
+    const int16_t* _downCoeffs = 0;
+    unsigned _downTaps = 0;
+#else
+    arm_fir_decimate_instance_q15 _lpfDecimationFilter;
+#endif
 };
     }
 }
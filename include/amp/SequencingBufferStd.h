@@ -23,6 +23,7 @@
 #include "kc1fsz-tools/Log.h"
 
 #include "amp/SequencingBuffer.h"
+#include "amp/JitterEstimator.h"
 
 namespace kc1fsz {   
     namespace amp {
@@ -66,8 +67,7 @@ public:
     void setInitialMargin(int32_t ms) {
         _initialMargin = ms;
         // Seed the adaptive buffer
-        _di = _di_1 = ms;
-        _vi = _vi_1 = 0;
+        _jitter.reset(ms);
     }
 
     void setTalkspurtTimeoutInterval(uint32_t ms) {
@@ -93,11 +93,7 @@ public:
         _talkspurtFirstOrigin = 0;
         _voicePlayoutCount = 0;
         _voiceConsumedCount = 0;
-        _di = 0;
-        _di_1 = 0;
-        _vi = 0;
-        _vi_1 = 0;
-        _idealDelay = 0;
+        _jitter.reset(0);
         _worstMargin = INT32_MAX;
         _totalMargin = 0;   
         _lastPlayoutTime = 0;
@@ -143,9 +139,13 @@ public:
         }
     }
 
+    /**
+     * @returns v rounded to the nearest multiple of tick (halfway cases
+     * away from zero).
+     */
     static int32_t roundToTick(int32_t v, int32_t tick) {
-        float a = round((float)v / (float)tick);
-        return a * (float)tick;
+        const int32_t a = (v >= 0) ? (v + tick / 2) / tick : -((-v + tick / 2) / tick);
+        return a * tick;
     }
 
     static uint32_t roundDownToTick(uint32_t v, uint32_t tick) {
@@ -348,33 +348,17 @@ private:
         uint32_t frameRxMs, uint32_t frameOrigMs) {
 
         // Calculate the flight time of this frame
-        float ni = ((float)frameRxMs - (float)frameOrigMs);
+        const int64_t ni = (int64_t)frameRxMs - (int64_t)frameOrigMs;
 
         // If this is the very first voice received for the first talkspurt
         // then use it to make an initial estimate of the delay. This can float
         // during the rest of the talkspurt.
-        if (startOfCall) {
-            _di = ni;
-            _di_1 = ni;
+        if (startOfCall) 
             // Assume no variance at the beginning
-            _vi = 0;
-            _vi_1 = _vi;
-        }
+            _jitter.reset(ni);
         // Re-estimate the variance statistics on each frame
-        else {
-            //
-            // Please see "Adaptive Playout Mechanisms for Packetized Audio Applications
-            // in Wide-Area Networks" by Ramachandran Ramjee, et. al.
-            //
-            // This is the classic "Algorithm 1" method
-            _di = _alpha * _di_1 + (1 - _alpha) * ni;
-            _di_1 = _di;
-            _vi = _alpha * _vi_1 + (1 - _alpha) * fabs(_di - ni);
-            _vi_1 = _vi;
-        }
-
-        // This is the current estimate of the ideal delay
-        _idealDelay = _di + _beta * _vi;
+        else 
+            _jitter.consume(ni);
     }
 
     // ------ Configuration Constants ----------------------------------------
@@ -384,9 +368,6 @@ private:
     // This is the most the playback cursor can be adjusted to pick up a 
     // late frame inside of a talkspurt
     const int32_t _midTsAdjustMax = 500;
-    // Constants for Ramjee Algorithm 1
-    const float _alpha = 0.998002f;
-    const float _beta = 5.0f;
     // The number of ms of silence before we delcare a talkspurt ended.
     uint32_t _talkspurtTimeoutInteval = 60;   
 
@@ -420,11 +401,7 @@ private:
     bool _delayLocked = false;
 
     // Used to estimate delay and delay variance
-    float _di_1 = 0;
-    float _di = 0;
-    float _vi = 0;
-    float _vi_1 = 0; 
-    float _idealDelay = 0;
+    JitterEstimator _jitter;
     // Starting estimate of margin
     // MUST BE A MULTIPLE OF _voiceTickSize
     unsigned _initialMargin = _voiceTickSize * 5;
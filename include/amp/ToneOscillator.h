@@ -0,0 +1,91 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * A fixed-point numerically-controlled oscillator (NCO) used by all of the
+ * tone generators (CTCSS, courtesy tones, test tones, CW, etc.). The phase
+ * is a 32-bit accumulator that wraps naturally, so there is no drift and 
+ * no fmod() is needed. The output is cos(phase), looked up in a shared 
+ * 1024-entry Q15 table with linear interpolation between entries, which
+ * keeps the error to about 1 LSB without any per-sample transcendental
+ * calls.
+ *
+ * Amplitude changes are ramped linearly over a configurable number of 
+ * samples to avoid clicks. Frequency changes are phase-continuous.
+ */
+class ToneOscillator {
+public:
+
+    ToneOscillator(unsigned sampleRate = 48000);
+
+    /**
+     * Stops the tone immediately and returns the phase to zero.
+     */
+    void reset();
+
+    void setFreq(float hz);
+
+    /**
+     * @param amp The peak amplitude as a fraction of full scale [0, 1].
+     * @param immediate When true the ramp is skipped.
+     */
+    void setAmplitude(float amp, bool immediate = false);
+
+    /**
+     * @param n The length of amplitude ramps in samples. Zero means
+     * that amplitude changes take effect immediately.
+     */
+    void setRampSamples(unsigned n) { _rampSamples = n; }
+
+    /**
+     * @returns true if the amplitude is (and will stay) zero.
+     */
+    bool isSilent() const { return _amp == 0 && _rampLeft == 0; }
+
+    /**
+     * Writes n samples of the tone.
+     */
+    void generate(int16_t* out, unsigned n);
+
+    /**
+     * Adds n samples of the tone to the existing audio (saturating).
+     */
+    void add(int16_t* pcm, unsigned n);
+
+private:
+
+    int32_t _next();
+
+    const unsigned _sampleRate;
+    uint32_t _phase = 0;
+    uint32_t _phaseInc = 0;
+    // Amplitude in Q30 and the per-sample step of the ramp in progress
+    int32_t _amp = 0;
+    int32_t _ampStep = 0;
+    int32_t _ampTarget = 0;
+    unsigned _rampLeft = 0;
+    unsigned _rampSamples = 0;
+};
+
+    }
+}
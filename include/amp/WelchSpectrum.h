@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "amp/RealFft.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * A streaming power spectrum estimate using Welch's method: Hann-windowed
+ * frames with 50% overlap whose power spectra are averaged. Audio is
+ * passed in as it arrives (i.e. a block per audio tick) and a new set of
+ * results is published after every averageCount frames.
+ *
+ * At most one FFT is run per call to consume(), so the cost on any one
+ * audio tick is bounded. If audio is passed in faster than one frame per
+ * call then frames are skipped, which only reduces the amount of averaging.
+ *
+ * The levels are in dBFS relative to a full-scale sine wave.
+ */
+class WelchSpectrum {
+public:
+
+    /**
+     * @param fftSize A power of 2. The frequency resolution is
+     * sampleRate / fftSize.
+     */
+    WelchSpectrum(unsigned sampleRate, unsigned fftSize, unsigned averageCount);
+
+    /**
+     * Discards the audio history and the results.
+     */
+    void reset();
+
+    void consume(const int16_t* pcm, unsigned n);
+
+    /**
+     * @returns true once results have been published since the last reset().
+     */
+    bool isReady() const { return _ready; }
+
+    /**
+     * @returns The frequency of the strongest component (above the hum
+     * range), interpolated between bins.
+     */
+    float getPeakFrequency() const { return _peakHz; }
+
+    float getPeakDbfs() const { return _peakDbfs; }
+
+    /**
+     * @returns The ratio of the total power to everything other than the
+     * strongest component (noise, distortion and hum) in dB. This is
+     * meaningful when a test tone is being received.
+     */
+    float getSinadDb() const { return _sinadDb; }
+
+    /**
+     * @returns The level of the 50 Hz or 60 Hz hum, whichever is stronger.
+     */
+    float getHumDbfs() const { return _humDbfs; }
+
+private:
+
+    void _analyzeFrame();
+    void _publish();
+    float _bandPower(unsigned k0, unsigned k1) const;
+    float _toDbfs(float power) const;
+
+    const unsigned _sampleRate;
+    const unsigned _fftSize;
+    const unsigned _hop;
+    const unsigned _averageCount;
+
+    RealFft _fft;
+    std::vector<float> _window;
+    // Sum of the squared window, used to scale the power
+    float _windowPower = 0;
+
+    // The most recent fftSize samples
+    std::vector<int16_t> _history;
+    unsigned _historyPos = 0;
+    unsigned _historyCount = 0;
+    // Samples received since the last frame was analyzed
+    unsigned _newSamples = 0;
+
+    std::vector<float> _frame, _re, _im;
+    // Accumulated |X[k]|^2
+    std::vector<float> _psd;
+    unsigned _frameCount = 0;
+
+    bool _ready = false;
+    float _peakHz = 0;
+    float _peakDbfs = -99;
+    float _sinadDb = 0;
+    float _humDbfs = -99;
+};
+
+    }
+}
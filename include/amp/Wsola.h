@@ -0,0 +1,82 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * Time-scale modification of PCM16 audio in whole 20ms blocks using a
+ * WSOLA-style (Waveform Similarity Overlap-Add) splice. This is used to
+ * shrink or grow the jitter buffer delay in the middle of a talkspurt
+ * without a gap or a click.
+ *
+ * Both operations work on two consecutive blocks (x, 2n samples) and
+ * make a single jump of exactly n samples. The point of the jump is
+ * chosen where the waveform is most similar to itself n samples away
+ * (i.e. a whole number of pitch periods for voiced speech) and a short
+ * cross-fade hides whatever difference remains. The output always starts
+ * and ends on the same samples that a normal playout would have, so the
+ * result joins seamlessly with the blocks on either side.
+ */
+class Wsola {
+public:
+
+    /**
+     * Squeezes two blocks into one block.
+     *
+     * @param x 2n samples: the two blocks to be played.
+     * @param n The block size.
+     * @param out n samples.
+     */
+    static void compress(const int16_t* x, unsigned n, int16_t* out);
+
+    /**
+     * Stretches one block into two blocks.
+     *
+     * @param x 2n samples: the previous block (already played) followed
+     * by the block to be played. The previous block is used as the
+     * source of the extra audio.
+     * @param n The block size.
+     * @param out 2n samples.
+     */
+    static void expand(const int16_t* x, unsigned n, int16_t* out);
+
+    /**
+     * @returns The length of the cross-fade (5ms) for the block size.
+     */
+    static unsigned overlapSize(unsigned n) { return n / 4; }
+
+private:
+
+    /**
+     * @returns The offset t in [0, n - overlap] where a[t...] and b[t...]
+     * are most similar.
+     */
+    static unsigned _bestSplice(const int16_t* a, const int16_t* b, unsigned n);
+
+    /**
+     * Linear cross-fade from a to b over len samples.
+     */
+    static void _crossFade(const int16_t* a, const int16_t* b, unsigned len,
+        int16_t* out);
+};
+
+    }
+}
@@ -14,15 +14,26 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <cassert>
 #include <iostream>
 #include <cstring> 
 #include <thread>
+#include <algorithm>
 
 #include "kc1fsz-tools/Log.h"
 #include "kc1fsz-tools/Clock.h"
 
+#include "amp/MixKernels.h"
+#include "amp/FixedMath.h"
+
 #include "Bridge.h"
 
+// How long a selected talker keeps its slot after its audio stops
+#define TALKER_HANGOVER_MS (500)
+// How much louder a waiting talker needs to be to take the slot of 
+// a selected talker
+#define TALKER_PREEMPT_FACTOR (2)
+
 using namespace std;
 
 namespace kc1fsz {
@@ -51,18 +62,76 @@ Bridge::Bridge(Log& log, Log& traceLog, Clock& clock, MessageConsumer& bus,
 
     // One-time (static) setup of all calls. Calls start numbering
     // at 2 to avoid any confusion with 0 and 1.
+    _activeCalls.reserve(callSpaceLen);
+    _contributors.reserve(callSpaceLen);
     for (unsigned i = 0; i < callSpaceLen; i++)
         callSpace[i].init(this, &log, &traceLog, &clock, &_bus, 
             _lineId, i + 2, _ttsLineId, _netTestLineId, netTestBindAddr);
+
+    // The shared outputs just capture the encoded frame so that it can
+    // be handed to each listener.
+    for (unsigned i = 0; i < SHARED_OUTPUT_COUNT; i++) {
+        SharedOutput* so = &_sharedOutputs[i];
+        so->out.init(&log, &clock);
+        so->out.setSink([so](const Message& msg) {
+            if (msg.getType() == Message::Type::AUDIO) {
+                assert(msg.size() <= sizeof(so->code));
+                memcpy(so->code, msg.body(), msg.size());
+                so->codeSize = msg.size();
+            }
+        });
+    }
+    _resetSharedOutputs();
 }
 
 void Bridge::reset() {
     _calls.visitAll(RESET_VISITOR);
+    _activeCalls.clear();
+    _contributors.clear();
     _lastCallListChangeMs = 0;
     _statusMessageText.clear();
     _statusMessageUpdateMs = 0;
     _statusMessageLevel = 0;
     _maxTickUs = 0;
+    for (unsigned i = 0; i < PHASE_COUNT; i++) {
+        _phaseHist[i].reset();
+        _lastPhaseHist[i].reset();
+    }
+    _tickStatsChangeMs = 0;
+    _cpuUsByCodec.clear();
+    _networkStatus.clear();
+    _networkStatusChangeMs = 0;
+    for (unsigned i = 0; i < MODE_COUNT; i++)
+        _cpuUsByMode[i] = 0;
+    _talkerSelectionChangeMs = 0;
+    _bypassSource = nullptr;
+    _lastBypassSource = BypassSourceRef();
+    _resetSharedOutputs();
+}
+
+void Bridge::_resetSharedOutputs() {
+    // NOTE: This order is assumed in _getSharedOutput()
+    const CODECType codecs[SHARED_OUTPUT_COUNT] = { 
+        CODECType::IAX2_CODEC_G711_ULAW, 
+        CODECType::IAX2_CODEC_SLIN_8K, 
+        CODECType::IAX2_CODEC_SLIN_16K };
+    for (unsigned i = 0; i < SHARED_OUTPUT_COUNT; i++) {
+        _sharedOutputs[i].out.reset();
+        _sharedOutputs[i].out.setCodec(codecs[i]);
+        _sharedOutputs[i].ready = false;
+        _sharedOutputs[i].codeSize = 0;
+    }
+}
+
+Bridge::SharedOutput* Bridge::_getSharedOutput(CODECType codec) {
+    if (codec == CODECType::IAX2_CODEC_G711_ULAW)
+        return &_sharedOutputs[0];
+    else if (codec == CODECType::IAX2_CODEC_SLIN_8K)
+        return &_sharedOutputs[1];
+    else if (codec == CODECType::IAX2_CODEC_SLIN_16K)
+        return &_sharedOutputs[2];
+    else 
+        return 0;
 }
 
 unsigned Bridge::getCallCount() const {
@@ -95,6 +164,26 @@ void Bridge::setParrotLevelThresholds(std::vector<int>& thresholds) {
     _parrotLevelThresholds = thresholds;
 }
 
+void Bridge::setWorkerThreads(unsigned n) {
+    unsigned current = _workers ? _workers->getThreadCount() : 1;
+    if (n == 0)
+        n = 1;
+    if (n == current)
+        return;
+    _log.info("Bridge worker threads %u", n);
+    if (n == 1)
+        _workers.reset();
+    else 
+        _workers = std::make_unique<WorkerPool>(n);
+}
+
+void Bridge::setMaxTalkers(unsigned k) {
+    if (k == _maxTalkers)
+        return;
+    _log.info("Bridge max talkers %u", k);
+    _maxTalkers = k;
+}
+
 vector<string> Bridge::getConnectedNodes() const {
     vector<string> result;
     _visitActiveCalls(
@@ -122,6 +211,9 @@ uint64_t Bridge::getStatusDocStampMs() const {
     // the possibly dynamic elements of the Bridge.
     uint64_t maxStampMs = _lastCallListChangeMs;
     maxStampMs = max(maxStampMs, _statusMessageUpdateMs);
+    maxStampMs = max(maxStampMs, _talkerSelectionChangeMs);
+    maxStampMs = max(maxStampMs, _tickStatsChangeMs);
+    maxStampMs = max(maxStampMs, _networkStatusChangeMs);
 
     // Check each call for more recent activity
     _visitActiveCalls(
@@ -166,6 +258,56 @@ json Bridge::getStatusDoc() const {
 
     root["calls"] = calls;
 
+    // Talker selection
+    root["busRate"] = _busRate;
+    root["maxTalkers"] = _maxTalkers;
+    auto talkers = json::array();
+    _visitActiveCalls(
+        [&talkers](const BridgeCall& call) { 
+            if (call.isSelectedTalker())
+                talkers.push_back(call.getRemoteNodeNumber());
+            return true;
+        }
+    );
+    root["talkers"] = talkers;
+
+    // Processing time
+    json tickStats;
+    const char* phaseNames[PHASE_COUNT] = { "input", "mix", "output", "total" };
+    for (unsigned i = 0; i < PHASE_COUNT; i++) {
+        json h;
+        h["count"] = _lastPhaseHist[i].getCount();
+        h["p50Us"] = _lastPhaseHist[i].getPercentile(50);
+        h["p99Us"] = _lastPhaseHist[i].getPercentile(99);
+        h["maxUs"] = _lastPhaseHist[i].getMax();
+        tickStats[phaseNames[i]] = h;
+    }
+    json byCodec = json::object();
+    for (const auto& [codec, us] : _cpuUsByCodec)
+        byCodec[codecName(codec)] = us;
+    tickStats["cpuUsByCodec"] = byCodec;
+    json byMode;
+    for (unsigned i = 0; i < MODE_COUNT; i++)
+        byMode[BridgeCall::modeName((BridgeCall::Mode)i)] = _cpuUsByMode[i];
+    tickStats["cpuUsByMode"] = byMode;
+    root["tickStats"] = tickStats;
+
+    // Socket health of the network lines
+    json network = json::object();
+    for (const auto& [lineId, status] : _networkStatus) {
+        json n;
+        n["txBufferSize"] = status.txBufferSize;
+        n["txQueuedMax"] = status.txQueuedMax;
+        n["rxBufferSize"] = status.rxBufferSize;
+        n["rxQueuedMax"] = status.rxQueuedMax;
+        n["rxDrops"] = status.rxDrops;
+        n["txDrops"] = status.txDrops;
+        n["rxPackets"] = status.rxPackets;
+        n["txPackets"] = status.txPackets;
+        network[std::to_string(lineId)] = n;
+    }
+    root["network"] = network;
+
     return root;
 }
 
@@ -245,6 +387,7 @@ void Bridge::consume(const Message& msg) {
             // Predicate
             [this, &msg](const BridgeCall& s) { return s.belongsTo(msg); }
         );
+        _forgetLastBypassSource(msg);
         
         // Add new session for this call
         // #### TODO: CONSIDER POSITIVE ACK ON ACCEPTED CALL AND ELIMINATE
@@ -284,8 +427,13 @@ void Bridge::consume(const Message& msg) {
 
             // Here we are converting the gain from a dB float to 
             // a q11 fixed integer format.
+#ifdef AMP_FIXED_POINT
+            int16_t echoGainQ11 = std::min(amp::dbToGainQ(payload.echoGainDb * 256.0f, 11), 
+                (int32_t)INT16_MAX);
+#else
             float echoGain = std::pow(10.0f, (payload.echoGainDb / 20.0f));
             int16_t echoGainQ11 = echoGain * 2048.0f;
+#endif
 
             BridgeCall& call = _calls.at(newIndex);
             call.setup(msg.getSourceBusId(), msg.getSourceCallId(), 
@@ -295,6 +443,8 @@ void Bridge::consume(const Message& msg) {
                 payload.sourceAddrValidated, _defaultMode, 
                 payload.remoteNumber, payload.permanent, useKerchunkFilter,
                 _kerchunkFilterDelayMs);
+            call.setAdaptiveJitterBuffer(_adaptivePlayout);
+            _addActiveCall(newIndex);
 
             // Play the greeting to the new caller, but not for calls that 
             // we originated in the first place
@@ -353,6 +503,7 @@ void Bridge::consume(const Message& msg) {
             // Predicate
             [&msg](const BridgeCall& c) { return c.belongsTo(msg); }         
         );
+        _forgetLastBypassSource(msg);
 
         // Announce the dropped connection to all of the *other* active calls
         string prompt = "Node ";
@@ -378,6 +529,21 @@ void Bridge::consume(const Message& msg) {
             }
         );
     }
+    else if (msg.isSignal(Message::SignalType::NETWORK_STATUS)) {
+
+        PayloadNetworkStatus payload;
+        assert(msg.size() == sizeof(payload));
+        memcpy(&payload, msg.body(), sizeof(payload));
+
+        // The packet counters move all of the time so the document is
+        // only marked as changed when something is dropped.
+        auto it = _networkStatus.find(msg.getSourceBusId());
+        if (it == _networkStatus.end() || 
+            it->second.rxDrops != payload.rxDrops ||
+            it->second.txDrops != payload.txDrops)
+            _networkStatusChangeMs = _clock.timeMs();
+        _networkStatus[msg.getSourceBusId()] = payload;
+    }
     // Everything else gets passed directly to the call.
     else {
         _calls.visitIf(
@@ -399,78 +565,150 @@ void Bridge::consume(const Message& msg) {
  * 
  * 1. Ask each active (speaking) conference participant to prepare input audio 
  *    frame to contribute to the final mix.
- * 2. Prepare a mixed audio frame for each conference participant. This is 
- *    customized because not all participants will want to hear their own audio
- *    in the mix.
- * 3. Give each participant an output audio frame.
- * 4. Clear the contributors' audio so its not used the next time.
+ * 2. Build a single 32-bit conference sum that contains every contributor. 
+ * 3. Derive a customized output for each participant by removing that 
+ *    participant's own contribution from the conference sum (and adding 
+ *    back the echo-scaled version if echo is enabled). Not all participants 
+ *    want to hear their own audio in the mix.
+ * 4. Give each participant an output audio frame.
+ * 5. Clear the contributors' audio so its not used the next time.
  *
+ * The cost of this process grows linearly with the number of calls. 
+ * 
  * PERFORMANCE CRITICAL AREA!
  */
 void Bridge::audioRateTick(uint32_t tickMs) {
 
     uint64_t startUs = _clock.timeUs();
-    
-    // Tick each call so that we have an input frame for each.
+
+    _pruneActiveCalls();
+    _updateBusRate();
+
+    // ----- Phase 1: Input --------------------------------------------------
+    //
+    // Jitter buffer playout, decoding and upsampling. In NORMAL mode a call
+    // only touches its own state here so this work can be spread across 
+    // the workers. Anything that the calls log while on the workers is
+    // held and then released on this thread in call order.
+    const bool deferOutput = _workers != nullptr;
+    _runPhase([this, tickMs, deferOutput](unsigned i) {
+        if (_calls[i].isActive() && _calls[i].isNormal()) {
+            uint64_t callStartUs = _clock.timeUs();
+            if (deferOutput)
+                _calls[i].beginDeferredOutput();
+            _calls[i].inputAudioRateTick(tickMs);
+            _calls[i].addCpuUs(_clock.timeUs() - callStartUs);
+        }
+    });
+
+    // The other modes can interact with the rest of the system so they 
+    // always run on this thread.
     _visitActiveCalls(
-        [tickMs](BridgeCall& call) { 
-            // Tick the call to get it to produce an audio frame
-            call.audioRateTick(tickMs);
+        [this, tickMs, deferOutput](BridgeCall& call) { 
+            if (deferOutput)
+                call.flushDeferredOutput();
+            uint64_t callStartUs = _clock.timeUs();
+            if (!call.isNormal())
+                call.inputAudioRateTick(tickMs);
+            call.modeAudioRateTick(tickMs);
+            call.addCpuUs(_clock.timeUs() - callStartUs);
             return true;
         }
     );
 
-    // Perform mixing and create a mixed output for each active call
-    for (unsigned i = 0; i < _calls.size(); i++) {
-       
-        if (!_calls[i].isActive())
-            continue;
+    uint64_t inputEndUs = _clock.timeUs();
 
-        // Figure out how many calls we are mixing. Keep in mind that calls only contribute
-        // audio to themselves if echo mode is enabled for that call.
-        int mixCount = 0;
-        for (unsigned j = 0; j < _calls.size(); j++) {
-            // Ignore calls that are inactive or are silent
-            if (!_calls[j].isActive())
-                continue;
-            if (!_calls[j].hasInputAudio())
-                continue;
-            // Ignore ourself if echo is turned off
-            if (i == j && !_calls[j].isEcho())
-                continue;
-            mixCount++;
-        }
+    // ----- Phase 2: Mix ----------------------------------------------------
 
-        // This is the target for the mixing of the conference audio
-        int16_t mixedFrame[BLOCK_SIZE_48K] = { 0 };
+    _selectTalkers(tickMs);
 
-        // Now do the actual mixing
-        if (mixCount > 0) {
-            for (unsigned j = 0; j < _calls.size(); j++) {
-                // Ignore calls that are inactive or are silent
-                if (!_calls[j].isActive())
-                    continue;
-                // Ignore calls that have nothing to contribute
-                if (!_calls[j].hasInputAudio())
-                    continue;
-                // Default to scale of 1.0 in q11 format
-                int16_t echoScale_q11 = 2048;
-                // Look for the echo case.
-                if (i == j) {
-                    // Ignore calls that have echo turned off
-                    if (!_calls[i].isEcho())
-                        continue;
-                    echoScale_q11 = _calls[i].getEchoScale();
-                }
-                // Mix call j's input into call i's output.
-                // NOTE: This appears to be the most time-critical step in this 
-                // process at the moment!
-                _calls[j].extractInputAudio(mixedFrame, BLOCK_SIZE_48K, mixCount, tickMs, echoScale_q11);
-            }
+    // Figure out which calls are contributing to the conference. 
+    _contributors.clear();
+    bool anyNonEchoContributors = false;
+    for (unsigned j : _activeCalls) {
+        if (_calls[j].isActive() && _calls[j].isContributing()) {
+            _contributors.push_back(j);
+            if (!_calls[j].isEcho())
+                anyNonEchoContributors = true;
         }
+    }
+    const int contributorCount = _contributors.size();
+
+    // Build the conference sum(s). Keep in mind that each contributor is 
+    // scaled by 1/mixCount, and the mixCount seen by a listener depends on
+    // whether the listener is also a contributor with echo turned off 
+    // (in which case the listener hears one less talker). So we build a 
+    // second sum for that case, but only if it is actually needed.
+    const bool needLessSum = anyNonEchoContributors && contributorCount > 1;
+    if (contributorCount > 0) {
+        memset(_confSum, 0, sizeof(_confSum));
+        if (needLessSum)
+            memset(_confSumLess, 0, sizeof(_confSumLess));
+        for (unsigned j : _contributors) {
+            _calls[j].extractInputAudio(_confSum, _busBlockSize, 
+                contributorCount, tickMs);
+            if (needLessSum) 
+                _calls[j].extractInputAudio(_confSumLess, _busBlockSize, 
+                    contributorCount - 1, tickMs);
+        }
+    }
 
-        // Output call i's final/total result
-        _calls[i].setConferenceOutput(mixedFrame, BLOCK_SIZE_48K, tickMs, mixCount);
+    if (contributorCount > 0)
+        MixKernels::get().narrowSaturate(_confMix, _confSum, _busBlockSize);
+
+    // The transcoding bypass is possible when there is exactly one talker
+    // and its original frame is available.
+    _bypassSource = nullptr;
+    if (_bypassEnabled && contributorCount == 1 && 
+        _calls[_contributors[0]].getBypassFrame())
+        _bypassSource = &_calls[_contributors[0]];
+
+    // Encode the shared outputs (at most once per CODEC) for the listeners
+    // that will use them.
+    for (unsigned k = 0; k < SHARED_OUTPUT_COUNT; k++)
+        _sharedOutputs[k].ready = false;
+    for (unsigned i : _activeCalls) {
+        if (contributorCount == 0)
+            break;
+        if (!_calls[i].isActive() || !_usesSharedOutput(_calls[i]))
+            continue;
+        SharedOutput* so = _getSharedOutput(_calls[i].getOutputCodec());
+        assert(so != 0);
+        if (so->ready)
+            continue;
+        uint8_t space[BLOCK_SIZE_16K * 2];
+        MessageWrapper msg = BridgeOut::makeBusFrame(_confMix, _busBlockSize, 
+            space, tickMs);
+        so->out.consume(msg);
+        so->ready = true;
+    }
+
+    uint64_t mixEndUs = _clock.timeUs();
+
+    // ----- Phase 3: Output -------------------------------------------------
+    //
+    // Each call's mix-minus, downsampling and encoding. When this runs on
+    // the workers the output messages are held by each call and then 
+    // released on this thread in call order so that the result is the 
+    // same as the single-threaded case.
+    _runPhase([this, tickMs, contributorCount, deferOutput](unsigned i) {
+        if (!_calls[i].isActive())
+            return;
+        uint64_t callStartUs = _clock.timeUs();
+        if (deferOutput)
+            _calls[i].beginDeferredOutput();
+        _mixCallOutput(_calls[i], tickMs, contributorCount);
+        _calls[i].addCpuUs(_clock.timeUs() - callStartUs);
+    });
+    if (deferOutput)
+        _visitActiveCalls([](BridgeCall& call) { call.flushDeferredOutput(); return true; });
+
+    _lastBypassSource = BypassSourceRef();
+    if (_bypassSource) {
+        _lastBypassSource.index = _contributors[0];
+        _lastBypassSource.lineId = _bypassSource->getLineId();
+        _lastBypassSource.callId = _bypassSource->getCallId();
+        _lastBypassSource.codec = _bypassSource->getInputCodec();
     }
 
     // Clear all contributions for this tick
@@ -478,6 +716,22 @@ void Bridge::audioRateTick(uint32_t tickMs) {
     
     uint64_t endUs = _clock.timeUs();
     uint64_t durUs = endUs - startUs;
+
+    _phaseHist[PHASE_INPUT].add(inputEndUs - startUs);
+    _phaseHist[PHASE_MIX].add(mixEndUs - inputEndUs);
+    _phaseHist[PHASE_OUTPUT].add(endUs - mixEndUs);
+    _phaseHist[PHASE_TOTAL].add(durUs);
+
+    // Charge each call's time to its CODEC and mode
+    _visitActiveCalls(
+        [this](BridgeCall& call) { 
+            uint32_t us = call.takeTickCpuUs();
+            _cpuUsByCodec[call.getInputCodec()] += us;
+            _cpuUsByMode[call.getMode()] += us;
+            return true;
+        }
+    );
+
     if (durUs > _maxTickUs) {
         _maxTickUs = durUs;
         if (_maxTickUs > 5000)
@@ -485,6 +739,229 @@ void Bridge::audioRateTick(uint32_t tickMs) {
     }
 }
 
+void Bridge::_runPhase(const std::function<void(unsigned)>& fn) {
+    if (_workers)
+        _workers->run(_activeCalls.size(), 
+            [this, &fn](unsigned k) { fn(_activeCalls[k]); });
+    else 
+        for (unsigned i : _activeCalls)
+            fn(i);
+}
+
+void Bridge::_addActiveCall(unsigned index) {
+    // Kept in slot order so that everything happens in the same order
+    // as a walk of the entire call space.
+    auto it = std::lower_bound(_activeCalls.begin(), _activeCalls.end(), index);
+    if (it == _activeCalls.end() || *it != index)
+        _activeCalls.insert(it, index);
+}
+
+void Bridge::_pruneActiveCalls() {
+    std::erase_if(_activeCalls, [this](unsigned i) { return !_calls[i].isActive(); });
+}
+
+void Bridge::_updateBusRate() {
+    // Mix at 16K unless someone can make use of 48K audio
+    unsigned rate = 48000;
+    if (_adaptiveBusRate) {
+        rate = 16000;
+        for (unsigned i : _activeCalls) 
+            if (_calls[i].isActive() && 
+                (codecSampleRate(_calls[i].getInputCodec()) == 48000 ||
+                 codecSampleRate(_calls[i].getOutputCodec()) == 48000))
+                rate = 48000;
+    }
+    if (rate != _busRate) {
+        _log.info("Bridge bus rate %u", rate);
+        _busRate = rate;
+        _busBlockSize = (rate == 16000) ? BLOCK_SIZE_16K : BLOCK_SIZE_48K;
+    }
+    // This also picks up new calls
+    for (unsigned i : _activeCalls) 
+        if (_calls[i].isActive() && _calls[i].getBusRate() != _busRate)
+            _calls[i].setBusRate(_busRate);
+}
+
+bool Bridge::_usesSharedOutput(const BridgeCall& call) const {
+    // Listeners that hear exactly the conference sum (i.e. they aren't
+    // contributing, or they are contributing with unity echo) can share 
+    // a single resampled/encoded frame with everyone else that is using 
+    // the same CODEC.
+    const bool hearsConfSum = !call.isContributing() ||
+        (call.isEcho() && call.getEchoScale() == 2048);
+    // Anyone coming out of the bypass needs their own output for the 
+    // crossfade.
+    return hearsConfSum && call.canShareConferenceOutput() && 
+        !call.isBypassActive() && !_usesBypass(call);
+}
+
+bool Bridge::_usesBypass(const BridgeCall& call) const {
+    return _bypassSource && 
+        &call != _bypassSource &&
+        !call.isContributing() && 
+        call.canShareConferenceOutput() &&
+        call.getOutputCodec() == _bypassSource->getInputCodec();
+}
+
+const BridgeCall* Bridge::_getLastBypassSource() const {
+    const BypassSourceRef& ref = _lastBypassSource;
+    if (ref.index < 0)
+        return nullptr;
+    const BridgeCall& call = _calls[ref.index];
+    if (!call.isActive() || 
+        call.getLineId() != ref.lineId || 
+        call.getCallId() != ref.callId ||
+        call.getInputCodec() != ref.codec)
+        return nullptr;
+    return &call;
+}
+
+void Bridge::_forgetLastBypassSource(const Message& msg) {
+    if (_lastBypassSource.index >= 0 &&
+        msg.getSourceBusId() == _lastBypassSource.lineId &&
+        msg.getSourceCallId() == _lastBypassSource.callId)
+        _lastBypassSource = BypassSourceRef();
+}
+
+void Bridge::_mixCallOutput(BridgeCall& call, uint32_t tickMs, int contributorCount) {
+
+    const MixKernels& mix = MixKernels::get();
+
+    // A single talker using our CODEC is forwarded without transcoding
+    if (_usesBypass(call)) {
+        call.setConferenceOutputBypass(*_bypassSource->getBypassFrame(), 
+            _confMix, tickMs);
+        return;
+    }
+
+    if (contributorCount > 0 && _usesSharedOutput(call)) {
+        const SharedOutput* so = _getSharedOutput(call.getOutputCodec());
+        assert(so != 0 && so->ready);
+        call.setConferenceOutputEncoded(so->code, so->codeSize, tickMs, 
+            contributorCount);
+        return;
+    }
+
+    // This is the target for the mixing of the conference audio
+    int16_t mixedFrame[BLOCK_SIZE_48K];
+    int mixCount = 0;
+
+    // Listeners that aren't contributing just hear the whole conference.
+    if (!call.isContributing()) {
+        mixCount = contributorCount;
+        if (mixCount > 0)
+            mix.narrowSaturate(mixedFrame, _confSum, _busBlockSize);
+    }
+    // Contributors with echo hear everything, but their own audio is 
+    // replaced by the echo-scaled version.
+    else if (call.isEcho()) {
+        mixCount = contributorCount;
+        int32_t acc[BLOCK_SIZE_48K];
+        memcpy(acc, _confSum, sizeof(acc));
+        if (call.getEchoScale() != 2048) {
+            call.extractInputAudio(acc, _busBlockSize, mixCount, tickMs, -2048);
+            call.extractInputAudio(acc, _busBlockSize, mixCount, tickMs, 
+                call.getEchoScale());
+        }
+        mix.narrowSaturate(mixedFrame, acc, _busBlockSize);
+    }
+    // Contributors without echo hear everyone else.
+    else {
+        mixCount = contributorCount - 1;
+        if (mixCount > 0) {
+            int32_t acc[BLOCK_SIZE_48K];
+            memcpy(acc, _confSumLess, sizeof(acc));
+            call.extractInputAudio(acc, _busBlockSize, mixCount, tickMs, -2048);
+            mix.narrowSaturate(mixedFrame, acc, _busBlockSize);
+        }
+    }
+
+    if (mixCount == 0)
+        memset(mixedFrame, 0, sizeof(mixedFrame));
+
+    // If the call was getting the bypass on the last tick then use the 
+    // talker's current frame (if it is still talking) to fade out of it.
+    // The frame is decoded by this call's output pipeline so it has to 
+    // be in this call's CODEC.
+    const Message* bypassFadeFrame = nullptr;
+    const BridgeCall* fadeSource = _getLastBypassSource();
+    if (call.isBypassActive() && fadeSource && 
+        fadeSource->getInputCodec() == call.getOutputCodec())
+        bypassFadeFrame = fadeSource->getBypassFrame();
+
+    // Output the call's final/total result
+    call.setConferenceOutput(mixedFrame, _busBlockSize, tickMs, mixCount, 
+        bypassFadeFrame);
+}
+
+void Bridge::_selectTalkers(uint32_t tickMs) {
+
+    bool changed = false;
+    unsigned selectedCount = 0;
+
+    // Without a limit everyone with audio is selected. Otherwise the 
+    // selected talkers keep their slot through short pauses.
+    for (unsigned i : _activeCalls) {
+        BridgeCall& call = _calls[i];
+        if (!call.isActive())
+            continue;
+        bool selected;
+        if (_maxTalkers == 0)
+            selected = call.hasInputAudio();
+        else 
+            selected = call.isSelectedTalker() && 
+                (tickMs - call.getLastInputTickMs()) <= TALKER_HANGOVER_MS;
+        if (selected != call.isSelectedTalker()) {
+            call.setSelectedTalker(selected);
+            changed = true;
+        }
+        if (selected)
+            selectedCount++;
+    }
+
+    // Fill any open slots with the loudest waiting talkers, and let a much 
+    // louder waiting talker take the slot of the quietest selected talker.
+    // Each pass makes one change so this is bounded.
+    for (unsigned pass = 0; _maxTalkers > 0 && pass < _activeCalls.size(); pass++) {
+
+        int loudest = -1, quietest = -1;
+        for (unsigned i : _activeCalls) {
+            const BridgeCall& call = _calls[i];
+            if (!call.isActive())
+                continue;
+            if (call.isSelectedTalker()) {
+                if (quietest == -1 || call.getInputLevel() < _calls[quietest].getInputLevel())
+                    quietest = i;
+            }
+            else if (call.hasInputAudio()) {
+                if (loudest == -1 || call.getInputLevel() > _calls[loudest].getInputLevel())
+                    loudest = i;
+            }
+        }
+
+        if (loudest == -1)
+            break;
+
+        if (selectedCount < _maxTalkers) {
+            selectedCount++;
+        } 
+        else if (quietest != -1 && _calls[loudest].getInputLevel() > 
+            _calls[quietest].getInputLevel() * TALKER_PREEMPT_FACTOR) {
+            _calls[quietest].setSelectedTalker(false);
+        }
+        else 
+            break;
+
+        _calls[loudest].setSelectedTalker(true);
+        changed = true;
+    }
+
+    // Without a limit the selection follows every pause in the audio, 
+    // so it isn't worth reporting.
+    if (changed && _maxTalkers > 0)
+        _talkerSelectionChangeMs = _clock.timeMs();
+}
+
 void Bridge::oneSecTick() {
 
     // Tick each call
@@ -529,6 +1006,13 @@ void Bridge::oneSecTick() {
 
 void Bridge::tenSecTick() {
 
+    // Start a new window for the tick statistics
+    for (unsigned i = 0; i < PHASE_COUNT; i++) {
+        _lastPhaseHist[i] = _phaseHist[i];
+        _phaseHist[i].reset();
+    }
+    _tickStatsChangeMs = _clock.timeMs();
+
     // #### TODO: REVIEW getConnectedNodes() and eliminate some redundancy
 
     std::vector<std::string> connectList;
@@ -572,11 +1056,15 @@ void Bridge::tenSecTick() {
 }
 
 void Bridge::_visitActiveCalls(std::function<bool(BridgeCall&)> cb) {
-    _calls.visitIf(cb, ACTIVE_PRED);
+    for (unsigned i : _activeCalls)
+        if (_calls[i].isActive() && !cb(_calls[i]))
+            break;
 }
 
 void Bridge::_visitActiveCalls(std::function<bool(const BridgeCall&)> cb) const {
-    _calls.visitIf(cb, ACTIVE_PRED);
+    for (unsigned i : _activeCalls)
+        if (_calls[i].isActive() && !cb(_calls[i]))
+            break;
 }
 
     }
@@ -18,6 +18,8 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <map>
 
 // 3rd party
 #include <nlohmann/json.hpp>
@@ -31,6 +33,8 @@
 #include "MessageConsumer.h"
 #include "Message.h"
 #include "BridgeCall.h"
+#include "WorkerPool.h"
+#include "LatencyHistogram.h"
 
 using json = nlohmann::json;
 
@@ -91,6 +95,61 @@ public:
 
     void setParrotLevelThresholds(std::vector<int>& thresholds);
 
+    /**
+     * Limits the conference mix to the K loudest talkers on each tick.
+     * Anyone else who is keyed up is left out of the mix until a slot
+     * opens up, or until they are much louder than the quietest selected
+     * talker. Selected talkers keep their slot through short pauses. 
+     * 
+     * @param k The maximum number of talkers, or zero for no limit (the 
+     * default).
+     */
+    void setMaxTalkers(unsigned k);
+
+    unsigned getMaxTalkers() const { return _maxTalkers; }
+
+    /**
+     * When enabled (the default) the conference audio is mixed at 16K 
+     * unless there is a 48K endpoint (ex: LineUsb) attached, which saves
+     * a lot of resampling and mixing for the common case where everyone 
+     * is an 8K or 16K IAX2 caller. When disabled the conference is always 
+     * mixed at 48K.
+     */
+    void setAdaptiveBusRate(bool b) { _adaptiveBusRate = b; }
+
+    /**
+     * @returns The sample rate of the conference audio (16000 or 48000).
+     */
+    unsigned getBusRate() const { return _busRate; }
+
+    /**
+     * When enabled (the default) and there is exactly one talker, listeners
+     * that use the same (stateless) CODEC as the talker are sent the 
+     * talker's original encoded frames instead of a decoded/mixed/re-encoded
+     * version. 
+     */
+    void setTranscodingBypassEnabled(bool b) { _bypassEnabled = b; }
+
+    /**
+     * When enabled the jitter buffer delay of each call (that isn't 
+     * bypassing the jitter buffer) follows the measured network jitter. 
+     * Good links get much lower latency and bad links lose fewer frames.
+     * When disabled the delay is fixed. Applies to calls that start 
+     * after the change.
+     */
+    void setAdaptivePlayoutEnabled(bool b) { _adaptivePlayout = b; }
+
+    /**
+     * Spreads the per-call work of each tick (input decoding and output 
+     * encoding) across a pool of threads. The output is identical to the
+     * single-threaded case.
+     * 
+     * @param n The total number of threads, including the one that calls
+     * audioRateTick(). 0 or 1 means that everything runs on the calling 
+     * thread (the default).
+     */
+    void setWorkerThreads(unsigned n);
+
     unsigned getCallCount() const;
 
     std::vector<std::string> getConnectedNodes() const;
@@ -130,6 +189,60 @@ private:
     void _visitActiveCalls(std::function<bool(BridgeCall&)> cb);
     void _visitActiveCalls(std::function<bool(const BridgeCall&)> cb) const;
 
+    /**
+     * Used to resample/encode the conference mix once per tick on behalf of
+     * all of the listeners that hear exactly the same thing in the same 
+     * CODEC. 
+     */
+    struct SharedOutput {
+        BridgeOut out;
+        // Set once the mix has been encoded on the current tick
+        bool ready = false;
+        unsigned codeSize = 0;
+        // NOTE: Make this big enough for any format!
+        uint8_t code[BLOCK_SIZE_8K * 4];
+    };
+
+    /**
+     * Decides which calls are allowed to contribute to the conference
+     * on this tick. See setMaxTalkers().
+     */
+    void _selectTalkers(uint32_t tickMs);
+
+    /**
+     * Calls fn(i) for every call slot, using the workers if they are 
+     * enabled. Returns once everything is finished.
+     */
+    void _runPhase(const std::function<void(unsigned)>& fn);
+
+    void _updateBusRate();
+    void _addActiveCall(unsigned index);
+    void _pruneActiveCalls();
+    bool _usesSharedOutput(const BridgeCall& call) const;
+    bool _usesBypass(const BridgeCall& call) const;
+
+    /**
+     * @returns The call that was the bypass source on the last tick, or 
+     * nullptr if that call has ended or its slot now holds something else.
+     */
+    const BridgeCall* _getLastBypassSource() const;
+
+    /**
+     * Forgets the last bypass source if the message (a CALL_START or 
+     * CALL_END) is for that call.
+     */
+    void _forgetLastBypassSource(const Message& msg);
+
+    /**
+     * Builds the mix that a call hears and passes it to the call's 
+     * output pipeline. This only touches the state of the call itself
+     * so it can run on a worker thread.
+     */
+    void _mixCallOutput(BridgeCall& call, uint32_t tickMs, int contributorCount);
+
+    void _resetSharedOutputs();
+    SharedOutput* _getSharedOutput(CODECType codec);
+
     Log& _log;
     Log& _traceLog;
     Clock& _clock;
@@ -160,7 +273,80 @@ private:
     unsigned _statusMessageLevel = 0;
 
     uint64_t _maxTickUs = 0;
+
+    // Tick instrumentation. The histograms cover a 10 second window
+    // (see tenSecTick()) and the last complete window is reported in 
+    // the status document.
+    enum TickPhase { PHASE_INPUT, PHASE_MIX, PHASE_OUTPUT, PHASE_TOTAL, PHASE_COUNT };
+    LatencyHistogram _phaseHist[PHASE_COUNT];
+    LatencyHistogram _lastPhaseHist[PHASE_COUNT];
+    uint64_t _tickStatsChangeMs = 0;
+    // Cumulative per-call processing time by CODEC and by mode
+    std::map<CODECType, uint64_t> _cpuUsByCodec;
+    static const unsigned MODE_COUNT = BridgeCall::Mode::PROGRAM + 1;
+    uint64_t _cpuUsByMode[MODE_COUNT] = { 0 };
+
+    // The latest socket health report from each network line (by bus ID)
+    std::map<unsigned, PayloadNetworkStatus> _networkStatus;
+    uint64_t _networkStatusChangeMs = 0;
+
+    // Top-K talker selection, zero means unlimited
+    unsigned _maxTalkers = 0;
+    // The last time the set of selected talkers changed
+    uint64_t _talkerSelectionChangeMs = 0;
     const bool _parrotConference;
+
+    // The conference rate
+    bool _adaptiveBusRate = true;
+    unsigned _busRate = 48000;
+    unsigned _busBlockSize = BLOCK_SIZE_48K;
+
+    // The conference sums that are built on each tick. These are kept
+    // off of the stack because of their size. Only the first _busBlockSize
+    // samples are used.
+    // _confSum contains every contributor scaled by 1/contributors.
+    int32_t _confSum[BLOCK_SIZE_48K];
+    // _confSumLess contains every contributor scaled by 1/(contributors - 1)
+    // and is only used by listeners who are contributing without echo.
+    int32_t _confSumLess[BLOCK_SIZE_48K];
+    // _confSum narrowed to 16 bits, used by the shared outputs and the 
+    // transcoding bypass.
+    int16_t _confMix[BLOCK_SIZE_48K];
+
+    // One per shareable CODEC (see BridgeOut::isShareable())
+    static const unsigned SHARED_OUTPUT_COUNT = 3;
+    SharedOutput _sharedOutputs[SHARED_OUTPUT_COUNT];
+
+    // Transcoding bypass. The source is the single talker whose original
+    // frames are being forwarded on this tick (if any).
+    bool _bypassEnabled = true;
+    const BridgeCall* _bypassSource = nullptr;
+
+    // The bypass source from the last tick, used for the crossfade out of
+    // the bypass. The call list can change between ticks (and a slot can 
+    // be reused) so this is kept by slot and identity rather than by 
+    // pointer. See _getLastBypassSource().
+    struct BypassSourceRef {
+        int index = -1;
+        unsigned lineId = 0;
+        unsigned callId = 0;
+        CODECType codec = CODECType::IAX2_CODEC_UNKNOWN;
+    };
+    BypassSourceRef _lastBypassSource;
+
+    bool _adaptivePlayout = true;
+
+    // The slot indices of the active calls (in slot order) so that the 
+    // per-tick loops only touch live calls. Calls are added on CALL_START.
+    // Calls can also end on their own (ex: parrot timeout) so anything 
+    // inactive is pruned at the start of each tick, and every user of the
+    // list still checks isActive().
+    std::vector<unsigned> _activeCalls;
+    // The slot indices of the calls contributing to the current tick
+    std::vector<unsigned> _contributors;
+
+    // Only used when running multi-threaded
+    std::unique_ptr<WorkerPool> _workers;
 };
 
 // #### TODO: CAN WE CONSOLIDATE THE CONFIG POLLER WITH THIS?
@@ -15,6 +15,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <cassert>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
@@ -25,6 +26,8 @@
 #include "kc1fsz-tools/Common.h"
 #include "kc1fsz-tools/fixed_math.h"
 
+#include "amp/MixKernels.h"
+
 #include "Message.h"
 #include "BridgeCall.h"
 #include "Poker.h"
@@ -121,8 +124,14 @@ BridgeCall::BridgeCall() {
     // The last stage of the BridgeOut pipeline passes the message
     // out to the sink message bus.
     _bridgeOut.setSink([this](const Message& msg) {
-        _sink->consume(msg);
+        if (_deferOutput) {
+            assert(_outboxCount < OUTBOX_SIZE);
+            _outbox[_outboxCount++] = msg;
+        }
+        else
+            _sink->consume(msg);
     });
+    _playResampler.setRates(48000, 16000);
 }
 
 void BridgeCall::init(Bridge* bridge, Log* log, Log* traceLog, Clock* clock, 
@@ -142,8 +151,9 @@ void BridgeCall::init(Bridge* bridge, Log* log, Log* traceLog, Clock* clock,
         _netTestBindAddr = netTestBindAddr;
     else 
         _netTestBindAddr.clear();
-    _bridgeIn.init(_log, _traceLog, _clock);
-    _bridgeOut.init(_log, _clock);
+    _callLog.setTarget(_log);
+    _bridgeIn.init(&_callLog, _traceLog, _clock);
+    _bridgeOut.init(&_callLog, _clock);
 }
 
 void BridgeCall::reset() {
@@ -163,11 +173,12 @@ void BridgeCall::reset() {
 
     _bridgeIn.reset();
     _bridgeOut.reset();
+    _playResampler.reset();
+    _busRate = 48000;
+    _busBlockSize = BLOCK_SIZE_48K;
 
     _toneActive = false;
-    _toneOmega = 0;
-    _tonePhi = 0;
-    _toneLevel = 0;
+    _tone.reset();
 
     _captureQueue = std::queue<PCM16Frame>();
     _captureQueueDepth = 0;
@@ -177,7 +188,18 @@ void BridgeCall::reset() {
     _lastUnkeyProcessedMs = 0;
 
     _stageInSet = false;
+    _stageInOrigMs = 0;
+    _bypassActive = false;
+    _deferOutput = false;
+    _outboxCount = 0;
+    _callLog.flush();
+    _frameLevel = 0;
+    _inputLevel = 0;
+    _lastInputTickMs = 0;
+    _selectedTalker = false;
     _lastCycleGeneratedOutput = false;
+    _tickCpuUs = 0;
+    _cpuUs = 0;
 
     _dtmfAccumulator.clear();
     _lastDtmfRxMs = 0;
@@ -234,8 +256,24 @@ void BridgeCall::setup(unsigned lineId, unsigned callId, uint32_t startMs, CODEC
         _enterProgramMode();
     else if (initialMode == Mode::NORMAL)
         _enterNormalMode();
-    else 
+    else {
         _mode = initialMode;
+        _updateInputRate();
+    }
+}
+
+void BridgeCall::setBusRate(unsigned rate) {
+    assert(rate == 48000 || rate == 16000);
+    _busRate = rate;
+    _busBlockSize = (rate == 16000) ? BLOCK_SIZE_16K : BLOCK_SIZE_48K;
+    // Anything staged is at the old rate
+    _stageInSet = false;
+    _playResampler.reset();
+    _updateInputRate();
+}
+
+void BridgeCall::_updateInputRate() {
+    _bridgeIn.setOutputRate(_mode == Mode::NORMAL ? _busRate : 48000);
 }
 
 void BridgeCall::_forceEnd() {
@@ -251,6 +289,20 @@ void BridgeCall::_forceEnd() {
 
 void BridgeCall::_enterNormalMode() {
     _mode = Mode::NORMAL;
+    _updateInputRate();
+}
+
+const char* BridgeCall::modeName(Mode mode) {
+    if (mode == Mode::NORMAL)
+        return "NORMAL";
+    else if (mode == Mode::PARROT)
+        return "PARROT";
+    else if (mode == Mode::TONE)
+        return "TONE";
+    else if (mode == Mode::PROGRAM)
+        return "PROGRAM";
+    else 
+        return "UNKNOWN";
 }
 
 bool BridgeCall::isRecentCommander() const {
@@ -280,6 +332,9 @@ json BridgeCall::getStatusDoc() const {
     // Dynamic
     o2["rxActive"] = _bridgeIn.isActiveRecently();
     o2["talkerid"] = _talkerId;
+    o2["codec"] = codecName(_bridgeIn.getCodec());
+    o2["mode"] = modeName(_mode);
+    o2["cpuUs"] = _cpuUs;
 
     // Build the connection list
     auto b = json::array();
@@ -335,6 +390,9 @@ json BridgeCall::getLevelsDoc() const {
     o["usb-tx-meter"] = _tx0Db;
     o["net-rx-meter"] = _rx1Db;
     o["net-tx-meter"] = _tx1Db;
+    o["usb-rx-peak-hz"] = _rx0PeakHz;
+    o["usb-rx-sinad"] = _rx0SinadDb;
+    o["usb-rx-hum"] = _rx0HumDb;
     return o;
 }
 
@@ -412,13 +470,35 @@ void BridgeCall::consume(const Message& frame) {
         _tx0Db = payload->tx0Db;
         _rx1Db = payload->rx1Db;
         _tx1Db = payload->tx1Db;
+        _rx0PeakHz = payload->rx0PeakHz;
+        _rx0SinadDb = payload->rx0SinadDb;
+        _rx0HumDb = payload->rx0HumDb;
     }
 }
 
 void BridgeCall::audioRateTick(uint32_t tickMs) {
+    inputAudioRateTick(tickMs);
+    modeAudioRateTick(tickMs);
+}
+
+void BridgeCall::inputAudioRateTick(uint32_t tickMs) {
 
     _bridgeIn.audioRateTick(tickMs);
 
+    // Track the input level: fast attack, slow decay. The decay step is 
+    // rounded up so that the level gets all the way back down to silence.
+    uint32_t frameLevel = 0;
+    if (hasInputAudio()) {
+        frameLevel = _frameLevel;
+        _lastInputTickMs = tickMs;
+    }
+    if (frameLevel > _inputLevel)
+        _inputLevel = frameLevel;
+    else 
+        _inputLevel -= (_inputLevel - frameLevel + 7) / 8;
+}
+
+void BridgeCall::modeAudioRateTick(uint32_t tickMs) {
     if (_mode == Mode::TONE) {
         _toneAudioRateTick(tickMs);
     } else if (_mode == Mode::PARROT) {
@@ -579,12 +659,26 @@ void BridgeCall::_processDtmfCommand(const string& cmd) {
 
 void BridgeCall::_processNormalAudio(const Message& msg) {   
     assert(msg.getType() == Message::Type::AUDIO);
-    assert(msg.size() == BLOCK_SIZE_48K * 2);
-    assert(msg.getFormat() == CODECType::IAX2_CODEC_SLIN_48K);
+    // Frames made before a change in the conference rate (ex: held by the 
+    // kerchunk filter) are dropped.
+    const CODECType busFormat = (_busRate == 16000) ? 
+        CODECType::IAX2_CODEC_SLIN_16K : CODECType::IAX2_CODEC_SLIN_48K;
+    if (msg.getFormat() != busFormat)
+        return;
+    assert(msg.size() == _busBlockSize * 2);
     const uint8_t* p = msg.body();
-    for (unsigned i = 0; i < BLOCK_SIZE_48K; i++, p += 2)
+    for (unsigned i = 0; i < _busBlockSize; i++, p += 2)
         _stageIn[i] = unpack_int16_le(p);
     _stageInSet = true;
+    _stageInOrigMs = msg.getOrigMs();
+
+    // Cheap level estimate used for talker selection. The audio is
+    // band-limited so looking at 8K worth of samples is plenty.
+    const unsigned step = _busBlockSize / BLOCK_SIZE_8K;
+    uint32_t sum = 0;
+    for (unsigned i = 0; i < _busBlockSize; i += step)
+        sum += std::abs(_stageIn[i]);
+    _frameLevel = sum / BLOCK_SIZE_8K;
 }
 
 /**
@@ -593,7 +687,7 @@ void BridgeCall::_processNormalAudio(const Message& msg) {
  */
 void BridgeCall::extractInputAudio(int16_t* pcmBlock, unsigned blockSize, 
     int calls, uint32_t tickMs, int16_t scale_q11) {
-    assert(blockSize == BLOCK_SIZE_48K);   
+    assert(blockSize == _busBlockSize);   
     if (_stageInSet) {
         // Make the fixed-point scale factor
         const int16_t scaleFixed = 0x7fff / (int16_t)calls;
@@ -613,29 +707,54 @@ void BridgeCall::extractInputAudio(int16_t* pcmBlock, unsigned blockSize,
     }
 }
 
+void BridgeCall::extractInputAudio(int32_t* accBlock, unsigned blockSize, 
+    int calls, uint32_t tickMs, int16_t scale_q11) {
+    assert(blockSize == _busBlockSize);   
+    if (_stageInSet) {
+        // Make the fixed-point scale factor
+        const int16_t scaleFixed = 0x7fff / (int16_t)calls;
+        // The steps are the same as the 16-bit version above so that
+        // the results are identical.
+        MixKernels::get().scaleAccumulate(accBlock, _stageIn, blockSize, 
+            scaleFixed, scale_q11);
+    }
+}
+
 void BridgeCall::clearInputAudio() {
     _stageInSet = false;
 }
 
+void BridgeCall::flushDeferredOutput() {
+    _callLog.flush();
+    _deferOutput = false;
+    for (unsigned i = 0; i < _outboxCount; i++)
+        _sink->consume(_outbox[i]);
+    _outboxCount = 0;
+}
+
 /**
  * The bridge calls this function to set the final output audio for this call.
- * Takes 48K PCM and passes it into the BridgeOut pipeline for transcoding, etc.
+ * Takes PCM at the conference rate and passes it into the BridgeOut pipeline 
+ * for transcoding, etc.
  */
 void BridgeCall::setConferenceOutput(const int16_t* pcm48k, unsigned blockSize, uint32_t tickMs,
-    unsigned mixCount) {
+    unsigned mixCount, const Message* bypassFadeFrame) {
 
-    assert(blockSize == BLOCK_SIZE_48K);
+    assert(blockSize == _busBlockSize);
 
     // IMPORTANT: The final output for a call is the combination
     // of any synthetic material on the play queue and whether 
     // is coming it from the conference.
     //
     // This should be the ONLY place in this class where a frame
-    // of audio is passed to the _bridgeOut.
+    // of audio is passed to the _bridgeOut (other than the shared/
+    // pre-encoded version in setConferenceOutputEncoded()).
     // 
     // This is also the place where an UNKEY event is requested on
     // the trailing edge of contributed audio.
 
+    // Calls that aren't in the conference always work at 48K
+    const unsigned outSize = (_mode == Mode::NORMAL) ? _busBlockSize : BLOCK_SIZE_48K;
     int16_t outputPCM48[BLOCK_SIZE_48K] = { 0 };
     int16_t sources = 0;
 
@@ -644,7 +763,11 @@ void BridgeCall::setConferenceOutput(const int16_t* pcm48k, unsigned blockSize,
     if (!_playQueue.empty()) {
         sources++;
         assert(_playQueue.front().size() == BLOCK_SIZE_48K);
-        memcpy(outputPCM48, _playQueue.front().data(), BLOCK_SIZE_48K * sizeof(int16_t));
+        if (outSize == BLOCK_SIZE_48K)
+            memcpy(outputPCM48, _playQueue.front().data(), BLOCK_SIZE_48K * sizeof(int16_t));
+        else
+            _playResampler.resample(_playQueue.front().data(), BLOCK_SIZE_48K, 
+                outputPCM48, outSize);
         _playQueue.pop();
     }
 
@@ -652,23 +775,32 @@ void BridgeCall::setConferenceOutput(const int16_t* pcm48k, unsigned blockSize,
     if (_mode == Mode::NORMAL && mixCount > 0) {
         sources++;
         if (sources == 1) {
-            for (unsigned i = 0; i < BLOCK_SIZE_48K; i++) 
+            for (unsigned i = 0; i < outSize; i++) 
                 outputPCM48[i] = pcm48k[i];
         } else {
-            for (unsigned i = 0; i < BLOCK_SIZE_48K; i++) 
-                // Sources are scaled individually first to avoid overflow
-                outputPCM48[i] = (outputPCM48[i] >> 1) + (pcm48k[i] >> 1);
+            // Sources are scaled individually first to avoid overflow
+            MixKernels::get().blendHalf(outputPCM48, outputPCM48, pcm48k, 
+                outSize);
         }
     }
 
     // If there was any audio contributed then make a message and send it
     if (sources > 0) {
         // #### TODO: DO TIMES MATTER HERE?
-        MessageWrapper msg(Message::Type::AUDIO, CODECType::IAX2_CODEC_PCM_48K, 
-            BLOCK_SIZE_48K * 2, (const uint8_t*)outputPCM48, 0, tickMs);
+        uint8_t space[BLOCK_SIZE_16K * 2];
+        MessageWrapper msg = BridgeOut::makeBusFrame(outputPCM48, outSize, 
+            space, tickMs);
         msg.setSource(LINE_ID, CALL_ID);
         msg.setDest(_lineId, _callId);
-        _bridgeOut.consume(msg);
+        // Fade out of the transcoding bypass if possible
+        if (_bypassActive && bypassFadeFrame && _bridgeOut.isShareable() &&
+            bypassFadeFrame->getFormat() == _bridgeOut.getCodec()) {
+            MessageWrapper frame(Message::Type::AUDIO, bypassFadeFrame->getFormat(), 
+                bypassFadeFrame->size(), bypassFadeFrame->body(), 0, tickMs);
+            _bridgeOut.consumeCrossfade(msg, frame, false);
+        }
+        else
+            _bridgeOut.consume(msg);
 
         _lastCycleGeneratedOutput = true;
     }
@@ -683,6 +815,60 @@ void BridgeCall::setConferenceOutput(const int16_t* pcm48k, unsigned blockSize,
         }
         _lastCycleGeneratedOutput = false;
     }
+
+    _bypassActive = false;
+}
+
+void BridgeCall::setConferenceOutputEncoded(const uint8_t* code, unsigned codeSize, 
+    uint32_t tickMs, unsigned mixCount) {
+
+    assert(canShareConferenceOutput());
+    assert(mixCount > 0);
+
+    MessageWrapper msg(Message::Type::AUDIO, _bridgeOut.getCodec(), 
+        codeSize, code, 0, tickMs);
+    msg.setSource(LINE_ID, CALL_ID);
+    msg.setDest(_lineId, _callId);
+    _bridgeOut.consume(msg);
+
+    _lastCycleGeneratedOutput = true;
+    _bypassActive = false;
+}
+
+const Message* BridgeCall::getBypassFrame() const {
+    // The frame must be the one behind the staged audio. This won't 
+    // be the case when the kerchunk filter is playing out a backlog.
+    const Message* frame = _bridgeIn.getLastEncodedFrame();
+    if (hasInputAudio() && frame && frame->getOrigMs() == _stageInOrigMs)
+        return frame;
+    return nullptr;
+}
+
+void BridgeCall::setConferenceOutputBypass(const Message& frame, const int16_t* pcm48k,
+    uint32_t tickMs) {
+
+    assert(canShareConferenceOutput());
+    assert(frame.getFormat() == _bridgeOut.getCodec());
+
+    MessageWrapper msg(Message::Type::AUDIO, frame.getFormat(), 
+        frame.size(), frame.body(), 0, tickMs);
+    msg.setSource(LINE_ID, CALL_ID);
+    msg.setDest(_lineId, _callId);
+
+    // Fade into the bypass on the first tick
+    if (!_bypassActive) {
+        uint8_t space[BLOCK_SIZE_16K * 2];
+        MessageWrapper mix = BridgeOut::makeBusFrame(pcm48k, _busBlockSize, 
+            space, tickMs);
+        mix.setSource(LINE_ID, CALL_ID);
+        mix.setDest(_lineId, _callId);
+        _bridgeOut.consumeCrossfade(mix, msg, true);
+    }
+    else 
+        _bridgeOut.consume(msg);
+
+    _lastCycleGeneratedOutput = true;
+    _bypassActive = true;
 }
 
 // ===== Tone Mode Related ====================================================
@@ -691,11 +877,7 @@ void BridgeCall::_toneAudioRateTick(uint32_t tickMs) {
     if (_toneActive) {
         // Make a tone at 48K
         int16_t data[BLOCK_SIZE_48K];
-        for (unsigned i = 0; i < BLOCK_SIZE_48K; i++) {
-            data[i] = (_toneLevel * cos(_tonePhi)) * 32767.0f;
-            _tonePhi += _toneOmega;
-        }
-        _tonePhi = fmod(_tonePhi, 2.0f * 3.14159f);
+        _tone.generate(data, BLOCK_SIZE_48K);
         // Queue a tick's worth of output
         _playQueue.push(PCM16Frame(data, BLOCK_SIZE_48K));
     }
@@ -705,6 +887,7 @@ void BridgeCall::_toneAudioRateTick(uint32_t tickMs) {
 
 void BridgeCall::_enterParrotMode() {
     _mode = Mode::PARROT;
+    _updateInputRate();
     _parrotState = ParrotState::CONNECTED;
 }
 
@@ -714,13 +897,14 @@ void BridgeCall::_enterParrotMode() {
  */
 void BridgeCall::_processParrotAudio(const Message& msg) { 
 
-    float rms = 0;
-    
     // At this point all interpolation is finished and the audio is in
     // the common bus format.
     assert(msg.getType() == Message::AUDIO);
+    // Frames left over from a 16K conference (ex: held by the kerchunk 
+    // filter) are dropped.
+    if (msg.getFormat() != CODECType::IAX2_CODEC_SLIN_48K)
+        return;
     assert(msg.size() == BLOCK_SIZE_48K * 2);
-    assert(msg.getFormat() == CODECType::IAX2_CODEC_SLIN_48K);
 
     // Convert back to native PCM16
     int16_t pcm48k[BLOCK_SIZE_48K];
@@ -728,12 +912,21 @@ void BridgeCall::_processParrotAudio(const Message& msg) {
     transcoder.decode(msg.body(), BLOCK_SIZE_48K * 2, pcm48k, BLOCK_SIZE_48K);                
 
     // Compute the power in the frame
+#ifdef AMP_FIXED_POINT
+    // Same threshold without the square root: 0.005^2 = 1/40000
+    uint64_t sumSquares = 0;
+    for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
+        sumSquares += (int32_t)pcm48k[i] * (int32_t)pcm48k[i];
+    bool vad = sumSquares * 40000 > (uint64_t)BLOCK_SIZE_48K * 32767 * 32767;
+#else
+    float rms = 0;
     float pcm48k_2[BLOCK_SIZE_48K];
     for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
         pcm48k_2[i] = pcm48k[i] / 32767.0;
     arm_rms_f32(pcm48k_2, BLOCK_SIZE_48K, &rms);
 
     bool vad = rms > 0.005;
+#endif
 
     if (vad)
         _lastAudioRxMs = _clock->time();
@@ -1029,16 +1222,13 @@ void BridgeCall::_loadAudio(const std::vector<PCM16Frame>& audio, std::queue<PCM
 }
 
 void BridgeCall::_loadCw(float amp, float hz, unsigned ticks, std::queue<PCM16Frame>& queue) {
-    float toneOmega = 2.0f * 3.14159f * hz / 48000.0f;
+    // The oscillator phase is continuous to avoid glitches during 
+    // frequency changes
+    _tone.setFreq(hz);
+    _tone.setAmplitude(amp, true);
     int16_t data[BLOCK_SIZE_48K];
     for (unsigned k = 0; k < ticks; k++) {
-        for (unsigned i = 0; i < BLOCK_SIZE_48K; i++) {
-            // We're using a continuous phase here to avoid glitches during 
-            // frequency changes
-            data[i] = (amp * cos(_tonePhi)) * 32767.0f;
-            _tonePhi += toneOmega;
-            _tonePhi = fmod(_tonePhi, 2.0f * 3.14159f);
-        }
+        _tone.generate(data, BLOCK_SIZE_48K);
         // Pass into the output pipeline for transcoding, etc.
         queue.push(PCM16Frame(data, BLOCK_SIZE_48K));
     }
@@ -1080,6 +1270,7 @@ void BridgeCall::_loadSweep(std::queue<PCM16Frame>& queue) {
 void BridgeCall::_enterProgramMode() {
 
     _mode = Mode::PROGRAM;
+    _updateInputRate();
 
     _programSteps.clear();
 
@@ -26,6 +26,7 @@
 
 // amp-core
 #include "amp/Ampersand.h"
+#include "amp/ToneOscillator.h"
 #include "PCM16Frame.h"
 #include "Runnable2.h"
 #include "MessageConsumer.h"
@@ -33,6 +34,7 @@
 #include "BridgeIn.h"
 #include "BridgeOut.h"
 #include "Poker.h"
+#include "DeferredLog.h"
 
 using json = nlohmann::json;
 
@@ -99,6 +101,26 @@ public:
 
     bool isNormal() const { return _mode == Mode::NORMAL; }
 
+    Mode getMode() const { return _mode; }
+
+    static const char* modeName(Mode mode);
+
+    /**
+     * Used by the Bridge to charge processing time to this call.
+     */
+    void addCpuUs(uint32_t us) { _tickCpuUs += us; _cpuUs += us; }
+
+    /**
+     * @returns The processing time charged since the last call, and 
+     * starts a new count.
+     */
+    uint32_t takeTickCpuUs() { uint32_t r = _tickCpuUs; _tickCpuUs = 0; return r; }
+
+    /**
+     * @returns The total processing time charged to this call.
+     */
+    uint64_t getCpuUs() const { return _cpuUs; }
+
     bool isPermanent() const { return _permanent; }
 
     /**
@@ -113,6 +135,29 @@ public:
 
     bool hasInputAudio() const { return isNormal() && _stageInSet; }
 
+    /**
+     * @returns true if this call's input audio should be mixed into the 
+     * conference on this tick (i.e. it has audio and it has been selected
+     * as one of the talkers by the Bridge).
+     */
+    bool isContributing() const { return hasInputAudio() && _selectedTalker; }
+
+    /**
+     * @returns A cheap estimate of the input audio level (mean absolute 
+     * sample value) with fast attack and slow decay. Used by the Bridge
+     * to pick the loudest talkers.
+     */
+    uint32_t getInputLevel() const { return _inputLevel; }
+
+    /**
+     * @returns The start of the last tick on which this call had input audio.
+     */
+    uint32_t getLastInputTickMs() const { return _lastInputTickMs; }
+
+    bool isSelectedTalker() const { return _selectedTalker; }
+
+    void setSelectedTalker(bool selected) { _selectedTalker = selected; }
+
     std::string getInputTalkerId() const { return _talkerId; }
     
     uint64_t getInputTalkerIdChangeMs() const { return _talkerIdChangeMs; }
@@ -168,11 +213,42 @@ public:
     void extractInputAudio(int16_t* pcmBlock, unsigned blockSize, int calls, uint32_t tickMs,
         int16_t scale_q11 = 2048);    
 
+    /**
+     * Same as above, but accumulates into a 32-bit conference sum. This is
+     * used by the Bridge to build a single mix that is shared by all 
+     * listeners.
+     * 
+     * NOTE: Passing scale_q11 = -2048 removes a contribution that was
+     * previously added with scale_q11 = 2048 exactly (i.e. no rounding 
+     * residue is left behind).
+     */
+    void extractInputAudio(int32_t* accBlock, unsigned blockSize, int calls, uint32_t tickMs,
+        int16_t scale_q11 = 2048);    
+
     /**
      * Clear the call's contribution so that we never use it again.
      */
     void clearInputAudio();
 
+    /**
+     * After this is called the messages generated by setConferenceOutput() 
+     * are held inside of the call instead of being passed to the sink, 
+     * and the same goes for anything that the input/output pipelines 
+     * write to the log. This allows the pipelines to run on a worker 
+     * thread while the message bus and the log are only touched from the 
+     * main thread.
+     */
+    void beginDeferredOutput() { 
+        _deferOutput = true; 
+        _callLog.beginDeferred();
+    }
+
+    /**
+     * Passes any held log messages to the log and any held messages to 
+     * the sink (in order) and goes back to normal operation.
+     */
+    void flushDeferredOutput();
+
     /**
      * This provides the call with the mixed audio frame for the designated tick interval.
      * Tells the call to generate its audio output for the designated tick interval,
@@ -180,9 +256,78 @@ public:
      * 
      * @param tickMs The start of the time interval for which this frame is applicable.
      * @param mixCount The number of conference talkers that are included in the pcmBlock.
+     * @param bypassFadeFrame If the transcoding bypass was active on the previous 
+     * tick this is the bypass talker's frame for this tick (if still available). 
+     * It is used to fade out of the bypass cleanly.
      */
     void setConferenceOutput(const int16_t* pcmBlock, unsigned blockSize, uint32_t tickMs,
-        unsigned mixCount);  
+        unsigned mixCount, const Message* bypassFadeFrame = nullptr);  
+
+    /**
+     * @returns true if this call's output would be exactly the conference
+     * mix (i.e. no synthetic audio on the play queue) and the output CODEC 
+     * allows the encoded frame to be shared with other listeners.
+     */
+    bool canShareConferenceOutput() const {
+        return _mode == Mode::NORMAL && _playQueue.empty() && _bridgeOut.isShareable();
+    }
+
+    CODECType getInputCodec() const { return _bridgeIn.getCodec(); }
+
+    CODECType getOutputCodec() const { return _bridgeOut.getCodec(); }
+
+    /**
+     * Lets the delay of the input jitter buffer follow the network 
+     * conditions instead of staying at the initial margin.
+     */
+    void setAdaptiveJitterBuffer(bool b) { _bridgeIn.setAdaptiveJitterBuffer(b); }
+
+    /**
+     * Sets the sample rate of the conference audio: 48000 or 16000. This 
+     * applies to the staged input audio and to the block passed to 
+     * setConferenceOutput(). Calls that aren't in NORMAL mode always work
+     * at 48K internally.
+     */
+    void setBusRate(unsigned rate);
+
+    unsigned getBusRate() const { return _busRate; }
+
+    /**
+     * @returns The original encoded frame that the staged input audio 
+     * was decoded from, or nullptr if there isn't one (ex: no input, 
+     * interpolation, kerchunk filter playout). 
+     */
+    const Message* getBypassFrame() const;
+
+    /**
+     * @returns true if this call's output was the transcoding bypass on 
+     * the last tick.
+     */
+    bool isBypassActive() const { return _bypassActive; }
+
+    /**
+     * Same as setConferenceOutput() except that the output is the original
+     * encoded frame of the single active talker, which is in this call's 
+     * output CODEC (i.e. the transcoding bypass). Only valid when 
+     * canShareConferenceOutput() is true.
+     * 
+     * @param frame The talker's frame (see getBypassFrame()).
+     * @param pcm48k The conference mix for the same tick, used to fade into 
+     * the bypass on the first tick.
+     */
+    void setConferenceOutputBypass(const Message& frame, const int16_t* pcm48k,
+        uint32_t tickMs);
+
+    /**
+     * Same as setConferenceOutput() except that the mix has already been
+     * resampled/encoded into this call's output CODEC by the Bridge. Only 
+     * valid when canShareConferenceOutput() is true.
+     * 
+     * @param code The encoded frame, which is copied.
+     * @param mixCount The number of conference talkers included in the frame.
+     */
+    void setConferenceOutputEncoded(const uint8_t* code, unsigned codeSize, 
+        uint32_t tickMs, unsigned mixCount);
 
     /**
      * @returns Effective time of the status document for this call. Used
@@ -226,11 +371,25 @@ public:
     void audioRateTick(uint32_t tickMs);
     void oneSecTick();
 
+    /**
+     * The first part of audioRateTick(): jitter buffer playout and input
+     * decoding. In NORMAL mode this only touches the call's own state.
+     */
+    void inputAudioRateTick(uint32_t tickMs);
+
+    /**
+     * The second part of audioRateTick(): mode-specific (tone, parrot, 
+     * etc.) processing.
+     */
+    void modeAudioRateTick(uint32_t tickMs);
+
 private:
 
     Bridge* _bridge;
     Log* _log;
     Log* _traceLog;
+    // What the input/output pipelines log to. See beginDeferredOutput().
+    DeferredLog _callLog;
     Clock* _clock;
     MessageConsumer* _sink;
 
@@ -266,6 +425,13 @@ private:
 
     // The audio waiting to be sent to the caller in PCM16 48K format.
     std::queue<PCM16Frame> _playQueue;
+    // Used to bring the play queue down to the conference rate when 
+    // the conference is running at 16K.
+    Resampler _playResampler;
+
+    // The conference rate, see setBusRate()
+    unsigned _busRate = 48000;
+    unsigned _busBlockSize = BLOCK_SIZE_48K;
 
     // Used to gather DTMF symbols from the peer
     std::string _dtmfAccumulator;
@@ -295,7 +461,11 @@ private:
     int _rx1Db = 0;
     int _tx0Db = 0;
     int _tx1Db = 0;
+    float _rx0PeakHz = 0;
+    float _rx0SinadDb = 0;
+    float _rx0HumDb = 0;
 
+    void _updateInputRate();
     void _processTTSAudio(const Message& msg);
     void _requestTTS(Message::Type type, const char* arg, unsigned preSilenceMs, 
         unsigned postSilenceMs);
@@ -315,19 +485,42 @@ private:
     int16_t _stageIn[BLOCK_SIZE_48K];
     // Indicates whether any input was provided during this tick
     bool _stageInSet = false;
+    // The origMs of the frame in _stageIn 
+    uint32_t _stageInOrigMs = 0;
+    // The level of the audio in _stageIn 
+    uint32_t _frameLevel = 0;
+    // Smoothed version of _frameLevel, updated on every tick
+    uint32_t _inputLevel = 0;
+    uint32_t _lastInputTickMs = 0;
+    // Controlled by the Bridge
+    bool _selectedTalker = false;
+
+    // Processing time, see addCpuUs()
+    uint32_t _tickCpuUs = 0;
+    uint64_t _cpuUs = 0;
 
     // Used to identify the trailing edge of output generation so that we 
     // can make an UNKEY at the right time.
     bool _lastCycleGeneratedOutput = false;
+    // Indicates that the last tick's output was the transcoding bypass
+    bool _bypassActive = false;
+
+    // Holds the output of a tick when the Bridge is running the output
+    // pipeline on a worker thread. A tick generates at most one message 
+    // (audio or UNKEY).
+    static const unsigned OUTBOX_SIZE = 2;
+    bool _deferOutput = false;
+    MessageCarrier _outbox[OUTBOX_SIZE];
+    unsigned _outboxCount = 0;
 
     // ----- Tone Mode Related ------------------------------------------------
 
     void _toneAudioRateTick(uint32_t tickMs);
 
     bool _toneActive = false;
-    float _toneOmega;
-    float _tonePhi;
-    float _toneLevel;
+    // Shared by the tone mode and the CW generator so that the phase is
+    // continuous across frequency changes.
+    amp::ToneOscillator _tone;
 
     // ----- Parrot Mode Related ----------------------------------------------
 
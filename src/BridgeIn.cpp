@@ -15,8 +15,12 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <cassert>
+#include <cmath>
 #include <iostream>
 
+#include "amp/Wsola.h"
+#include "amp/FixedMath.h"
+
 #include "Message.h"
 #include "BridgeIn.h"
 
@@ -29,6 +33,9 @@
 // avoid ringing.
 // #### TODO: MAKE THIS SMARTER
 #define UNKEY_WINDOW_MS (500)
+// The number of consecutive silent frames needed before the PLC history
+// (48.75ms) and the resampler state are known to be all zero.
+#define QUIESCENT_FRAMES (3)
 
 namespace kc1fsz {
 
@@ -43,18 +50,39 @@ BridgeIn::BridgeIn() {
 
 void BridgeIn::setCodec(CODECType codecType) {
     _codecType = codecType;
-    unsigned rate = codecSampleRate(_codecType);
-    if (rate == 0)
+    if (_codecType == CODECType::IAX2_CODEC_G711_ULAW)
+        _startPipeline<CODECType::IAX2_CODEC_G711_ULAW>();
+    else if (_codecType == CODECType::IAX2_CODEC_SLIN_8K)
+        _startPipeline<CODECType::IAX2_CODEC_SLIN_8K>();
+    else if (_codecType == CODECType::IAX2_CODEC_G726_AAL2)
+        _startPipeline<CODECType::IAX2_CODEC_G726_AAL2>();
+    else if (_codecType == CODECType::IAX2_CODEC_SLIN_16K)
+        _startPipeline<CODECType::IAX2_CODEC_SLIN_16K>();
+    else if (_codecType == CODECType::IAX2_CODEC_SLIN_48K)
+        _startPipeline<CODECType::IAX2_CODEC_SLIN_48K>();
+    else if (_codecType == CODECType::IAX2_CODEC_PCM_48K)
+        _startPipeline<CODECType::IAX2_CODEC_PCM_48K>();
+    else 
         assert(false);
-    _resampler.setRates(rate, 48000);
-    if (rate == 8000)
-        _plc.setSampleRate(8000);
-    else if (rate == 16000)
-        _plc.setSampleRate(16000);
-    else if (rate == 48000) {
-        // #### TODO: SETUP THE PLC FOR THIS CASE
-    }
-    else assert(false);
+}
+
+template<CODECType C> void BridgeIn::_startPipeline() {
+    typedef CodecTraits<C> Traits;
+    _decoder.emplace<DecodePipeline<C>>();
+    _codecBlockSize = Traits::BLOCK_SIZE;
+    _resampler.setRates(Traits::RATE, _outputRate);
+    // The jitter buffer slots only need to be as big as the voice frames
+    // of the CODEC.
+    _jitBuf.setPayloadCapacity(Traits::FRAME_SIZE);
+}
+
+void BridgeIn::setOutputRate(unsigned rate) {
+    assert(rate == 48000 || rate == 16000);
+    if (rate == _outputRate)
+        return;
+    _outputRate = rate;
+    if (_codecType != CODECType::IAX2_CODEC_UNKNOWN)
+        _resampler.setRates(codecSampleRate(_codecType), _outputRate);
 }
 
 void BridgeIn::setJitterBufferInitialMargin(unsigned ms) {
@@ -95,7 +123,7 @@ void BridgeIn::consume(const Message& frame) {
 void BridgeIn::audioRateTick(uint32_t tickMs) {
 
     _jitBuf.playOut(*_log, _clock->time(), 
-        [this](const MessageCarrier& msg, uint32_t) {
+        [this](const Message& msg, uint32_t) {
             _handleJitBufOut(msg);
         },
         [this](uint32_t origMs, uint32_t localMs, uint32_t) {
@@ -113,6 +141,13 @@ void BridgeIn::audioRateTick(uint32_t tickMs) {
         }
     );
 
+    // The second half of an expanded frame covers this tick
+    if (_jitBuf.getTimeScale() == SequencingBufferRing::TS_HOLD && _heldValid) {
+        _heldValid = false;
+        _lastEncodedFrameValid = false;
+        _emit(_heldPcm, _heldFrame, false, 0);
+    }
+
     // Let the kerchunk filter contribute output if necessary
     _kerchunkFilter.audioRateTick(tickMs);
 
@@ -136,117 +171,159 @@ void BridgeIn::_handleJitBufOut(const Message& frame) {
 
     if (frame.getType() == Message::Type::AUDIO ||
         frame.getType() == Message::Type::AUDIO_INTERPOLATE) {
+
+        // The adaptive jitter buffer may want this frame stretched or 
+        // squeezed (see below).
+        const SequencingBufferRing::TimeScale ts = _jitBuf.getTimeScale();
+
+        // Measure the energy of the frame while it is still encoded (if the 
+        // CODEC allows it). 
+        bool haveEnergy = false;
+        uint64_t sumSquares = 0;
+        if (frame.getType() == Message::Type::AUDIO && 
+            ts == SequencingBufferRing::TS_NORMAL) 
+            haveEnergy = _frameEnergy(frame, sumSquares);
+
+        // A completely silent frame is ignored. This can happen for stations
+        // that sent continuous silent frames, like the ASL Telephone Portal.
+        // Once enough silence has gone through to flush the PLC history and 
+        // the resampler state the output is guaranteed to be silent, so 
+        // the entire decode/PLC/resample path can be skipped.
+        if (haveEnergy && sumSquares == 0) {
+            if (_silentRun >= QUIESCENT_FRAMES)
+                return;
+            _silentRun++;
+        } 
+        else {
+            // NOTE: Interpolation also resets the run because it changes
+            // the PLC state for the next good frame.
+            _silentRun = 0;
+        }
+
+        // Keep the original frame around for the transcoding bypass. This 
+        // isn't possible if the timing of the frame is being changed.
+        if (frame.getType() == Message::Type::AUDIO && 
+            ts == SequencingBufferRing::TS_NORMAL) {
+            _lastEncodedFrame = frame;
+            _lastEncodedFrameValid = true;
+        } 
+        else 
+            _lastEncodedFrameValid = false;
     
+        // Decode (or interpolate) to PCM at the CODEC rate
         int16_t pcm2[BLOCK_SIZE_48K];
-
-        // #### TODO: REORGANIZE TO ELIMINATE REPEATED CODE. EX:
-        // #### ALLOW THE PLC TO DEAL WITH 48K SMOOTHLY TO ELIMINATE
-        // #### THE SPECIAL CASE.
-
-        if (_codecType == CODECType::IAX2_CODEC_G711_ULAW ||
-            _codecType == CODECType::IAX2_CODEC_SLIN_8K ||
-            _codecType == CODECType::IAX2_CODEC_G726_AAL2) {
-            if (frame.getType() == Message::Type::AUDIO) {
-                int16_t pcm1[BLOCK_SIZE_8K];
-                Transcoder* tc = 0;
-                if (_codecType == CODECType::IAX2_CODEC_G711_ULAW)
-                    tc = &_transcoder0a;
-                else if (_codecType == CODECType::IAX2_CODEC_SLIN_8K)
-                    tc = &_transcoder0b;
-                else if (_codecType == CODECType::IAX2_CODEC_G726_AAL2)
-                    tc = &_transcoder0e;
+        std::visit(Overloaded {
+            [](std::monostate&) { assert(false); },
+            [&frame, &pcm2](auto& decoder) {
+                if (frame.getType() == Message::Type::AUDIO)
+                    decoder.decode(frame, pcm2);
                 else 
-                    assert(false);
-                // Transcode
-                tc->decode(frame.body(), frame.size(), pcm1, codecBlockSize(_codecType));            
-                // Pass audio through the PLC mechanism. 
-                // PLC operates on 10ms blocks so there are two calls
-                _plc.goodFrame(pcm1, pcm2, BLOCK_SIZE_8K / 2);
-                _plc.goodFrame(pcm1 + BLOCK_SIZE_8K / 2, pcm2 + BLOCK_SIZE_8K / 2, 
-                    BLOCK_SIZE_8K / 2);
-            } else {
-                // Ask PLC to fill in the missing frame (in two 10ms sections).  
-                // PLC operates on 10ms blocks so there are two calls
-                _plc.badFrame(pcm2, BLOCK_SIZE_8K / 2);
-                _plc.badFrame(pcm2 + BLOCK_SIZE_8K / 2, BLOCK_SIZE_8K / 2);
+                    decoder.interpolate(pcm2);
             }
-        }
-        else if (_codecType == CODECType::IAX2_CODEC_SLIN_16K) {
-            if (frame.getType() == Message::Type::AUDIO) {
-                int16_t pcm1[BLOCK_SIZE_16K];
-                // Transcode
-                _transcoder0c.decode(frame.body(), frame.size(), 
-                    pcm1, codecBlockSize(_codecType));            
-                // Pass audio through the PLC mechanism
-                // PLC operates on 10ms blocks so there are two calls
-                _plc.goodFrame(pcm1, pcm2, BLOCK_SIZE_16K / 2);
-                _plc.goodFrame(pcm1 + BLOCK_SIZE_16K / 2, pcm2 + BLOCK_SIZE_16K / 2, 
-                    BLOCK_SIZE_16K / 2);
-            } else {
-                // Ask PLC to fill in the missing frame (in two 10ms sections).  
-                // PLC operates on 10ms blocks so there are two calls
-                _plc.badFrame(pcm2, BLOCK_SIZE_16K / 2);
-                _plc.badFrame(pcm2 + BLOCK_SIZE_16K / 2, BLOCK_SIZE_16K / 2);
-            }
-        }
-        else if (_codecType == CODECType::IAX2_CODEC_SLIN_48K) {
-            if (frame.getType() == Message::Type::AUDIO) {
-                // Transcode
-                _transcoder0d.decode(frame.body(), frame.size(), 
-                    pcm2, codecBlockSize(_codecType));            
-            } else {
-                // There is no PLC at the moment, so we just
-                // create a frame of silence
-                for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
-                    pcm2[i] = 0;
+        }, _decoder);
+
+        // Time-scale modification for the adaptive jitter buffer
+        const unsigned n = _codecBlockSize;
+        if (ts == SequencingBufferRing::TS_COMPRESS) {
+            // The first of the two frames is held until the second arrives
+            if (!_compressPending) {
+                memcpy(_tsmPcm, pcm2, n * sizeof(int16_t));
+                memcpy(_lastPcm, pcm2, n * sizeof(int16_t));
+                _compressPending = true;
+                return;
             }
+            _compressPending = false;
+            memcpy(_tsmPcm + n, pcm2, n * sizeof(int16_t));
+            memcpy(_lastPcm, pcm2, n * sizeof(int16_t));
+            Wsola::compress(_tsmPcm, n, pcm2);
         }
-        else if (_codecType == CODECType::IAX2_CODEC_PCM_48K) {
-            if (frame.getType() == Message::Type::AUDIO) {
-                assert(frame.size() == BLOCK_SIZE_48K * 2);
-                // Nothing to transcode, already PCM
-                const int16_t* src = (const int16_t*)frame.body();
-                for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
-                    pcm2[i] = src[i];
-            } else {
-                // There is no PLC at the moment, so we just create a frame 
-                // of silence
-                for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
-                    pcm2[i] = 0;
-            }
+        else if (ts == SequencingBufferRing::TS_EXPAND) {
+            // The extra audio comes from the previous frame. The second half
+            // is held for the next tick.
+            memcpy(_tsmPcm, _lastPcm, n * sizeof(int16_t));
+            memcpy(_tsmPcm + n, pcm2, n * sizeof(int16_t));
+            memcpy(_lastPcm, pcm2, n * sizeof(int16_t));
+            int16_t pcm3[BLOCK_SIZE_48K * 2];
+            Wsola::expand(_tsmPcm, n, pcm3);
+            memcpy(pcm2, pcm3, n * sizeof(int16_t));
+            memcpy(_heldPcm, pcm3 + n, n * sizeof(int16_t));
+            _heldFrame = MessageEmpty(Message::Type::AUDIO, frame.getFormat(), 
+                frame.getOrigMs() + 20, frame.getRxMs());
+            _heldFrame.setSource(frame.getSourceBusId(), frame.getSourceCallId());
+            _heldFrame.setDest(frame.getDestBusId(), frame.getDestCallId());
+            _heldValid = true;
         }
+        else 
+            memcpy(_lastPcm, pcm2, n * sizeof(int16_t));
 
-        // Resample PCM data up to 48K
-        int16_t pcm48k[BLOCK_SIZE_48K];
-        _resampler.resample(pcm2, codecBlockSize(_codecType), 
-            pcm48k, BLOCK_SIZE_48K);
+        _emit(pcm2, frame, haveEnergy, sumSquares);
+    }
+    else {
+        assert(false);
+    }
+}
 
-        // Determine if this frame is silence 
-        // #### TOOD: MOVE BEFORE RESAMPLING!
-        bool isSilence = true;
-        for (unsigned i = 0; i < BLOCK_SIZE_48K && isSilence; i++) 
-            if (pcm48k[i] != 0)
-                isSilence = false;
+/**
+ * The last part of the input flow: resampling to the output rate, conversion
+ * to the bus format and kerchunk filtering.
+ */
+void BridgeIn::_emit(const int16_t* pcm, const Message& frame, bool haveEnergy, 
+    uint64_t sumSquares) {
 
-        // A completely silent frame is ignored. This can happen for stations
-        // that sent continuous silent frames, like the ASL Telephone Portal.
-        if (isSilence)
-            return;
-       
-        // Transcode to SLIN_48K
-        uint8_t slin48k[BLOCK_SIZE_48K * 2];
-        _transcoder1.encode(pcm48k, BLOCK_SIZE_48K, slin48k, BLOCK_SIZE_48K * 2);
-        
-        MessageWrapper outFrame(Message::Type::AUDIO, CODECType::IAX2_CODEC_SLIN_48K,
-            BLOCK_SIZE_48K * 2, slin48k, frame.getOrigMs(), frame.getRxMs());
-        outFrame.setSource(frame.getSourceBusId(), frame.getSourceCallId());
-        outFrame.setDest(frame.getDestBusId(), frame.getDestCallId());
+    // Resample PCM data up to the output rate
+    const unsigned outBlockSize = (_outputRate == 16000) ? 
+        BLOCK_SIZE_16K : BLOCK_SIZE_48K;
+    int16_t pcm48k[BLOCK_SIZE_48K];
+    _resampler.resample(pcm, _codecBlockSize, pcm48k, outBlockSize);
 
-        _kerchunkFilter.consume(outFrame);
+    // Determine if this frame is silence. This catches the frames that
+    // are flushing the pipeline (see _handleJitBufOut()) and the CODECs that can't 
+    // be measured before decoding.
+    bool isSilence = true;
+    for (unsigned i = 0; i < outBlockSize && isSilence; i++) 
+        if (pcm48k[i] != 0)
+            isSilence = false;
+    if (isSilence)
+        return;
+   
+    // Transcode to the bus format 
+    uint8_t slin48k[BLOCK_SIZE_48K * 2];
+    CODECType outFormat;
+    if (_outputRate == 16000) {
+        _transcoder1b.encode(pcm48k, BLOCK_SIZE_16K, slin48k, BLOCK_SIZE_16K * 2);
+        outFormat = CODECType::IAX2_CODEC_SLIN_16K;
+    } else {
+        _transcoder1.encode(pcm48k, BLOCK_SIZE_48K, slin48k, BLOCK_SIZE_48K * 2);
+        outFormat = CODECType::IAX2_CODEC_SLIN_48K;
     }
-    else {
-        assert(false);
+    
+    MessageWrapper outFrame(Message::Type::AUDIO, outFormat,
+        outBlockSize * 2, slin48k, frame.getOrigMs(), frame.getRxMs());
+    outFrame.setSource(frame.getSourceBusId(), frame.getSourceCallId());
+    outFrame.setDest(frame.getDestBusId(), frame.getDestCallId());
+
+    // Give the kerchunk filter the power that we already know about
+    if (haveEnergy && sumSquares > 0) {
+#ifdef AMP_FIXED_POINT
+        _kerchunkFilter.consume(outFrame, amp::powerRatioDbQ8(sumSquares, 
+            (uint64_t)_codecBlockSize * 32767 * 32767) / 256);
+#else
+        float meanSquare = (float)sumSquares / 
+            ((float)_codecBlockSize * 32767.0f * 32767.0f);
+        _kerchunkFilter.consume(outFrame, 10.0f * std::log10(meanSquare));
+#endif
     }
+    else 
+        _kerchunkFilter.consume(outFrame);
+}
+
+bool BridgeIn::_frameEnergy(const Message& frame, uint64_t& sumSquares) const {
+    return std::visit(Overloaded {
+        [](const std::monostate&) { return false; },
+        [&frame, &sumSquares](const auto& decoder) { 
+            return decoder.frameEnergy(frame, sumSquares); 
+        }
+    }, _decoder);
 }
 
 }
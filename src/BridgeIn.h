@@ -18,21 +18,16 @@
 
 #include <functional>
 #include <queue>
-
-#include "itu-g711-plc/Plc.h"
+#include <variant>
 
 #include "amp/Ampersand.h"
 #include "amp/Resampler.h"
-#include "amp/SequencingBufferStd.h"
 
 #include "IAX2Util.h"
 #include "MessageConsumer.h"
-#include "Transcoder_G711_ULAW.h"
-#include "Transcoder_SLIN_8K.h"
-#include "Transcoder_SLIN_16K.h"
-#include "Transcoder_SLIN_48K.h"
-#include "Transcoder_G726.h"
+#include "CodecPipeline.h"
 #include "KerchunkFilter.h"
+#include "SequencingBufferRing.h"
 
 namespace kc1fsz {
 
@@ -46,7 +41,8 @@ class Clock;
  * 
  * 1. De-jitter, identification of interpolation needs.
  * 2. PLC (if possible)
- * 3. Transcodes/resamples to SLIN_48K for internal processing.
+ * 3. Transcodes/resamples to SLIN_48K (or SLIN_16K, see setOutputRate())
+ *    for internal processing.
  * 4. Kerchunk filtering
  */
 class BridgeIn : public MessageConsumer {
@@ -66,28 +62,62 @@ public:
 
     void setJitterBufferInitialMargin(unsigned ms);
 
+    /**
+     * Lets the jitter buffer delay follow the network conditions. See 
+     * SequencingBufferRing::setAdaptiveDelay().
+     */
+    void setAdaptiveJitterBuffer(bool b) { _jitBuf.setAdaptiveDelay(b); }
+
+    /**
+     * Provides access to the jitter buffer diagnostics.
+     */
+    const SequencingBufferRing& getJitterBuffer() const { return _jitBuf; }
+
     void setCodec(CODECType codecType);
 
     CODECType getCodec() const { return _codecType; }
 
+    /**
+     * Sets the rate of the internal audio that comes out of the pipeline.
+     * 48000 (SLIN_48K, the default) or 16000 (SLIN_16K). 
+     */
+    void setOutputRate(unsigned rate);
+
+    unsigned getOutputRate() const { return _outputRate; }
+
     void setStartTime(uint32_t ms) { 
         _jitBuf.setStartMs(ms);
     }
 
     uint32_t getLastUnkeyMs() const { return _lastUnkeyMs; }
+
+    /**
+     * @returns The original (still encoded) frame behind the most recent 
+     * output of the pipeline, or nullptr if that output wasn't made from 
+     * a received frame (ex: interpolation). The origMs of the frame can
+     * be used to line it up with the output. Used for the transcoding 
+     * bypass.
+     */
+    const Message* getLastEncodedFrame() const { 
+        return _lastEncodedFrameValid ? &_lastEncodedFrame : nullptr; 
+    }
     
     void reset() { 
         _codecType = CODECType::IAX2_CODEC_UNKNOWN;
+        _outputRate = 48000;
         _jitBuf.reset();
         _lastUnkeyMs = 0;
+        _silentRun = 0;
+        _lastEncodedFrameValid = false;
+        _compressPending = false;
+        _heldValid = false;
         _lastAudioMs = 0;
         _activeStatus = false;
         _lastActiveStatusChangedMs = 0;
-        _transcoder0a.reset(); 
-        _transcoder0c.reset(); 
-        _transcoder0d.reset(); 
-        _transcoder0e.reset(); 
+        _decoder = std::monostate();
+        _codecBlockSize = 0;
         _transcoder1.reset(); 
+        _transcoder1b.reset(); 
         _resampler.reset(); 
         _kerchunkFilter.reset();
     }
@@ -150,14 +180,30 @@ public:
 
 private:
 
+    /**
+     * Creates the decoding pipeline for the CODEC.
+     */
+    template<CODECType C> void _startPipeline();
+
     void _handleJitBufOut(const Message& msg);
 
+    void _emit(const int16_t* pcm, const Message& frame, bool haveEnergy, 
+        uint64_t sumSquares);
+
+    /**
+     * Measures the energy of an encoded frame without decoding it.
+     * @returns false if the input CODEC doesn't allow this.
+     */
+    bool _frameEnergy(const Message& msg, uint64_t& sumSquares) const;
+
     Log* _log; 
     Log* _traceLog; 
     Clock* _clock;
     std::function<void(const Message& msg)> _sink = nullptr;
     // This is the input CODEC of the user
     CODECType _codecType = CODECType::IAX2_CODEC_UNKNOWN;
+    // The number of samples in a frame of the input CODEC
+    unsigned _codecBlockSize = 0;
 
     // Last time audio was processed 
     uint64_t _lastAudioMs = 0; 
@@ -168,27 +214,49 @@ private:
     uint64_t _lastActiveStatusChangedMs = 0;
 
     // This is the Jitter Buffer used to address timing/sequencing
-    // issues on the input side of the Bridge.
-    amp::SequencingBufferStd<MessageCarrier> _jitBuf;
+    // issues on the input side of the Bridge. The slots are sized for 
+    // the CODEC in setCodec().
+    SequencingBufferRing _jitBuf;
 
     uint64_t _lastUnkeyMs = 0;
 
-    Transcoder_G711_ULAW _transcoder0a;
-    Transcoder_SLIN_8K _transcoder0b;
-    Transcoder_SLIN_16K _transcoder0c;
-    Transcoder_SLIN_48K _transcoder0d;
-    Transcoder_G726 _transcoder0e;
-
-    // This is used to satisfy interpolation requests from
-    // the Jitter Buffer.
-    Plc _plc;
-
-    // This is used to convert up to 48K
+    // The number of consecutive frames that were silent before decoding
+    unsigned _silentRun = 0;
+
+    // A copy of the last frame that came out of the jitter buffer 
+    MessageCarrier _lastEncodedFrame;
+    bool _lastEncodedFrameValid = false;
+
+    // Time-scale modification for the adaptive jitter buffer. All of 
+    // this is at the CODEC rate.
+    // The last block that was decoded (the source for an expansion)
+    int16_t _lastPcm[BLOCK_SIZE_48K] = { 0 };
+    // The two blocks that are going into a compression/expansion
+    int16_t _tsmPcm[BLOCK_SIZE_48K * 2];
+    bool _compressPending = false;
+    // The second half of an expansion, played on the next tick
+    int16_t _heldPcm[BLOCK_SIZE_48K];
+    MessageEmpty _heldFrame;
+    bool _heldValid = false;
+
+    // Decoding and PLC for the input CODEC, chosen in setCodec(). The PLC 
+    // is used to satisfy interpolation requests from the Jitter Buffer.
+    std::variant<std::monostate,
+        DecodePipeline<CODECType::IAX2_CODEC_G711_ULAW>,
+        DecodePipeline<CODECType::IAX2_CODEC_SLIN_8K>,
+        DecodePipeline<CODECType::IAX2_CODEC_G726_AAL2>,
+        DecodePipeline<CODECType::IAX2_CODEC_SLIN_16K>,
+        DecodePipeline<CODECType::IAX2_CODEC_SLIN_48K>,
+        DecodePipeline<CODECType::IAX2_CODEC_PCM_48K>> _decoder;
+
+    // This is used to convert up to the output rate
     amp::Resampler _resampler;    
+    unsigned _outputRate = 48000;
     
     // This is used at the end to convert to the "bus format"
     // that is passed around internally.
     Transcoder_SLIN_48K _transcoder1;
+    Transcoder_SLIN_16K _transcoder1b;
 
     KerchunkFilter _kerchunkFilter;
 };
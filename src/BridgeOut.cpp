@@ -32,10 +32,28 @@ namespace kc1fsz {
 
 void BridgeOut::setCodec(CODECType codecType) {
     _codecType = codecType;
-    unsigned rate = codecSampleRate(_codecType);
-    if (rate == 0)
+    if (_codecType == CODECType::IAX2_CODEC_G711_ULAW) 
+        _encoder.emplace<EncodePipeline<CODECType::IAX2_CODEC_G711_ULAW>>();
+    else if (_codecType == CODECType::IAX2_CODEC_SLIN_8K)
+        _encoder.emplace<EncodePipeline<CODECType::IAX2_CODEC_SLIN_8K>>();
+    else if (_codecType == CODECType::IAX2_CODEC_G726_AAL2)
+        _encoder.emplace<EncodePipeline<CODECType::IAX2_CODEC_G726_AAL2>>();
+    else if (_codecType == CODECType::IAX2_CODEC_SLIN_16K)
+        _encoder.emplace<EncodePipeline<CODECType::IAX2_CODEC_SLIN_16K>>();
+    else if (_codecType == CODECType::IAX2_CODEC_SLIN_48K ||
+        _codecType == CODECType::IAX2_CODEC_PCM_48K)
+        _encoder = std::monostate();
+    else 
         assert(false);
-    _resampler.setRates(48000, rate);
+}
+
+bool BridgeOut::isShareable() const {
+    return std::visit(Overloaded {
+        [](const std::monostate&) { return false; },
+        [](const auto& encoder) { 
+            return std::decay_t<decltype(encoder)>::Traits::SHAREABLE; 
+        }
+    }, _encoder);
 }
 
 bool BridgeOut::isActiveRecently() const {
@@ -48,50 +66,30 @@ void BridgeOut::consume(const Message& frame) {
 
         _lastActivityMs = _clock->timeMs();
 
-        // This is the existing path
+        // Frames that have already been encoded (i.e. shared conference 
+        // output) are passed right through.
+        if (frame.getFormat() == _codecType && 
+            frame.getFormat() != CODECType::IAX2_CODEC_SLIN_48K &&
+            frame.getFormat() != CODECType::IAX2_CODEC_PCM_48K) {
+            assert(isShareable());
+            // The resampler history is now out of date
+            std::visit(Overloaded {
+                [](std::monostate&) { },
+                [](auto& encoder) { encoder.setStale(); }
+            }, _encoder);
+            _sink(frame);
+            return;
+        }
+
         if (frame.getFormat() == CODECType::IAX2_CODEC_SLIN_48K) {
             
             assert(frame.size() == BLOCK_SIZE_48K * 2);
     
-            if (_codecType == CODECType::IAX2_CODEC_G711_ULAW ||
-                _codecType == CODECType::IAX2_CODEC_G726_AAL2 ||
-                _codecType == CODECType::IAX2_CODEC_SLIN_16K ||
-                _codecType == CODECType::IAX2_CODEC_SLIN_8K) {             
-                
-                Transcoder* t1 = 0;
-                unsigned codeSize = maxVoiceFrameSize(_codecType);
-                unsigned blockSize = codecBlockSize(_codecType);
-                if (_codecType == CODECType::IAX2_CODEC_G711_ULAW) 
-                    t1 = &_transcoder1a;
-                else if (_codecType == CODECType::IAX2_CODEC_SLIN_16K)
-                    t1 = &_transcoder1c;
-                else if (_codecType == CODECType::IAX2_CODEC_SLIN_8K)
-                    t1 = &_transcoder1d;
-                else if (_codecType == CODECType::IAX2_CODEC_G726_AAL2)
-                    t1 = &_transcoder1e;
-                else 
-                    assert(false);
-
+            if (_isEncoding()) {
                 // Make PCM data
                 int16_t pcm48k[BLOCK_SIZE_48K];
                 _transcoder0.decode(frame.body(), frame.size(), pcm48k, BLOCK_SIZE_48K);
-
-                // Resample PCM data 
-                // NOTE: MAKE THIS LARGE ENOUGH
-                int16_t pcm_low[BLOCK_SIZE_8K * 2];
-                _resampler.resample(pcm48k, BLOCK_SIZE_48K, pcm_low, blockSize);
-
-                // NOTE: Make this big enough for any format!
-                uint8_t code[BLOCK_SIZE_8K * 4];
-                t1->encode(pcm_low, blockSize, code, codeSize);
-                
-                // Times are passed right through
-                MessageWrapper outFrame(Message::Type::AUDIO, _codecType,
-                    codeSize, code, frame.getOrigMs(), frame.getRxMs());
-                outFrame.setSource(frame.getSourceBusId(), frame.getSourceCallId());
-                outFrame.setDest(frame.getDestBusId(), frame.getDestCallId());
-
-                _sink(outFrame);
+                _resampleAndEncode(frame, pcm48k, BLOCK_SIZE_48K);
             }
             else if (_codecType == CODECType::IAX2_CODEC_SLIN_48K) {
                 // No support for interpolation
@@ -111,42 +109,8 @@ void BridgeOut::consume(const Message& frame) {
 
             assert(frame.size() == BLOCK_SIZE_48K * 2);
     
-            if (_codecType == CODECType::IAX2_CODEC_G711_ULAW ||
-                _codecType == CODECType::IAX2_CODEC_G726_AAL2 ||
-                _codecType == CODECType::IAX2_CODEC_SLIN_16K ||
-                _codecType == CODECType::IAX2_CODEC_SLIN_8K) {             
-                
-                Transcoder* t1 = 0;
-                unsigned codeSize = maxVoiceFrameSize(_codecType);
-                unsigned blockSize = codecBlockSize(_codecType);
-                if (_codecType == CODECType::IAX2_CODEC_G711_ULAW) 
-                    t1 = &_transcoder1a;
-                else if (_codecType == CODECType::IAX2_CODEC_SLIN_16K)
-                    t1 = &_transcoder1c;
-                else if (_codecType == CODECType::IAX2_CODEC_SLIN_8K)
-                    t1 = &_transcoder1d;
-                else if (_codecType == CODECType::IAX2_CODEC_G726_AAL2)
-                    t1 = &_transcoder1e;
-                else 
-                    assert(false);
-
-                // Resample PCM data 
-                // NOTE: MAKE THIS LARGE ENOUGH
-                int16_t pcm_low[BLOCK_SIZE_8K * 2];
-                _resampler.resample((const int16_t*)frame.body(), BLOCK_SIZE_48K, 
-                    pcm_low, blockSize);
-
-                // NOTE: Make this big enough for any format!
-                uint8_t code[BLOCK_SIZE_8K * 4];
-                t1->encode(pcm_low, blockSize, code, codeSize);
-                
-                // Times are passed right through
-                MessageWrapper outFrame(Message::Type::AUDIO, _codecType,
-                    codeSize, code, frame.getOrigMs(), frame.getRxMs());
-                outFrame.setSource(frame.getSourceBusId(), frame.getSourceCallId());
-                outFrame.setDest(frame.getDestBusId(), frame.getDestCallId());
-
-                _sink(outFrame);
+            if (_isEncoding()) {
+                _resampleAndEncode(frame, (const int16_t*)frame.body(), BLOCK_SIZE_48K);
             }
             else if (_codecType == CODECType::IAX2_CODEC_SLIN_48K) {
                 // No support for interpolation
@@ -171,6 +135,15 @@ void BridgeOut::consume(const Message& frame) {
                 assert(false);
             }
         }
+        // The conference runs at 16K when there are no 48K endpoints 
+        // attached, so only the low-rate CODECs will see this.
+        else if (frame.getFormat() == CODECType::IAX2_CODEC_SLIN_16K) {
+            assert(frame.size() == BLOCK_SIZE_16K * 2);
+            assert(_isEncoding());
+            int16_t pcm16k[BLOCK_SIZE_16K];
+            _transcoder0b.decode(frame.body(), frame.size(), pcm16k, BLOCK_SIZE_16K);
+            _resampleAndEncode(frame, pcm16k, BLOCK_SIZE_16K);
+        }
         else {
             assert(false);
         }
@@ -181,4 +154,100 @@ void BridgeOut::consume(const Message& frame) {
     }
 }
 
+MessageWrapper BridgeOut::makeBusFrame(const int16_t* pcm, unsigned blockSize, 
+    uint8_t* space, uint32_t rxMs) {
+    if (blockSize == BLOCK_SIZE_16K) {
+        Transcoder_SLIN_16K transcoder;
+        transcoder.encode(pcm, BLOCK_SIZE_16K, space, BLOCK_SIZE_16K * 2);
+        return MessageWrapper(Message::Type::AUDIO, CODECType::IAX2_CODEC_SLIN_16K, 
+            BLOCK_SIZE_16K * 2, space, 0, rxMs);
+    }
+    assert(blockSize == BLOCK_SIZE_48K);
+    return MessageWrapper(Message::Type::AUDIO, CODECType::IAX2_CODEC_PCM_48K, 
+        BLOCK_SIZE_48K * 2, (const uint8_t*)pcm, 0, rxMs);
+}
+
+void BridgeOut::_resampleAndEncode(const Message& frame, const int16_t* pcm, 
+    unsigned pcmSize) {
+
+    // NOTE: Make this big enough for any format!
+    uint8_t code[BLOCK_SIZE_8K * 4];
+    const unsigned codeSize = std::visit(Overloaded {
+        [](std::monostate&) -> unsigned { assert(false); return 0; },
+        [pcm, pcmSize, &code](auto& encoder) {
+            typedef typename std::decay_t<decltype(encoder)>::Traits Traits;
+            int16_t pcmLow[Traits::BLOCK_SIZE];
+            encoder.resample(pcm, pcmSize, pcmLow);
+            encoder.encode(pcmLow, code);
+            return Traits::FRAME_SIZE;
+        }
+    }, _encoder);
+    
+    // Times are passed right through
+    MessageWrapper outFrame(Message::Type::AUDIO, _codecType,
+        codeSize, code, frame.getOrigMs(), frame.getRxMs());
+    outFrame.setSource(frame.getSourceBusId(), frame.getSourceCallId());
+    outFrame.setDest(frame.getDestBusId(), frame.getDestCallId());
+
+    _sink(outFrame);
+}
+
+void BridgeOut::consumeCrossfade(const Message& mix, const Message& frame, 
+    bool intoFrame) {
+
+    assert(isShareable());
+    assert(mix.getType() == Message::Type::AUDIO);
+    assert(frame.getFormat() == _codecType);
+
+    _lastActivityMs = _clock->timeMs();
+
+    // NOTE: Make this big enough for any format!
+    uint8_t code[BLOCK_SIZE_8K * 4];
+    const unsigned codeSize = std::visit(Overloaded {
+        [](std::monostate&) -> unsigned { assert(false); return 0; },
+        [this, &mix, &frame, intoFrame, &code](auto& encoder) {
+
+            typedef typename std::decay_t<decltype(encoder)>::Traits Traits;
+            const unsigned blockSize = Traits::BLOCK_SIZE;
+
+            // Both sides at the native rate of the CODEC
+            int16_t pcmMix[blockSize];
+            if (mix.getFormat() == CODECType::IAX2_CODEC_PCM_48K) {
+                assert(mix.size() == BLOCK_SIZE_48K * 2);
+                encoder.resample((const int16_t*)mix.body(), BLOCK_SIZE_48K, pcmMix);
+            }
+            else if (mix.getFormat() == CODECType::IAX2_CODEC_SLIN_16K) {
+                assert(mix.size() == BLOCK_SIZE_16K * 2);
+                int16_t pcm16k[BLOCK_SIZE_16K];
+                _transcoder0b.decode(mix.body(), mix.size(), pcm16k, BLOCK_SIZE_16K);
+                encoder.resample(pcm16k, BLOCK_SIZE_16K, pcmMix);
+            }
+            else 
+                assert(false);
+            int16_t pcmFrame[blockSize];
+            encoder.decode(frame, pcmFrame);
+
+            // Linear crossfade across the block (q15 weights)
+            const int16_t* from = intoFrame ? pcmMix : pcmFrame;
+            const int16_t* to = intoFrame ? pcmFrame : pcmMix;
+            int16_t pcmOut[blockSize];
+            for (unsigned i = 0; i < blockSize; i++) {
+                int32_t w = (int32_t)((i * 32768) / blockSize);
+                pcmOut[i] = ((int32_t)from[i] * (32768 - w) + (int32_t)to[i] * w) >> 15;
+            }
+
+            encoder.encode(pcmOut, code);
+            return Traits::FRAME_SIZE;
+        }
+    }, _encoder);
+
+    // Times are passed right through
+    MessageWrapper outFrame(Message::Type::AUDIO, _codecType,
+        codeSize, code, mix.getOrigMs(), mix.getRxMs());
+    outFrame.setSource(mix.getSourceBusId(), mix.getSourceCallId());
+    outFrame.setDest(mix.getDestBusId(), mix.getDestCallId());
+
+    _sink(outFrame);
+}
+
 }
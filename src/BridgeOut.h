@@ -17,17 +17,13 @@
 #pragma once
 
 #include <functional>
+#include <variant>
 
 #include "amp/Ampersand.h"
-#include "amp/Resampler.h"
 
 #include "IAX2Util.h"
 #include "MessageConsumer.h"
-#include "Transcoder_G711_ULAW.h"
-#include "Transcoder_SLIN_48K.h"
-#include "Transcoder_SLIN_16K.h"
-#include "Transcoder_SLIN_8K.h"
-#include "Transcoder_G726.h"
+#include "CodecPipeline.h"
 
 namespace kc1fsz {
 
@@ -37,7 +33,8 @@ class Clock;
 // #### TODO: CLEANUP NAMESPACE
 
 /**
- * Transcodes from internal SLIN_48K to whatever CODEC is needed for 
+ * Transcodes from the internal format (SLIN_48K/PCM_48K, or SLIN_16K when
+ * the conference is running at 16K) to whatever CODEC is needed for 
  * external communications.
  */
 class BridgeOut : public MessageConsumer {
@@ -47,6 +44,17 @@ public:
 
     void setCodec(CODECType codecType);
 
+    CODECType getCodec() const { return _codecType; }
+
+    /**
+     * @returns true if the output of this encoder depends only on the
+     * current frame (plus the resampler history). When this is the case 
+     * the same encoded frame can be fanned out to any number of listeners 
+     * that hear an identical mix. Stateful CODECs like G.726 are excluded 
+     * because the far-end decoder tracks the state of our encoder.
+     */
+    bool isShareable() const;
+
     void init(Log* log, Clock* clock) { 
         _log = log; 
         _clock = clock; 
@@ -55,31 +63,67 @@ public:
     void reset() { 
         _codecType = CODECType::IAX2_CODEC_UNKNOWN;
         _transcoder0.reset(); 
-        _transcoder1a.reset(); 
-        _transcoder1c.reset(); 
-        _transcoder1d.reset(); 
-        _transcoder1e.reset(); 
-        _resampler.reset(); 
+        _transcoder0b.reset(); 
+        _encoder = std::monostate();
         _lastActivityMs = 0;
     }
 
     virtual void consume(const Message& frame);
 
+    /**
+     * Used on the ticks where the transcoding bypass starts or stops. The 
+     * two paths aren't sample-aligned (the normal path has PLC and filter 
+     * delay) so the output is crossfaded between them across the block 
+     * to avoid a click. Only valid when isShareable() is true.
+     * 
+     * @param mix The conference mix for this tick (PCM_48K or SLIN_16K).
+     * @param frame The talker's original frame for this tick, already in 
+     * this output's CODEC.
+     * @param intoFrame true to fade from the mix to the frame (start of 
+     * bypass), false to fade from the frame to the mix (end of bypass).
+     */
+    void consumeCrossfade(const Message& mix, const Message& frame, bool intoFrame);
+
     bool isActiveRecently() const;
 
+    /**
+     * Wraps a block of conference audio in the frame format that consume()
+     * expects: PCM_48K when the conference is running at 48K, SLIN_16K when
+     * it is running at 16K.
+     * 
+     * @param space Holds the frame body in the 16K case. Must be at least
+     * BLOCK_SIZE_16K * 2 bytes; unused at 48K.
+     */
+    static MessageWrapper makeBusFrame(const int16_t* pcm, unsigned blockSize, 
+        uint8_t* space, uint32_t rxMs);
+
 private:
 
+    /**
+     * @returns true if the output CODEC needs to be encoded (i.e. anything
+     * other than the 48K formats).
+     */
+    bool _isEncoding() const { 
+        return !std::holds_alternative<std::monostate>(_encoder); 
+    }
+
+    void _resampleAndEncode(const Message& frame, const int16_t* pcm, unsigned pcmSize);
+
     Log* _log; 
     Clock* _clock;
 
     CODECType _codecType = CODECType::IAX2_CODEC_UNKNOWN;
     std::function<void(const Message& msg)> _sink = nullptr;
+    // Used to decode the 48K and 16K bus formats respectively
     Transcoder_SLIN_48K _transcoder0;
-    Transcoder_G711_ULAW _transcoder1a;
-    Transcoder_SLIN_16K _transcoder1c;
-    Transcoder_SLIN_8K _transcoder1d;
-    Transcoder_G726 _transcoder1e;
-    amp::Resampler _resampler;
+    Transcoder_SLIN_16K _transcoder0b;
+    // Resampling and encoding for the output CODEC, chosen in setCodec().
+    // Nothing is needed for the 48K CODECs.
+    std::variant<std::monostate,
+        EncodePipeline<CODECType::IAX2_CODEC_G711_ULAW>,
+        EncodePipeline<CODECType::IAX2_CODEC_SLIN_8K>,
+        EncodePipeline<CODECType::IAX2_CODEC_G726_AAL2>,
+        EncodePipeline<CODECType::IAX2_CODEC_SLIN_16K>> _encoder;
     uint64_t _lastActivityMs;
 };
 
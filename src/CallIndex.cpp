@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cassert>
+
+#include "CallIndex.h"
+
+namespace kc1fsz {
+
+CallIndex::CallIndex(unsigned maxEntries) 
+:   _maxEntries(maxEntries) {
+    // Power of 2 so that wrapping is a mask, and a load factor of 
+    // 50% or less to keep the probe runs short.
+    unsigned size = 2;
+    while (size < maxEntries * 2)
+        size <<= 1;
+    _slots.resize(size);
+    _mask = size - 1;
+}
+
+void CallIndex::clear() {
+    for (Slot& s : _slots)
+        s.pos = EMPTY;
+    _size = 0;
+}
+
+unsigned CallIndex::_home(uint64_t key) const {
+    // Finalizer from SplitMix64, call numbers are small and sequential
+    // so the bits need to be spread out.
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return (unsigned)key & _mask;
+}
+
+void CallIndex::insert(uint64_t key, unsigned pos) {
+    assert(_size < _maxEntries);
+    unsigned i = _home(key);
+    while (_slots[i].pos != EMPTY)
+        i = (i + 1) & _mask;
+    _slots[i].key = key;
+    _slots[i].pos = pos;
+    _size++;
+}
+
+bool CallIndex::remove(uint64_t key, unsigned pos) {
+
+    unsigned i = _home(key);
+    while (true) {
+        if (_slots[i].pos == EMPTY)
+            return false;
+        if (_slots[i].key == key && _slots[i].pos == (int32_t)pos)
+            break;
+        i = (i + 1) & _mask;
+    }
+
+    // Shift back any entries later in the run that would no longer 
+    // be reachable from their home slot once this one is emptied.
+    unsigned j = i;
+    while (true) {
+        j = (j + 1) & _mask;
+        if (_slots[j].pos == EMPTY)
+            break;
+        unsigned k = _home(_slots[j].key);
+        // Leave it alone if its home is (cyclically) in (i, j]
+        bool inRange = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (inRange)
+            continue;
+        _slots[i] = _slots[j];
+        i = j;
+    }
+    _slots[i].pos = EMPTY;
+    _size--;
+    return true;
+}
+
+}
@@ -0,0 +1,84 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace kc1fsz {
+
+/**
+ * An open-addressing hash index from a 64-bit key to a position in a 
+ * table (ex: the call table of a line). Uses linear probing with 
+ * backward-shift deletion so removals don't leave tombstones behind.
+ *
+ * Keys don't need to be unique: the same key may be stored for several
+ * positions and find() visits all of them. The caller is expected to 
+ * check the positions that it gets back, so a key can be a hash of 
+ * something larger.
+ *
+ * The table is sized once in the constructor (at least twice the 
+ * maximum number of entries) and never grows.
+ */
+class CallIndex {
+public:
+
+    /**
+     * @param maxEntries The most entries that will ever be stored.
+     */
+    CallIndex(unsigned maxEntries);
+
+    void clear();
+
+    void insert(uint64_t key, unsigned pos);
+
+    /**
+     * Removes one entry for the key/position pair.
+     * @returns true if the entry was found.
+     */
+    bool remove(uint64_t key, unsigned pos);
+
+    /**
+     * Calls the visitor with each position stored under the key. The 
+     * visitor returns false to stop the search.
+     */
+    template<typename V> void find(uint64_t key, V visitor) const {
+        for (unsigned i = _home(key); _slots[i].pos != EMPTY; i = (i + 1) & _mask)
+            if (_slots[i].key == key && !visitor((unsigned)_slots[i].pos))
+                return;
+    }
+
+    unsigned size() const { return _size; }
+
+private:
+
+    static const int32_t EMPTY = -1;
+
+    struct Slot {
+        uint64_t key = 0;
+        int32_t pos = EMPTY;
+    };
+
+    unsigned _home(uint64_t key) const;
+
+    const unsigned _maxEntries;
+    std::vector<Slot> _slots;
+    unsigned _mask;
+    unsigned _size = 0;
+};
+
+}
@@ -0,0 +1,242 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstring>
+#include <cassert>
+#include <type_traits>
+
+#include "itu-g711-plc/Plc.h"
+
+#include "amp/Ampersand.h"
+#include "amp/Resampler.h"
+
+#include "IAX2Util.h"
+#include "Message.h"
+#include "Transcoder_G711_ULAW.h"
+#include "Transcoder_SLIN_8K.h"
+#include "Transcoder_SLIN_16K.h"
+#include "Transcoder_SLIN_48K.h"
+#include "Transcoder_PCM_48K.h"
+#include "Transcoder_G726.h"
+
+namespace kc1fsz {
+
+/**
+ * The compile-time properties of each CODEC. These match the run-time 
+ * functions in IAX2Util.h (codecSampleRate(), codecBlockSize(), etc.)
+ * but let the per-frame audio paths be built for one CODEC at a time.
+ */
+template<CODECType C> struct CodecTraits;
+
+template<> struct CodecTraits<CODECType::IAX2_CODEC_G711_ULAW> {
+    typedef Transcoder_G711_ULAW Transcoder;
+    static constexpr unsigned RATE = 8000;
+    static constexpr unsigned BLOCK_SIZE = BLOCK_SIZE_8K;
+    static constexpr unsigned FRAME_SIZE = 160;
+    static constexpr bool HAS_PLC = true;
+    static constexpr bool SHAREABLE = true;
+};
+
+template<> struct CodecTraits<CODECType::IAX2_CODEC_SLIN_8K> {
+    typedef Transcoder_SLIN_8K Transcoder;
+    static constexpr unsigned RATE = 8000;
+    static constexpr unsigned BLOCK_SIZE = BLOCK_SIZE_8K;
+    static constexpr unsigned FRAME_SIZE = 160 * 2;
+    static constexpr bool HAS_PLC = true;
+    static constexpr bool SHAREABLE = true;
+};
+
+template<> struct CodecTraits<CODECType::IAX2_CODEC_G726_AAL2> {
+    typedef Transcoder_G726 Transcoder;
+    static constexpr unsigned RATE = 8000;
+    static constexpr unsigned BLOCK_SIZE = BLOCK_SIZE_8K;
+    static constexpr unsigned FRAME_SIZE = 80;
+    static constexpr bool HAS_PLC = true;
+    // The far-end decoder tracks the state of our encoder
+    static constexpr bool SHAREABLE = false;
+};
+
+template<> struct CodecTraits<CODECType::IAX2_CODEC_SLIN_16K> {
+    typedef Transcoder_SLIN_16K Transcoder;
+    static constexpr unsigned RATE = 16000;
+    static constexpr unsigned BLOCK_SIZE = BLOCK_SIZE_16K;
+    static constexpr unsigned FRAME_SIZE = 160 * 2 * 2;
+    static constexpr bool HAS_PLC = true;
+    static constexpr bool SHAREABLE = true;
+};
+
+template<> struct CodecTraits<CODECType::IAX2_CODEC_SLIN_48K> {
+    typedef Transcoder_SLIN_48K Transcoder;
+    static constexpr unsigned RATE = 48000;
+    static constexpr unsigned BLOCK_SIZE = BLOCK_SIZE_48K;
+    static constexpr unsigned FRAME_SIZE = BLOCK_SIZE_48K * 2;
+    // #### TODO: SETUP THE PLC FOR THIS CASE
+    static constexpr bool HAS_PLC = false;
+    static constexpr bool SHAREABLE = false;
+};
+
+template<> struct CodecTraits<CODECType::IAX2_CODEC_PCM_48K> {
+    typedef Transcoder_PCM_48K Transcoder;
+    static constexpr unsigned RATE = 48000;
+    static constexpr unsigned BLOCK_SIZE = BLOCK_SIZE_48K;
+    static constexpr unsigned FRAME_SIZE = BLOCK_SIZE_48K * 2;
+    static constexpr bool HAS_PLC = false;
+    static constexpr bool SHAREABLE = false;
+};
+
+/**
+ * Used to visit a std::variant with a set of lambdas.
+ */
+template<class... Ts> struct Overloaded : Ts... { using Ts::operator()...; };
+
+/**
+ * The CODEC-specific front of the BridgeIn pipeline: decoding to PCM at the 
+ * rate of the CODEC, and PLC. One of these is created when the CODEC of a 
+ * call is set and it only holds the state that the CODEC needs. All calls
+ * to the transcoder are resolved at compile time.
+ */
+template<CODECType C> class DecodePipeline {
+public:
+
+    typedef CodecTraits<C> Traits;
+
+    DecodePipeline() {
+        if constexpr (Traits::HAS_PLC)
+            _plc.setSampleRate(Traits::RATE);
+    }
+
+    /**
+     * Measures the energy of an encoded frame without decoding it.
+     * @returns false if the CODEC doesn't allow this.
+     */
+    bool frameEnergy(const Message& frame, uint64_t& sumSquares) const {
+        return _transcoder.frameEnergy(frame.body(), frame.size(), sumSquares);
+    }
+
+    /**
+     * @param pcm Receives Traits::BLOCK_SIZE samples.
+     */
+    void decode(const Message& frame, int16_t* pcm) {
+        if constexpr (Traits::HAS_PLC) {
+            int16_t pcm1[Traits::BLOCK_SIZE];
+            _transcoder.decode(frame.body(), frame.size(), pcm1, Traits::BLOCK_SIZE);
+            // Pass audio through the PLC mechanism. 
+            // PLC operates on 10ms blocks so there are two calls
+            _plc.goodFrame(pcm1, pcm, HALF_BLOCK);
+            _plc.goodFrame(pcm1 + HALF_BLOCK, pcm + HALF_BLOCK, HALF_BLOCK);
+        }
+        else 
+            _transcoder.decode(frame.body(), frame.size(), pcm, Traits::BLOCK_SIZE);
+    }
+
+    /**
+     * Fills in a missing frame.
+     * @param pcm Receives Traits::BLOCK_SIZE samples.
+     */
+    void interpolate(int16_t* pcm) {
+        if constexpr (Traits::HAS_PLC) {
+            // PLC operates on 10ms blocks so there are two calls
+            _plc.badFrame(pcm, HALF_BLOCK);
+            _plc.badFrame(pcm + HALF_BLOCK, HALF_BLOCK);
+        }
+        else {
+            // There is no PLC at the moment, so we just create a frame 
+            // of silence
+            memset(pcm, 0, Traits::BLOCK_SIZE * sizeof(int16_t));
+        }
+    }
+
+private:
+
+    static constexpr unsigned HALF_BLOCK = Traits::BLOCK_SIZE / 2;
+
+    struct NoPlc { };
+
+    typename Traits::Transcoder _transcoder;
+    [[no_unique_address]] std::conditional_t<Traits::HAS_PLC, Plc, NoPlc> _plc;
+};
+
+/**
+ * The CODEC-specific back of the BridgeOut pipeline: resampling from the 
+ * conference rate (48K or 16K) down to the rate of the CODEC and encoding.
+ * Only the CODECs that run below 48K need one of these, the 48K CODECs
+ * are passed straight through.
+ */
+template<CODECType C> class EncodePipeline {
+public:
+
+    typedef CodecTraits<C> Traits;
+
+    static_assert(Traits::RATE < 48000);
+
+    /**
+     * Called when pre-encoded frames have been passed through, in which 
+     * case the resampler history is out of date.
+     */
+    void setStale() { _stale = true; }
+
+    /**
+     * @param pcm At the conference rate, BLOCK_SIZE_48K or BLOCK_SIZE_16K 
+     * samples.
+     * @param out Receives Traits::BLOCK_SIZE samples.
+     */
+    void resample(const int16_t* pcm, unsigned pcmSize, int16_t* out) {
+        assert(pcmSize == BLOCK_SIZE_48K || pcmSize == BLOCK_SIZE_16K);
+        const unsigned inRate = (pcmSize == BLOCK_SIZE_16K) ? 16000 : 48000;
+        // The resampler history is from before the pass-through frames (or 
+        // from before a change in the conference rate) so start fresh rather 
+        // than splicing in old audio.
+        if (inRate != _inRate) {
+            _resampler.setRates(inRate, Traits::RATE);
+            _inRate = inRate;
+            _stale = false;
+        }
+        else if (_stale) {
+            _resampler.reset();
+            _stale = false;
+        }
+        _resampler.resample(pcm, pcmSize, out, Traits::BLOCK_SIZE);
+    }
+
+    /**
+     * @param pcm Traits::BLOCK_SIZE samples.
+     * @param code Receives Traits::FRAME_SIZE bytes.
+     */
+    void encode(const int16_t* pcm, uint8_t* code) {
+        _transcoder.encode(pcm, Traits::BLOCK_SIZE, code, Traits::FRAME_SIZE);
+    }
+
+    /**
+     * Decodes a frame that is already in this CODEC (see 
+     * BridgeOut::consumeCrossfade()).
+     * @param pcm Receives Traits::BLOCK_SIZE samples.
+     */
+    void decode(const Message& frame, int16_t* pcm) {
+        _transcoder.decode(frame.body(), frame.size(), pcm, Traits::BLOCK_SIZE);
+    }
+
+private:
+
+    typename Traits::Transcoder _transcoder;
+    amp::Resampler _resampler;
+    // The input rate of the resampler (0 before the first use)
+    unsigned _inRate = 0;
+    bool _stale = false;
+};
+
+}
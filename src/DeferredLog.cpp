@@ -0,0 +1,47 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "DeferredLog.h"
+
+using namespace std;
+
+namespace kc1fsz {
+
+void DeferredLog::flush() {
+    _deferred = false;
+    for (const Held& held : _held)
+        _pass(held.sev.c_str(), held.msg.c_str());
+    _held.clear();
+}
+
+void DeferredLog::_out(const char* sev, const char*, const char* msg) {
+    if (_deferred)
+        _held.push_back({ string(sev), string(msg) });
+    else
+        _pass(sev, msg);
+}
+
+void DeferredLog::_pass(const char* sev, const char* msg) {
+    if (!_target)
+        return;
+    // The severity is the first letter ("E" for an error)
+    if (sev[0] == 'E' || sev[0] == 'e')
+        _target->error("%s", msg);
+    else
+        _target->info("%s", msg);
+}
+
+}
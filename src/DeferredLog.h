@@ -0,0 +1,72 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "kc1fsz-tools/Log.h"
+
+namespace kc1fsz {
+
+/**
+ * A Log that passes everything on to another Log, but which can be told
+ * to hold the messages for a while and pass them on later. This is used
+ * to keep the (non thread-safe) main Log out of work that runs on a
+ * WorkerPool: the messages are held while the work runs and are passed
+ * on once the main thread gets control back.
+ *
+ * Messages keep their severity (error() or info()) when they are passed
+ * on, and held messages are timestamped when they are passed on.
+ *
+ * Not thread-safe. Only one thread can be using this at a time.
+ */
+class DeferredLog : public Log {
+public:
+
+    void setTarget(Log* target) { _target = target; }
+
+    /**
+     * Messages are held until the next flush().
+     */
+    void beginDeferred() { _deferred = true; }
+
+    /**
+     * Passes on anything that is being held and goes back to passing 
+     * messages straight through.
+     */
+    void flush();
+
+protected:
+
+    void _out(const char* sev, const char* dt, const char* msg);
+
+private:
+
+    void _pass(const char* sev, const char* msg);
+
+    struct Held {
+        std::string sev;
+        std::string msg;
+    };
+
+    Log* _target = 0;
+    bool _deferred = false;
+    std::vector<Held> _held;
+};
+
+}
@@ -15,6 +15,9 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <algorithm>
+#include <vector>
+#include <memory>
+#include <cerrno>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -27,14 +30,172 @@
 #include "kc1fsz-tools/linux/StdClock.h"
 
 #include "Runnable2.h"
+#include "IoUring.h"
 #include "EventLoop.h"
 
 namespace kc1fsz {
 
+#ifdef AMP_IO_URING
+
+/**
+ * The io_uring version of the poll() at the top of the event loop. The
+ * tick timeout and the polls stay armed in the ring from one iteration
+ * to the next (the polls are multishot) so an iteration is a single 
+ * io_uring_enter() that submits whatever has changed, plus anything the 
+ * tasks have queued, and waits for the first completion.
+ */
+class RingWait : public IoUring::Handler {
+public:
+
+    RingWait(IoUring& ring) 
+    :   _ring(ring) { 
+        _handlerId = _ring.addHandler(this);
+    }
+
+    ~RingWait() {
+        _ring.removeHandler(_handlerId);
+    }
+
+    /**
+     * @param block Set to false when a task has more work pending, in 
+     * which case nothing is waited for.
+     * @returns 0 or -errno
+     */
+    int wait(const pollfd* fds, unsigned fdsSize, uint32_t sleepUs, bool block) {
+
+        _syncPolls(fds, fdsSize);
+
+        // The timeout stays armed until it fires, even if something else 
+        // wakes us up first, so there is one of these per tick rather 
+        // than one per iteration.
+        if (block && !_timeoutArmed) {
+            _timeout.tv_sec = sleepUs / 1000000;
+            _timeout.tv_nsec = (sleepUs % 1000000) * 1000;
+            io_uring_sqe* sqe = _ring.getSqe(_handlerId, TIMEOUT);
+            if (sqe) {
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->fd = -1;
+                sqe->addr = (uint64_t)&_timeout;
+                sqe->len = 1;
+                _timeoutArmed = true;
+            }
+        }
+
+        int rc = block ? _ring.submitAndWait() : _ring.submit();
+        _ring.dispatch();
+        return (rc < 0 && rc != -EINTR) ? rc : 0;
+    }
+
+    /**
+     * Cancels all of the polls so they get armed again from scratch. A
+     * poll holds onto the file that it was armed on, so this is the 
+     * backstop for a file descriptor that is closed and re-opened under
+     * the same number between two iterations.
+     */
+    void rearm() {
+        for (const Poll& poll : _polls)
+            _remove(poll);
+        _polls.clear();
+    }
+
+    /**
+     * @returns true if the kernel turned down a multishot poll, in which
+     * case poll() should be used instead.
+     */
+    bool isUnsupported() const { return _unsupported; }
+
+    virtual void ringComplete(uint64_t data, int res, uint32_t flags) {
+        if (data == TIMEOUT) {
+            _timeoutArmed = false;
+            return;
+        }
+        if (res == -EINVAL)
+            _unsupported = true;
+        // A poll that won't be reporting anything more. Anything that 
+        // isn't in the list anymore was removed on purpose.
+        if (!(flags & IORING_CQE_F_MORE)) {
+            for (auto it = _polls.begin(); it != _polls.end(); it++) {
+                if (it->serial == data) {
+                    _polls.erase(it);
+                    break;
+                }
+            }
+        }
+        // Otherwise there is nothing to do, the tasks will be run anyway
+    }
+
+private:
+
+    // Polls are identified by a serial number
+    static const uint64_t TIMEOUT = 1ULL << 32;
+
+    struct Poll {
+        int fd;
+        short events;
+        uint32_t serial;
+    };
+
+    void _syncPolls(const pollfd* fds, unsigned fdsSize) {
+        // Anything that isn't wanted anymore
+        for (auto it = _polls.begin(); it != _polls.end(); ) {
+            bool wanted = false;
+            for (unsigned i = 0; i < fdsSize && !wanted; i++) 
+                wanted = fds[i].fd == it->fd && fds[i].events == it->events;
+            if (wanted) {
+                it++;
+            } else {
+                _remove(*it);
+                it = _polls.erase(it);
+            }
+        }
+        // Anything that is new
+        for (unsigned i = 0; i < fdsSize; i++) {
+            bool armed = false;
+            for (const Poll& poll : _polls)
+                armed = armed || (poll.fd == fds[i].fd && poll.events == fds[i].events);
+            if (armed)
+                continue;
+            Poll poll = { fds[i].fd, fds[i].events, _nextSerial++ };
+            io_uring_sqe* sqe = _ring.getSqe(_handlerId, poll.serial);
+            if (!sqe)
+                continue;
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = poll.fd;
+            uint32_t events = (uint16_t)poll.events;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            events = __builtin_bswap32(events);
+#endif
+            sqe->poll32_events = events;
+            sqe->len = IORING_POLL_ADD_MULTI;
+            _polls.push_back(poll);
+        }
+    }
+
+    void _remove(const Poll& poll) {
+        // The completion of the removal itself isn't interesting
+        io_uring_sqe* sqe = _ring.getSqe(0, 0);
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = ((uint64_t)_handlerId << IoUring::DATA_BITS) | poll.serial;
+    }
+
+    IoUring& _ring;
+    int _handlerId;
+    std::vector<Poll> _polls;
+    uint32_t _nextSerial = 1;
+    __kernel_timespec _timeout;
+    bool _timeoutArmed = false;
+    bool _unsupported = false;
+};
+
+#endif
+
 void EventLoop::run(Log& log, Clock& clock, 
     Runnable** tasks1, unsigned task1Count,
     Runnable2** tasks, unsigned taskCount,
-    std::function<bool(Log& log, Clock& clock)> cb, bool trace) {
+    std::function<bool(Log& log, Clock& clock)> cb, bool trace, bool useRing) {
 
     StdPollTimer timer20ms(clock, 20000);
     StdPollTimer timer250ms(clock, 250000);
@@ -54,6 +215,24 @@ void EventLoop::run(Log& log, Clock& clock,
 
     unsigned long usedUs[16] = { 0 };
 
+    // Set when a task says that it has more work to do
+    bool morePending = false;
+
+#ifdef AMP_IO_URING
+    // The ring is sized for a busy IAX2 line: a completion for each of 
+    // the provided receive buffers plus the sends from one tick.
+    IoUring ring;
+    std::unique_ptr<RingWait> ringWait;
+    if (useRing && ring.init(log, 256, 4096) == 0) {
+        ringWait = std::make_unique<RingWait>(ring);
+        for (unsigned i = 0; i < taskCount; i++)
+            tasks[i]->attachRing(&ring);
+    }
+#else
+    if (useRing)
+        log.info("io_uring isn't available on this platform, using poll()");
+#endif
+
     // IMPORTANT POINT: THIS IS THE ACTUAL EVENT LOOP OF THE APPLICATION. THIS
     // WHILE LOOP WILL NEVER EXIT!
 
@@ -78,12 +257,16 @@ void EventLoop::run(Log& log, Clock& clock,
         // Figure out how long we can sleep without missing the 
         // end of the current 20ms interval. Good audio quality depends
         // on us servicing the 20ms promptly every time.
-        uint32_t msLeft = timer20ms.usLeftInInterval();
-        msLeft /= 1000;
+        const uint32_t usLeft = timer20ms.usLeftInInterval();
+        uint32_t msLeft = usLeft / 1000;
     
         uint32_t sleepMs = msLeft;
         // But never less than 2ms
         sleepMs = std::max(sleepMs, (uint32_t)2);
+        // Unless a task still has work to do, in which case we only check
+        // for I/O activity and go right back to work.
+        if (morePending)
+            sleepMs = 0;
 
         // Block waiting for I/O activity wakeup or sleep timeout
         int rc = 0;
@@ -108,6 +291,19 @@ void EventLoop::run(Log& log, Clock& clock,
         // On the other hand, be cautious of a program that loops excessively and 
         // consumes high CPU%.
         
+#ifdef AMP_IO_URING
+        if (ringWait) {
+            rc = ringWait->wait(fds, fdsSize, std::max(usLeft, (uint32_t)2000), !morePending);
+            if (ringWait->isUnsupported()) {
+                log.info("io_uring polls aren't supported, using poll()");
+                for (unsigned i = 0; i < taskCount; i++)
+                    tasks[i]->attachRing(nullptr);
+                ringWait.reset();
+                ring.close();
+            }
+        }
+        else
+#endif
         rc = poll(fds, fdsSize, sleepMs);
 #endif
         if (rc < 0) {
@@ -140,9 +336,11 @@ void EventLoop::run(Log& log, Clock& clock,
             }
         }  
 
+        morePending = false;
         for (unsigned i = 0; i < taskCount; i++) {
             uint64_t startUs = clock.timeUs();
-            tasks[i]->run2();             
+            if (tasks[i]->run2())
+                morePending = true;
             uint64_t endUs = clock.timeUs();
             usedUs[i] += (endUs - startUs);
         }
@@ -155,6 +353,10 @@ void EventLoop::run(Log& log, Clock& clock,
         if (timer1s.poll()) {
             for (unsigned i = 0; i < taskCount; i++)
                 tasks[i]->oneSecTick();
+#ifdef AMP_IO_URING
+            if (ringWait)
+                ringWait->rearm();
+#endif
         }
 
         bool showStats = false;
@@ -205,6 +407,13 @@ void EventLoop::run(Log& log, Clock& clock,
 
         loopCount++;
     }
+
+#ifdef AMP_IO_URING
+    if (ringWait) {
+        for (unsigned i = 0; i < taskCount; i++)
+            tasks[i]->attachRing(nullptr);
+    }
+#endif
 }
 
 }
@@ -31,12 +31,16 @@ public:
     /**
      * @param cb (Optional) Called on every cycle. If false is
      * returned then the loop exits.
+     * @param useRing (Optional) Wait on an io_uring instead of poll() when
+     * the kernel supports it. The 20ms tick timeout and the polls are kept
+     * armed in the ring and the tasks are offered the ring for their own
+     * I/O (see Runnable2::attachRing()). Falls back to poll() otherwise.
      */
     static void run(Log& log, Clock& lock, 
         Runnable** tasks1, unsigned task1Count,
         Runnable2** tasks, unsigned taskCount,
         std::function<bool(Log& log, Clock& clock)> cb = nullptr,
-        bool trace = false);    
+        bool trace = false, bool useRing = false);    
 };
 
 }
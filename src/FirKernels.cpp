@@ -0,0 +1,192 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cassert>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FIR_X86 1
+#include <immintrin.h>
+#endif
+
+// NEON is decided at compile time (i.e. by the -mfpu flags on 32-bit ARM,
+// always present on 64-bit ARM).
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FIR_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "amp/FirKernels.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+static inline int16_t saturateQ15(int64_t acc) {
+    acc >>= 15;
+    if (acc > 32767)
+        return 32767;
+    else if (acc < -32768)
+        return -32768;
+    return acc;
+}
+
+// ===== Scalar (Reference) ===================================================
+
+static int64_t dot_scalar(const int16_t* x, const int16_t* c, unsigned taps) {
+    int64_t acc = 0;
+    for (unsigned k = 0; k < taps; k++)
+        acc += (int32_t)c[k] * (int32_t)x[k];
+    return acc;
+}
+
+static void fir_scalar(int16_t* out, unsigned outStride, const int16_t* x,
+    unsigned inStep, const int16_t* coeffs, unsigned taps, unsigned n) {
+    for (unsigned i = 0; i < n; i++, out += outStride, x += inStep)
+        *out = saturateQ15(dot_scalar(x, coeffs, taps));
+}
+
+static const FirKernels scalarKernels = {
+    fir_scalar, FirKernels::Backend::SCALAR, "scalar"
+};
+
+// ===== SSE2/AVX2 ============================================================
+
+// The multiply-add instructions sum pairs of 16x16 products into 32 bits,
+// which can't overflow as long as no coefficient is -32768. The pair sums
+// are widened to 64 bits before accumulating so that the result is exact
+// for any filter length.
+
+#ifdef FIR_X86
+
+static void fir_sse2(int16_t* out, unsigned outStride, const int16_t* x,
+    unsigned inStep, const int16_t* coeffs, unsigned taps, unsigned n) {
+    for (unsigned i = 0; i < n; i++, out += outStride, x += inStep) {
+        __m128i acc = _mm_setzero_si128();
+        unsigned k = 0;
+        for (; k + 8 <= taps; k += 8) {
+            __m128i m = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(x + k)),
+                _mm_loadu_si128((const __m128i*)(coeffs + k)));
+            // Sign-extend to 64 bits
+            __m128i sign = _mm_srai_epi32(m, 31);
+            acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(m, sign));
+            acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(m, sign));
+        }
+        int64_t lanes[2];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        *out = saturateQ15(lanes[0] + lanes[1] + dot_scalar(x + k, coeffs + k, taps - k));
+    }
+}
+
+__attribute__((target("avx2")))
+static void fir_avx2(int16_t* out, unsigned outStride, const int16_t* x,
+    unsigned inStep, const int16_t* coeffs, unsigned taps, unsigned n) {
+    for (unsigned i = 0; i < n; i++, out += outStride, x += inStep) {
+        __m256i acc = _mm256_setzero_si256();
+        unsigned k = 0;
+        for (; k + 16 <= taps; k += 16) {
+            __m256i m = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(x + k)),
+                _mm256_loadu_si256((const __m256i*)(coeffs + k)));
+            acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(m)));
+            acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(m, 1)));
+        }
+        int64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        *out = saturateQ15(lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+            dot_scalar(x + k, coeffs + k, taps - k));
+    }
+}
+
+static const FirKernels sse2Kernels = {
+    fir_sse2, FirKernels::Backend::SSE2, "sse2"
+};
+
+static const FirKernels avx2Kernels = {
+    fir_avx2, FirKernels::Backend::AVX2, "avx2"
+};
+
+#endif
+
+// ===== NEON =================================================================
+
+#ifdef FIR_NEON
+
+static void fir_neon(int16_t* out, unsigned outStride, const int16_t* x,
+    unsigned inStep, const int16_t* coeffs, unsigned taps, unsigned n) {
+    for (unsigned i = 0; i < n; i++, out += outStride, x += inStep) {
+        int64x2_t acc = vdupq_n_s64(0);
+        unsigned k = 0;
+        for (; k + 8 <= taps; k += 8) {
+            int16x8_t a = vld1q_s16(x + k);
+            int16x8_t c = vld1q_s16(coeffs + k);
+            // Widening multiply, then pairwise add into 64 bits
+            acc = vpadalq_s32(acc, vmull_s16(vget_low_s16(a), vget_low_s16(c)));
+            acc = vpadalq_s32(acc, vmull_s16(vget_high_s16(a), vget_high_s16(c)));
+        }
+        *out = saturateQ15(vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1) +
+            dot_scalar(x + k, coeffs + k, taps - k));
+    }
+}
+
+static const FirKernels neonKernels = {
+    fir_neon, FirKernels::Backend::NEON, "neon"
+};
+
+#endif
+
+// ===== Dispatch =============================================================
+
+bool FirKernels::isSupported(Backend backend) {
+    if (backend == Backend::SCALAR)
+        return true;
+#ifdef FIR_X86
+    else if (backend == Backend::SSE2)
+        return __builtin_cpu_supports("sse2");
+    else if (backend == Backend::AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef FIR_NEON
+    else if (backend == Backend::NEON)
+        return true;
+#endif
+    return false;
+}
+
+const FirKernels& FirKernels::get(Backend backend) {
+    assert(isSupported(backend));
+#ifdef FIR_X86
+    if (backend == Backend::SSE2)
+        return sse2Kernels;
+    else if (backend == Backend::AVX2)
+        return avx2Kernels;
+#endif
+#ifdef FIR_NEON
+    if (backend == Backend::NEON)
+        return neonKernels;
+#endif
+    return scalarKernels;
+}
+
+const FirKernels& FirKernels::get() {
+    // Best first
+    static const FirKernels& best =
+        isSupported(Backend::AVX2) ? get(Backend::AVX2) :
+        isSupported(Backend::SSE2) ? get(Backend::SSE2) :
+        isSupported(Backend::NEON) ? get(Backend::NEON) :
+        get(Backend::SCALAR);
+    return best;
+}
+
+    }
+}
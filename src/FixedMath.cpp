@@ -0,0 +1,154 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cassert>
+#include <algorithm>
+
+#include "amp/FixedMath.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+// log2(1 + i/256) in Q16
+static const uint32_t LOG2_TABLE[257] = {
+    0, 369, 736, 1102, 1466, 1829, 2190, 2551,
+    2909, 3267, 3623, 3978, 4331, 4683, 5034, 5384,
+    5732, 6079, 6425, 6769, 7112, 7454, 7795, 8134,
+    8473, 8810, 9146, 9480, 9814, 10146, 10477, 10807,
+    11136, 11464, 11791, 12116, 12440, 12764, 13086, 13407,
+    13727, 14046, 14363, 14680, 14996, 15310, 15624, 15937,
+    16248, 16559, 16868, 17177, 17484, 17791, 18096, 18401,
+    18704, 19007, 19308, 19609, 19909, 20207, 20505, 20802,
+    21098, 21393, 21687, 21980, 22272, 22564, 22854, 23144,
+    23433, 23720, 24007, 24293, 24579, 24863, 25146, 25429,
+    25711, 25992, 26272, 26551, 26830, 27108, 27384, 27660,
+    27936, 28210, 28484, 28757, 29029, 29300, 29571, 29840,
+    30109, 30378, 30645, 30912, 31178, 31443, 31707, 31971,
+    32234, 32496, 32758, 33019, 33279, 33538, 33797, 34055,
+    34312, 34569, 34825, 35080, 35334, 35588, 35841, 36094,
+    36346, 36597, 36847, 37097, 37346, 37595, 37842, 38090,
+    38336, 38582, 38827, 39072, 39316, 39559, 39802, 40044,
+    40286, 40527, 40767, 41006, 41246, 41484, 41722, 41959,
+    42196, 42432, 42667, 42902, 43137, 43370, 43603, 43836,
+    44068, 44300, 44530, 44761, 44990, 45220, 45448, 45676,
+    45904, 46131, 46357, 46583, 46809, 47034, 47258, 47482,
+    47705, 47928, 48150, 48372, 48593, 48813, 49034, 49253,
+    49472, 49691, 49909, 50127, 50344, 50560, 50776, 50992,
+    51207, 51422, 51636, 51850, 52063, 52276, 52488, 52700,
+    52911, 53122, 53332, 53542, 53751, 53960, 54169, 54377,
+    54584, 54791, 54998, 55204, 55410, 55615, 55820, 56025,
+    56229, 56432, 56635, 56838, 57040, 57242, 57443, 57644,
+    57845, 58045, 58245, 58444, 58643, 58841, 59039, 59237,
+    59434, 59631, 59827, 60023, 60219, 60414, 60609, 60803,
+    60997, 61190, 61384, 61576, 61769, 61961, 62152, 62343,
+    62534, 62725, 62915, 63104, 63294, 63483, 63671, 63859,
+    64047, 64234, 64421, 64608, 64794, 64980, 65166, 65351,
+    65536
+};
+
+// 2^(i/256) in Q16
+static const uint32_t EXP2_TABLE[257] = {
+    65536, 65714, 65892, 66071, 66250, 66429, 66609, 66790,
+    66971, 67153, 67335, 67517, 67700, 67884, 68068, 68252,
+    68438, 68623, 68809, 68996, 69183, 69370, 69558, 69747,
+    69936, 70126, 70316, 70507, 70698, 70889, 71082, 71274,
+    71468, 71661, 71856, 72050, 72246, 72442, 72638, 72835,
+    73032, 73230, 73429, 73628, 73828, 74028, 74229, 74430,
+    74632, 74834, 75037, 75240, 75444, 75649, 75854, 76060,
+    76266, 76473, 76680, 76888, 77096, 77305, 77515, 77725,
+    77936, 78147, 78359, 78572, 78785, 78998, 79212, 79427,
+    79642, 79858, 80075, 80292, 80510, 80728, 80947, 81166,
+    81386, 81607, 81828, 82050, 82273, 82496, 82719, 82944,
+    83169, 83394, 83620, 83847, 84074, 84302, 84531, 84760,
+    84990, 85220, 85451, 85683, 85915, 86148, 86382, 86616,
+    86851, 87086, 87322, 87559, 87796, 88034, 88273, 88513,
+    88752, 88993, 89234, 89476, 89719, 89962, 90206, 90451,
+    90696, 90942, 91188, 91436, 91684, 91932, 92181, 92431,
+    92682, 92933, 93185, 93438, 93691, 93945, 94200, 94455,
+    94711, 94968, 95226, 95484, 95743, 96002, 96263, 96524,
+    96785, 97048, 97311, 97575, 97839, 98104, 98370, 98637,
+    98905, 99173, 99442, 99711, 99982, 100253, 100524, 100797,
+    101070, 101344, 101619, 101895, 102171, 102448, 102726, 103004,
+    103283, 103564, 103844, 104126, 104408, 104691, 104975, 105260,
+    105545, 105831, 106118, 106406, 106694, 106984, 107274, 107565,
+    107856, 108149, 108442, 108736, 109031, 109326, 109623, 109920,
+    110218, 110517, 110816, 111117, 111418, 111720, 112023, 112327,
+    112631, 112937, 113243, 113550, 113858, 114167, 114476, 114787,
+    115098, 115410, 115723, 116036, 116351, 116667, 116983, 117300,
+    117618, 117937, 118257, 118577, 118899, 119221, 119544, 119869,
+    120194, 120519, 120846, 121174, 121502, 121832, 122162, 122493,
+    122825, 123158, 123492, 123827, 124163, 124500, 124837, 125176,
+    125515, 125855, 126197, 126539, 126882, 127226, 127571, 127917,
+    128263, 128611, 128960, 129310, 129660, 130012, 130364, 130718,
+    131072
+};
+
+// 10 log10(2) in Q24
+static const int64_t DB_PER_OCTAVE_Q24 = 50504453;
+// log2(10) / 20 in Q24
+static const int64_t OCTAVES_PER_DB_Q24 = 2786635;
+
+static unsigned msb64(uint64_t x) {
+    return 63 - __builtin_clzll(x);
+}
+
+int32_t log2Q16(uint64_t x) {
+    assert(x != 0);
+    // Normalize to [2^24, 2^25): 8 bits of table index and 16 bits to
+    // interpolate with.
+    const unsigned msb = msb64(x);
+    const uint32_t m = (msb >= 24) ? (uint32_t)(x >> (msb - 24)) : 
+        (uint32_t)(x << (24 - msb));
+    const unsigned i = (m >> 16) & 0xff;
+    const uint32_t frac = m & 0xffff;
+    const uint32_t y = LOG2_TABLE[i] + 
+        (((LOG2_TABLE[i + 1] - LOG2_TABLE[i]) * frac) >> 16);
+    return ((int32_t)msb << 16) + (int32_t)y;
+}
+
+int32_t powerRatioDbQ8(uint64_t num, uint64_t den) {
+    if (num == 0)
+        return MIN_DB_Q8;
+    const int64_t octaves = (int64_t)log2Q16(num) - (int64_t)log2Q16(den);
+    // Q16 * Q24 -> Q8
+    const int64_t db = (octaves * DB_PER_OCTAVE_Q24 + ((int64_t)1 << 31)) >> 32;
+    return (int32_t)std::max(db, (int64_t)MIN_DB_Q8);
+}
+
+int32_t dbToGainQ(int32_t dbQ8, unsigned fracBits) {
+    assert(fracBits <= 30);
+    // Q8 * Q24 -> Q16
+    const int64_t e = ((int64_t)dbQ8 * OCTAVES_PER_DB_Q24) >> 16;
+    const int32_t whole = (int32_t)(e >> 16);
+    const uint32_t frac = (uint32_t)e & 0xffff;
+    const unsigned i = frac >> 8;
+    // Mantissa in [1, 2) in Q16
+    const uint64_t m = EXP2_TABLE[i] + 
+        (((EXP2_TABLE[i + 1] - EXP2_TABLE[i]) * (frac & 0xff)) >> 8);
+    const int32_t shift = whole + (int32_t)fracBits - 16;
+    uint64_t g;
+    if (shift >= 0) {
+        if (shift > 30)
+            return INT32_MAX;
+        g = m << shift;
+    }
+    else 
+        g = (-shift >= 64) ? 0 : (m + ((uint64_t)1 << (-shift - 1))) >> -shift;
+    return (int32_t)std::min(g, (uint64_t)INT32_MAX);
+}
+
+    }
+}
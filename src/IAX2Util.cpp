@@ -173,6 +173,27 @@ unsigned codecSampleRate(CODECType type) {
         return 0;
 }
 
+const char* codecName(CODECType type) {
+    if (type == CODECType::IAX2_CODEC_G711_ULAW)
+        return "ulaw";
+    else if (type == CODECType::IAX2_CODEC_G711_ALAW)
+        return "alaw";
+    else if (type == CODECType::IAX2_CODEC_G726_AAL2)
+        return "g726";
+    else if (type == CODECType::IAX2_CODEC_GSM_FULL)
+        return "gsm";
+    else if (type == CODECType::IAX2_CODEC_SLIN_8K)
+        return "slin8";
+    else if (type == CODECType::IAX2_CODEC_SLIN_16K)
+        return "slin16";
+    else if (type == CODECType::IAX2_CODEC_SLIN_48K)
+        return "slin48";
+    else if (type == CODECType::IAX2_CODEC_PCM_48K)
+        return "pcm48";
+    else 
+        return "unknown";
+}
+
 /**
  * Fills in the array with the CODECs that are supported in preference order.
  * @returns The number of CODECs currently supported.
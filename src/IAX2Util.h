@@ -115,6 +115,11 @@ unsigned maxVoiceFrameSize(CODECType type);
 
 unsigned codecSampleRate(CODECType type);
 
+/**
+ * @returns A short name for the CODEC, used for display/statistics.
+ */
+const char* codecName(CODECType type);
+
 /**
  * @returns The number of samples in a frame.
  */
@@ -0,0 +1,332 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <algorithm>
+
+#include "kc1fsz-tools/Log.h"
+
+#include "IoUring.h"
+
+#ifdef AMP_IO_URING
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace kc1fsz {
+
+IoUring::~IoUring() {
+    close();
+}
+
+#ifdef AMP_IO_URING
+
+// The ring indices are shared with the kernel
+static unsigned loadAcquire(unsigned* p) {
+    return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+}
+
+static void storeRelease(unsigned* p, unsigned v) {
+    std::atomic_ref<unsigned>(*p).store(v, std::memory_order_release);
+}
+
+int IoUring::init(Log& log, unsigned sqEntries, unsigned cqEntries) {
+
+    close();
+
+    // The completions only need to be run when we go into the kernel,
+    // and only this thread will be submitting. Older kernels don't know
+    // about these, so try again without.
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN |
+        IORING_SETUP_SINGLE_ISSUER;
+    params.cq_entries = cqEntries;
+    int fd = syscall(__NR_io_uring_setup, sqEntries, &params);
+    if (fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = cqEntries;
+        fd = syscall(__NR_io_uring_setup, sqEntries, &params);
+    }
+    if (fd < 0) {
+        log.info("io_uring isn't available (%d)", errno);
+        return -1;
+    }
+
+    // Anything older than this isn't worth the trouble
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_NODROP)) {
+        log.info("io_uring is too old (%08X)", params.features);
+        ::close(fd);
+        return -1;
+    }
+
+    const unsigned long sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const unsigned long cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    _ringMemSize = std::max(sqSize, cqSize);
+    _ringMem = mmap(0, _ringMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        fd, IORING_OFF_SQ_RING);
+    if (_ringMem == MAP_FAILED) {
+        log.error("io_uring ring mmap failed (%d)", errno);
+        _ringMem = nullptr;
+        ::close(fd);
+        return -1;
+    }
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(0, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        log.error("io_uring SQE mmap failed (%d)", errno);
+        munmap(_ringMem, _ringMemSize);
+        _ringMem = nullptr;
+        ::close(fd);
+        return -1;
+    }
+    _sqes = (io_uring_sqe*)sqes;
+
+    uint8_t* p = (uint8_t*)_ringMem;
+    _sqHead = (unsigned*)(p + params.sq_off.head);
+    _sqTail = (unsigned*)(p + params.sq_off.tail);
+    _sqArray = (unsigned*)(p + params.sq_off.array);
+    _sqMask = *(unsigned*)(p + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    _cqHead = (unsigned*)(p + params.cq_off.head);
+    _cqTail = (unsigned*)(p + params.cq_off.tail);
+    _cqMask = *(unsigned*)(p + params.cq_off.ring_mask);
+    _cqes = p + params.cq_off.cqes;
+
+    // The submission entries are always used in order
+    for (unsigned i = 0; i < _sqEntries; i++)
+        _sqArray[i] = i;
+    _sqLocalTail = *_sqTail;
+
+    _fd = fd;
+
+    log.info("Using io_uring (SQ %u, CQ %u)", params.sq_entries, params.cq_entries);
+    return 0;
+}
+
+void IoUring::close() {
+    if (_fd == -1)
+        return;
+    munmap(_sqes, _sqesSize);
+    munmap(_ringMem, _ringMemSize);
+    ::close(_fd);
+    _fd = -1;
+    _sqes = nullptr;
+    _ringMem = nullptr;
+    for (unsigned i = 0; i < MAX_HANDLERS; i++)
+        _handlers[i] = nullptr;
+}
+
+int IoUring::addHandler(Handler* handler) {
+    for (unsigned i = 1; i < MAX_HANDLERS; i++) {
+        if (_handlers[i] == nullptr) {
+            _handlers[i] = handler;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void IoUring::removeHandler(int handlerId) {
+    if (handlerId > 0 && handlerId < (int)MAX_HANDLERS)
+        _handlers[handlerId] = nullptr;
+}
+
+io_uring_sqe* IoUring::getSqe(int handlerId, uint64_t data) {
+    if (_fd == -1)
+        return nullptr;
+    if (_sqLocalTail - loadAcquire(_sqHead) >= _sqEntries) {
+        submit();
+        if (_sqLocalTail - loadAcquire(_sqHead) >= _sqEntries)
+            return nullptr;
+    }
+    io_uring_sqe* sqe = &_sqes[_sqLocalTail & _sqMask];
+    _sqLocalTail++;
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    sqe->user_data = ((uint64_t)handlerId << DATA_BITS) | (data & DATA_MASK);
+    return sqe;
+}
+
+int IoUring::_enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    int rc = syscall(__NR_io_uring_enter, _fd, toSubmit, minComplete, flags, nullptr, 0);
+    return rc < 0 ? -errno : rc;
+}
+
+int IoUring::submit() {
+    if (_fd == -1)
+        return -EBADF;
+    storeRelease(_sqTail, _sqLocalTail);
+    const unsigned toSubmit = _sqLocalTail - loadAcquire(_sqHead);
+    if (toSubmit == 0)
+        return 0;
+    return _enter(toSubmit, 0, 0);
+}
+
+int IoUring::submitAndWait() {
+    if (_fd == -1)
+        return -EBADF;
+    storeRelease(_sqTail, _sqLocalTail);
+    const unsigned toSubmit = _sqLocalTail - loadAcquire(_sqHead);
+    return _enter(toSubmit, 1, IORING_ENTER_GETEVENTS);
+}
+
+unsigned IoUring::dispatch() {
+    if (_fd == -1)
+        return 0;
+    unsigned count = 0;
+    while (true) {
+        const unsigned head = *_cqHead;
+        if (head == loadAcquire(_cqTail))
+            break;
+        const io_uring_cqe& cqe = ((const io_uring_cqe*)_cqes)[head & _cqMask];
+        const uint64_t userData = cqe.user_data;
+        const int res = cqe.res;
+        const uint32_t flags = cqe.flags;
+        // Consumed before the Handler runs in case it dispatches again
+        storeRelease(_cqHead, head + 1);
+        const unsigned handlerId = userData >> DATA_BITS;
+        if (handlerId < MAX_HANDLERS && _handlers[handlerId])
+            _handlers[handlerId]->ringComplete(userData & DATA_MASK, res, flags);
+        count++;
+    }
+    return count;
+}
+
+int IoUring::cancel(int handlerId, uint64_t data) {
+    if (_fd == -1)
+        return -EBADF;
+    io_uring_sync_cancel_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = ((uint64_t)handlerId << DATA_BITS) | (data & DATA_MASK);
+    reg.fd = -1;
+    reg.timeout.tv_sec = -1;
+    reg.timeout.tv_nsec = -1;
+    int rc = syscall(__NR_io_uring_register, _fd, IORING_REGISTER_SYNC_CANCEL, &reg, 1);
+    return rc < 0 ? -errno : 0;
+}
+
+// ----- BufferRing -----------------------------------------------------------
+
+IoUring::BufferRing::~BufferRing() {
+    detach();
+}
+
+int IoUring::BufferRing::attach(IoUring& ring, unsigned count, unsigned size) {
+
+    detach();
+
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768)
+        return -EINVAL;
+
+    // The kernel wants the ring to be page-aligned
+    const unsigned long brSize = count * sizeof(io_uring_buf);
+    void* br = mmap(0, brSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (br == MAP_FAILED)
+        return -errno;
+
+    const uint16_t groupId = ring.allocateBufferGroup();
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)br;
+    reg.ring_entries = count;
+    reg.bgid = groupId;
+    int rc = syscall(__NR_io_uring_register, ring.getFd(), IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (rc < 0) {
+        rc = -errno;
+        munmap(br, brSize);
+        return rc;
+    }
+
+    _ring = &ring;
+    _groupId = groupId;
+    _count = count;
+    _size = size;
+    _br = (io_uring_buf_ring*)br;
+    _storage.resize(count * size);
+    _tail = 0;
+    for (unsigned i = 0; i < count; i++)
+        _add(i);
+    _publish();
+    return 0;
+}
+
+void IoUring::BufferRing::detach() {
+    if (_ring == nullptr)
+        return;
+    if (_ring->isOpen()) {
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = _groupId;
+        syscall(__NR_io_uring_register, _ring->getFd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    munmap(_br, _count * sizeof(io_uring_buf));
+    _br = nullptr;
+    _ring = nullptr;
+}
+
+void IoUring::BufferRing::_add(uint16_t bufferId) {
+    // NOTE: The tail overlays the reserved field of the first buffer
+    // so that field is never written. The entries are found from the 
+    // start of the ring since the header's flexible array doesn't start
+    // at offset 0 when compiled as C++.
+    io_uring_buf& buf = ((io_uring_buf*)_br)[_tail & (_count - 1)];
+    buf.addr = (uint64_t)getBuffer(bufferId);
+    buf.len = _size;
+    buf.bid = bufferId;
+    _tail++;
+}
+
+void IoUring::BufferRing::_publish() {
+    std::atomic_ref<uint16_t>(_br->tail).store(_tail, std::memory_order_release);
+}
+
+void IoUring::BufferRing::recycle(uint16_t bufferId) {
+    if (_ring == nullptr)
+        return;
+    _add(bufferId);
+    _publish();
+}
+
+#else
+
+int IoUring::init(Log& log, unsigned, unsigned) {
+    log.info("io_uring isn't available on this platform");
+    return -1;
+}
+
+void IoUring::close() { }
+int IoUring::addHandler(Handler*) { return -1; }
+void IoUring::removeHandler(int) { }
+io_uring_sqe* IoUring::getSqe(int, uint64_t) { return nullptr; }
+int IoUring::submit() { return -EBADF; }
+int IoUring::submitAndWait() { return -EBADF; }
+unsigned IoUring::dispatch() { return 0; }
+int IoUring::cancel(int, uint64_t) { return -EBADF; }
+
+IoUring::BufferRing::~BufferRing() { }
+int IoUring::BufferRing::attach(IoUring&, unsigned, unsigned) { return -EINVAL; }
+void IoUring::BufferRing::detach() { }
+void IoUring::BufferRing::recycle(uint16_t) { }
+
+#endif
+
+}
@@ -0,0 +1,218 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// The newest things that we use (multishot receive, the single issuer 
+// hint, synchronous cancel) came in with the 6.0 headers. Older headers
+// get the stubs.
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_SETUP_SINGLE_ISSUER)
+#define AMP_IO_URING 1
+#endif
+#endif
+
+struct io_uring_sqe;
+struct io_uring_buf_ring;
+
+namespace kc1fsz {
+
+class Log;
+
+/**
+ * A minimal io_uring built directly on the system calls (i.e. no
+ * liburing). One ring is shared by everything that runs on an EventLoop
+ * thread: the loop keeps its tick timeout and poll requests in it and
+ * the tasks put their socket I/O in it (see Runnable2::attachRing()).
+ *
+ * Completions are routed to the Handler that made the request. The top
+ * bits of the user data identify the Handler and the rest is up to the
+ * Handler.
+ *
+ * Support is detected at runtime: init() fails on a kernel that doesn't
+ * have io_uring (or has it disabled), and always fails on platforms that
+ * don't have it at all. Callers are expected to fall back to poll().
+ *
+ * Not thread-safe. All use must be from the thread that called init().
+ */
+class IoUring {
+public:
+
+    class Handler {
+    public:
+        /**
+         * Called for each completion of a request made by this Handler.
+         * This can happen at any point where the ring is dispatched
+         * (ex: in the middle of a send), so the Handler should only
+         * record what happened and do the real work later (ex: in run2()).
+         *
+         * @param data The Handler's part of the user data.
+         * @param res The result of the request (-errno on failure).
+         * @param flags The IORING_CQE_F_xxx flags.
+         */
+        virtual void ringComplete(uint64_t data, int res, uint32_t flags) = 0;
+    };
+
+    static const unsigned MAX_HANDLERS = 16;
+    static const unsigned DATA_BITS = 48;
+    static const uint64_t DATA_MASK = (1ULL << DATA_BITS) - 1;
+
+    IoUring() { }
+    ~IoUring();
+
+    /**
+     * @param cqEntries The completion queue should be large enough to
+     * hold all of the completions that can build up between calls to
+     * dispatch() (ex: one per provided receive buffer).
+     * @returns 0 on success, -1 if io_uring can't be used.
+     */
+    int init(Log& log, unsigned sqEntries, unsigned cqEntries);
+
+    void close();
+
+    bool isOpen() const { return _fd != -1; }
+
+    /**
+     * @returns The Handler ID to use with getSqe(), or -1 if there is no
+     * room.
+     */
+    int addHandler(Handler* handler);
+
+    /**
+     * Any completions for the Handler that arrive after this are ignored.
+     */
+    void removeHandler(int handlerId);
+
+    /**
+     * @returns A zeroed submission entry with the user data filled in,
+     * or nullptr if the submission queue is full and can't be submitted.
+     * The entry goes to the kernel on the next submit().
+     */
+    io_uring_sqe* getSqe(int handlerId, uint64_t data);
+
+    /**
+     * Passes everything that is waiting in the submission queue to the
+     * kernel without waiting.
+     * @returns The number of entries submitted, or -errno.
+     */
+    int submit();
+
+    /**
+     * Like submit(), but then blocks until there is at least one
+     * completion.
+     */
+    int submitAndWait();
+
+    /**
+     * Passes all of the completions that are waiting to their Handlers.
+     * Each completion is consumed before its Handler is called, so this
+     * is safe to call from inside of a Handler.
+     * @returns The number of completions.
+     */
+    unsigned dispatch();
+
+    /**
+     * Cancels a request and waits for the cancellation to finish. The
+     * request's final completion still shows up in a later dispatch().
+     * @returns 0 on success, -errno on failure (-ENOENT if the request
+     * had already finished).
+     */
+    int cancel(int handlerId, uint64_t data);
+
+    /**
+     * @returns A new ID for a BufferRing.
+     */
+    uint16_t allocateBufferGroup() { return _nextBufferGroup++; }
+
+    int getFd() const { return _fd; }
+
+    /**
+     * A set of equal-size buffers that the kernel picks from when a
+     * receive request completes (a "provided buffer ring"). Buffers are
+     * handed back with recycle() once their contents have been used.
+     */
+    class BufferRing {
+    public:
+
+        ~BufferRing();
+
+        /**
+         * @param count A power of 2.
+         * @returns 0 on success, -errno if the kernel doesn't support
+         * buffer rings.
+         */
+        int attach(IoUring& ring, unsigned count, unsigned size);
+
+        void detach();
+
+        bool isAttached() const { return _ring != nullptr; }
+
+        uint16_t getGroupId() const { return _groupId; }
+
+        uint8_t* getBuffer(uint16_t bufferId) { return _storage.data() + bufferId * _size; }
+
+        unsigned getBufferSize() const { return _size; }
+
+        void recycle(uint16_t bufferId);
+
+    private:
+
+        void _add(uint16_t bufferId);
+        void _publish();
+
+        IoUring* _ring = nullptr;
+        uint16_t _groupId = 0;
+        unsigned _count = 0;
+        unsigned _size = 0;
+        io_uring_buf_ring* _br = nullptr;
+        std::vector<uint8_t> _storage;
+        uint16_t _tail = 0;
+    };
+
+private:
+
+    int _enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+    int _fd = -1;
+
+    void* _ringMem = nullptr;
+    unsigned long _ringMemSize = 0;
+    io_uring_sqe* _sqes = nullptr;
+    unsigned long _sqesSize = 0;
+
+    unsigned* _sqHead = nullptr;
+    unsigned* _sqTail = nullptr;
+    unsigned* _sqArray = nullptr;
+    unsigned _sqMask = 0;
+    unsigned _sqEntries = 0;
+    // The tail that we've filled up to (but not necessarily published)
+    unsigned _sqLocalTail = 0;
+
+    unsigned* _cqHead = nullptr;
+    unsigned* _cqTail = nullptr;
+    unsigned _cqMask = 0;
+    void* _cqes = nullptr;
+
+    // ID 0 is reserved for requests whose completions are of no interest
+    Handler* _handlers[MAX_HANDLERS] = { 0 };
+    uint16_t _nextBufferGroup = 1;
+};
+
+}
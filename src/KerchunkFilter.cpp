@@ -19,6 +19,8 @@
 #include "kc1fsz-tools/Log.h"
 #include "kc1fsz-tools/Clock.h"
 
+#include "amp/FixedMath.h"
+
 #include "Message.h"
 #include "KerchunkFilter.h"
 
@@ -88,11 +90,23 @@ void KerchunkFilter::audioRateTick(uint32_t tickMs) {
     }
 }
 
-float KerchunkFilter::_framePower(const Message& frame) {
-    float sumSquare = 0;
+int KerchunkFilter::_framePower(const Message& frame) {
     unsigned count = 0;
     const uint8_t* p = frame.body();
-    for (unsigned i = 0; i < BLOCK_SIZE_48K; i += 6, p += 12) {
+    // Looking at 8K worth of samples is plenty, whatever the rate
+    const unsigned samples = frame.size() / 2;
+    const unsigned step = samples / BLOCK_SIZE_8K;
+#ifdef AMP_FIXED_POINT
+    uint64_t sumSquare = 0;
+    for (unsigned i = 0; i < samples; i += step, p += step * 2) {
+        int32_t pcm = unpack_int16_le(p);
+        sumSquare += pcm * pcm;
+        count++;
+    }
+    return amp::powerRatioDbQ8(sumSquare, (uint64_t)count * 32767 * 32767) / 256;
+#else
+    float sumSquare = 0;
+    for (unsigned i = 0; i < samples; i += step, p += step * 2) {
         int16_t pcm = unpack_int16_le(p);
         float v = (float)pcm / 32767.0f;
         sumSquare += (v * v);
@@ -100,9 +114,18 @@ float KerchunkFilter::_framePower(const Message& frame) {
     }
     sumSquare /= (float)count;
     return 10.0 * std::log10(sumSquare);
+#endif
 }
 
 void KerchunkFilter::consume(const Message& frame) {
+    _consume(frame, false, 0);
+}
+
+void KerchunkFilter::consume(const Message& frame, int powerDb) {
+    _consume(frame, true, powerDb);
+}
+
+void KerchunkFilter::_consume(const Message& frame, bool havePower, int powerDb) {
 
     // When disabled everything just passes through
 
@@ -113,7 +136,7 @@ void KerchunkFilter::consume(const Message& frame) {
 
         bool isLeadingFrame = _clock->isPast(_lastFrameMs + 10 * 1000);
         if (isLeadingFrame) {
-            int power = _framePower(frame);
+            int power = havePower ? powerDb : _framePower(frame);
             if (power < vadPowerThreshold) {
                 return;
             }
@@ -64,10 +64,19 @@ public:
 
     virtual void consume(const Message& frame);
 
+    /**
+     * Same as consume() for a caller that already knows the power of the 
+     * frame (ex: measured before decoding), which saves recomputing it.
+     * 
+     * @param powerDb Frame power in whole dBFS.
+     */
+    void consume(const Message& frame, int powerDb);
+
 private:
 
     void _saveAndDiscard(std::queue<Message>& q);
-    static float _framePower(const Message& frame);
+    static int _framePower(const Message& frame);
+    void _consume(const Message& frame, bool havePower, int powerDb);
 
     enum State { 
         PASSING, 
@@ -0,0 +1,78 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include "LatencyHistogram.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+void LatencyHistogram::reset() {
+    memset(_counts, 0, sizeof(_counts));
+    _count = 0;
+    _max = 0;
+}
+
+void LatencyHistogram::add(uint32_t us) {
+    _counts[_bucket(us)]++;
+    _count++;
+    _max = std::max(_max, us);
+}
+
+uint32_t LatencyHistogram::getPercentile(unsigned pct) const {
+    assert(pct <= 100);
+    if (_count == 0)
+        return 0;
+    // The rank of the sample that we are looking for (1-based)
+    uint64_t rank = ((uint64_t)_count * pct + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < BUCKETS; b++) {
+        seen += _counts[b];
+        if (seen >= rank)
+            return std::min(_bucketTop(b), _max);
+    }
+    return _max;
+}
+
+/**
+ * Values below 8 get their own bucket. After that each power of two 
+ * is split into 8 equal parts.
+ */
+unsigned LatencyHistogram::_bucket(uint32_t us) {
+    if (us < SUB_BUCKETS)
+        return us;
+    unsigned e = 31 - __builtin_clz(us);
+    unsigned sub = (us >> (e - 3)) & (SUB_BUCKETS - 1);
+    return (e - 2) * SUB_BUCKETS + sub;
+}
+
+uint32_t LatencyHistogram::_bucketTop(unsigned bucket) {
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    unsigned e = bucket / SUB_BUCKETS + 2;
+    unsigned sub = bucket % SUB_BUCKETS;
+    uint64_t low = (uint64_t)(SUB_BUCKETS + sub) << (e - 3);
+    uint64_t top = low + ((uint64_t)1 << (e - 3)) - 1;
+    return (uint32_t)std::min(top, (uint64_t)UINT32_MAX);
+}
+
+    }
+}
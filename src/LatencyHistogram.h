@@ -0,0 +1,64 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * A fixed-size histogram of durations (in microseconds) that can report 
+ * percentiles. The buckets are log-linear (8 per power of two) so the 
+ * percentiles are accurate to within 12.5% over the whole range, and 
+ * adding a sample is a handful of instructions with no allocation.
+ */
+class LatencyHistogram {
+public:
+
+    LatencyHistogram() { reset(); }
+
+    void reset();
+
+    void add(uint32_t us);
+
+    uint32_t getCount() const { return _count; }
+
+    uint32_t getMax() const { return _max; }
+
+    /**
+     * @param pct The percentile, 0 to 100.
+     * @returns The upper end of the bucket that contains the percentile 
+     * (limited to the largest value seen), or 0 if there are no samples.
+     */
+    uint32_t getPercentile(unsigned pct) const;
+
+private:
+
+    static const unsigned SUB_BUCKETS = 8;
+    static const unsigned BUCKETS = 30 * SUB_BUCKETS;
+
+    static unsigned _bucket(uint32_t us);
+    static uint32_t _bucketTop(unsigned bucket);
+
+    uint32_t _counts[BUCKETS];
+    uint32_t _count;
+    uint32_t _max;
+};
+
+    }
+}
@@ -35,9 +35,8 @@ struct udphdr {
 #include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/ioctl.h>
-#include <linux/sockios.h> // Required for SIOCOUTQ
 #include <netinet/udp.h>
+#include <linux/filter.h>
 #endif
 
 #include <sys/types.h>
@@ -121,7 +120,9 @@ LineIAX2::LineIAX2(Log& log, Log& traceLog, Clock& clock, int busId,
     _publicUser(publicUser),
     _startTime(clock.time()),
     _calls(callSpace),
-    _maxCalls(callSpaceLen) {
+    _maxCalls(callSpaceLen),
+    _fullFrameIndex(callSpaceLen),
+    _miniFrameIndex(callSpaceLen) {
     // One-time initialization of calls
     for (unsigned i = 0; i < callSpaceLen; i++)
         _calls[i].init(this, &_clock);
@@ -206,14 +207,14 @@ int LineIAX2::open(short addrFamily, int listenPort) {
         _log.error("Failed to adjust socket send buffer");
     }
 
-    // Get the current send buffer size
-    {
-        int bufferSize = 0;
-        socklen_t optlen = sizeof(bufferSize);
-        if (getsockopt(iaxSockFd, SOL_SOCKET, SO_SNDBUF, &bufferSize, &optlen) < 0) {
-            _log.error("Unable to get TX buffer size");
-        } else {
-            _txSocketBufferSize = bufferSize;
+    _socketHealth.attach(_log, iaxSockFd);
+
+    if (_shardCount > 1) {
+        optval = 1;
+        if (setsockopt(iaxSockFd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+            _log.error("IAX setsockopt SO_REUSEPORT failed (%d)", errno);
+            ::close(iaxSockFd);
+            return -1;
         }
     }
 #endif
@@ -243,6 +244,13 @@ int LineIAX2::open(short addrFamily, int listenPort) {
         return -1;
     }
 
+    if (_shardCount > 1 && _shardSteering) {
+        if (_attachShardSteering(iaxSockFd) != 0) {
+            ::close(iaxSockFd);
+            return -1;
+        }
+    }
+
     if (makeNonBlocking(iaxSockFd) != 0) {
         _log.error("open fcntl failed (%d)", errno);
         ::close(iaxSockFd);
@@ -296,6 +304,8 @@ int LineIAX2::open(short addrFamily, int listenPort) {
 
 void LineIAX2::close() {   
 
+    _flushTxQueue();
+
     if (_captureEnabled)    
         _closeCapture();
 
@@ -303,12 +313,18 @@ void LineIAX2::close() {
     for (unsigned i = 0; i < _maxCalls; i++)
         _calls[i].reset();
 
+#ifdef AMP_IO_URING
+    // The ring holds onto the socket until the receive is cancelled
+    _cancelRingRx();
+#endif
+
     if (_iaxSockFd) 
         ::close(_iaxSockFd);
     if (_dnsSockFd) 
         ::close(_dnsSockFd);
     _iaxSockFd = -1;
     _dnsSockFd = -1;
+    _socketHealth.detach();
     _iaxListenPort = 0;
     _addrFamily = 0;
 } 
@@ -505,7 +521,12 @@ int LineIAX2::getPolls(pollfd* fds, unsigned fdsCapacity) {
     if (fdsCapacity < 2) 
         return -1;
     int used = 0;
-    if (_iaxSockFd != -1) {
+    bool ringRx = false;
+#ifdef AMP_IO_URING
+    // In io_uring mode the receive takes care of this
+    ringRx = _ringRxArmed;
+#endif
+    if (_iaxSockFd != -1 && !ringRx) {
         // We're only watching for receive events
         fds[used].fd = _iaxSockFd;
         fds[used].events = POLLIN;
@@ -523,6 +544,9 @@ int LineIAX2::getPolls(pollfd* fds, unsigned fdsCapacity) {
 bool LineIAX2::run2() {   
     bool w1 = _processInboundIAXData();
     bool w2 = _processInboundDNSData();
+    // The voice frames from the audio tick (which runs just before this)
+    // go out together.
+    _flushTxQueue();
     return w1 || w2;
 }
 
@@ -538,36 +562,25 @@ bool LineIAX2::_processInboundIAXData() {
     if (_iaxSockFd == -1)
         return false;
 
+#ifdef _WIN32
     // Check for new data on the socket
     // ### TODO: MOVE TO CONFIG AREA
     const unsigned readBufferSize = 2048;
     uint8_t readBuffer[readBufferSize];
     struct sockaddr_storage peerAddr;
     socklen_t peerAddrLen = sizeof(peerAddr);
-// Windows uses slightly different types on the socket calls
-#ifdef _WIN32    
+    // Windows uses slightly different types on the socket calls
     int rc = recvfrom(_iaxSockFd, (char*)readBuffer, readBufferSize, 0, (sockaddr*)&peerAddr, &peerAddrLen);
-#else
-    int rc = recvfrom(_iaxSockFd, readBuffer, readBufferSize, 0, (sockaddr*)&peerAddr, &peerAddrLen);
-#endif
     if (rc == 0) {
         return false;
     } 
-#ifdef _WIN32
     else if (rc == -1 && WSAGetLastError() == WSAEWOULDBLOCK) {
         return false;
     }
-#else
-    else if (rc == -1 && errno == 11) {
-        return false;
-    } 
-#endif
     else if (rc > 0) {
-        // #### TEMP: Drop packets to test recovery
-        //if (++dropRecvCount % 10 == 0) {
-        //    _log.info("Dropped inbound packet");
-        //    return true;
-        //}
+        _socketStats.rxCalls++;
+        _socketStats.rxPackets++;
+        _socketStats.rxMaxBatch = std::max(_socketStats.rxMaxBatch, 1U);
         // Capture/trace
         _captureRxPacket(readBuffer, rc, (const sockaddr&)peerAddr);
         // The actual processing of the received packet
@@ -579,6 +592,61 @@ bool LineIAX2::_processInboundIAXData() {
         _log.error("IAX2 read error %d/%d", rc, errno);
         return false;
     }
+#else
+#ifdef AMP_IO_URING
+    if (_ring != nullptr && !_ringRxUnsupported) {
+        _processRingRx();
+        // In case the receive stopped (ex: it ran out of buffers)
+        _armRingRx();
+        return false;
+    }
+#endif
+    // Drain the socket, up to a full batch in one call. The lengths are 
+    // modified by the kernel so they are set every time.
+    for (unsigned i = 0; i < RX_BATCH_SIZE; i++) {
+        _rxIovs[i].iov_base = _rxBuffers[i];
+        _rxIovs[i].iov_len = RX_BUFFER_SIZE;
+        memset(&_rxMsgs[i], 0, sizeof(mmsghdr));
+        _rxMsgs[i].msg_hdr.msg_name = &_rxAddrs[i];
+        _rxMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        _rxMsgs[i].msg_hdr.msg_iov = &_rxIovs[i];
+        _rxMsgs[i].msg_hdr.msg_iovlen = 1;
+        _rxMsgs[i].msg_hdr.msg_control = _rxControl[i];
+        _rxMsgs[i].msg_hdr.msg_controllen = SocketHealth::CONTROL_SIZE;
+    }
+    int rc = recvmmsg(_iaxSockFd, _rxMsgs, RX_BATCH_SIZE, MSG_DONTWAIT, 0);
+    if (rc == 0) {
+        return false;
+    } 
+    else if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return false;
+    } 
+    else if (rc > 0) {
+        _socketStats.rxCalls++;
+        _socketStats.rxPackets += rc;
+        _socketStats.rxMaxBatch = std::max(_socketStats.rxMaxBatch, (unsigned)rc);
+        for (int i = 0; i < rc; i++) {
+            // #### TEMP: Drop packets to test recovery
+            //if (++dropRecvCount % 10 == 0) {
+            //    _log.info("Dropped inbound packet");
+            //    continue;
+            //}
+            _socketHealth.consumeControl(_rxMsgs[i].msg_hdr);
+            const sockaddr& peerAddr = (const sockaddr&)_rxAddrs[i];
+            // Capture/trace
+            _captureRxPacket(_rxBuffers[i], _rxMsgs[i].msg_len, peerAddr);
+            // The actual processing of the received packet
+            _processReceivedIAXPacket(_rxBuffers[i], _rxMsgs[i].msg_len, peerAddr, 
+                _clock.time());
+        }
+        // A full batch means that there might be more
+        return (unsigned)rc == RX_BATCH_SIZE;
+    } else {
+        // #### TODO: ERROR COUNTER
+        _log.error("IAX2 read error %d/%d", rc, errno);
+        return false;
+    }
+#endif
 }
 
 bool LineIAX2::_processInboundDNSData() {
@@ -921,6 +989,7 @@ void LineIAX2::_processFullFrame(const uint8_t* potentiallyDangerousBuf,
             call.lastLagrqMs = _clock.time();
             call.lastFrameRxMs = _clock.time();
             call.codec = (CODECType)assignedCodec;
+            _indexCall(call);
 
             // Explicit ACK for the NEW
             _sendACK(0, call);
@@ -1139,14 +1208,17 @@ void LineIAX2::_processFullFrame(const uint8_t* potentiallyDangerousBuf,
         bool recognizedCall = false;        
         unsigned recognizedCallIx = 0;
 
-        for (unsigned i = 0; i < _maxCalls; i++) {
-            const Call& call = _calls[i];
-            if (call.active && call.localCallId == destCallId) {
-                recognizedCall = true;
-                recognizedCallIx = i;
-                break;
+        _fullFrameIndex.find(destCallId,
+            [this, destCallId, &recognizedCall, &recognizedCallIx](unsigned ix) {
+                const Call& call = _calls[ix];
+                if (call.active && call.localCallId == destCallId) {
+                    recognizedCall = true;
+                    recognizedCallIx = ix;
+                    return false;
+                }
+                return true;
             }
-        }
+        );
 
         if (!recognizedCall) {
             _invalidCallPacketCounter++;
@@ -1187,6 +1259,7 @@ void LineIAX2::_processFullFrame(const uint8_t* potentiallyDangerousBuf,
                 // Lock in the remote call ID
                 untrustedCall.remoteCallId = frame.getSourceCallId();  
                 untrustedCall.trusted = true;    
+                _indexCall(untrustedCall);
             }
         }
 
@@ -1975,8 +2048,7 @@ void LineIAX2::_processMiniFrame(const uint8_t* buf, unsigned bufLen,
     // Figure out which call this frame belong to (if any)
     uint16_t sourceCallId = unpack_uint16_be(buf) & 0x7fff;
 
-    _visitActiveCallsIf(
-        // Visitor
+    auto deliver = 
         [line=this, &log=_log, buf, bufLen, rxStampMs](Call& call) {
 
             call.lastFrameRxMs = line->_clock.time();
@@ -2008,14 +2080,155 @@ void LineIAX2::_processMiniFrame(const uint8_t* buf, unsigned bufLen,
                 log.error("Unsupported CODEC");
                 return;
             }
-        },
-        // Predicate
-        [sourceCallId, &unverifiedPeerAddr](const Call& call) {
-            return call.remoteCallId == sourceCallId && call.isPeerAddr(unverifiedPeerAddr);
+        };
+
+    _miniFrameIndex.find(_miniFrameKey(unverifiedPeerAddr, sourceCallId),
+        [this, &deliver, sourceCallId, &unverifiedPeerAddr](unsigned ix) {
+            Call& call = _calls[ix];
+            // The index only narrows things down, the call still needs 
+            // to be checked.
+            if (call.active && call.remoteCallId == sourceCallId && 
+                call.isPeerAddr(unverifiedPeerAddr))
+                deliver(call);
+            return true;
         }
     );
 }
 
+void LineIAX2::setShard(unsigned index, unsigned count, unsigned firstShardBusId, 
+    bool steer) {
+    assert(count > 0 && index < count);
+    assert(firstShardBusId + index == _busId);
+    _shardIndex = index;
+    _shardCount = count;
+    _firstShardBusId = firstShardBusId;
+    _shardSteering = steer;
+}
+
+unsigned LineIAX2::_shardOf(const sockaddr& peerAddr) const {
+    // This needs to agree with the program in _attachShardSteering(),
+    // which sees the address in host byte order.
+    uint32_t a = 0;
+    if (peerAddr.sa_family == AF_INET) {
+        a = ntohl(((const sockaddr_in&)peerAddr).sin_addr.s_addr);
+    }
+    else if (peerAddr.sa_family == AF_INET6) {
+        // The last 32 bits of the address. An IPv4 peer on a dual-stack 
+        // socket shows up here as ::ffff:a.b.c.d while the program sees 
+        // an IPv4 packet from a.b.c.d, and those are the same 32 bits.
+        uint32_t w;
+        memcpy(&w, ((const sockaddr_in6&)peerAddr).sin6_addr.s6_addr + 12, 4);
+        a = ntohl(w);
+    }
+    return a % _shardCount;
+}
+
+int LineIAX2::_attachShardSteering(int sockFd) {
+#ifdef _WIN32
+    return 0;
+#else
+    // The program picks the socket (in bind order) within the SO_REUSEPORT
+    // group. The packet data starts after the UDP header so the source 
+    // address is loaded relative to the IP header. A result that is out 
+    // of range (ex: not all shards are open yet) falls back to the 
+    // kernel's hash.
+    //
+    // An AF_INET6 socket is dual-stack, so the IP version is checked on
+    // every packet: the IPv4 source address is at offset 12 and the last 
+    // 32 bits of the IPv6 source address are at offset 20.
+    sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, (uint32_t)SKF_NET_OFF),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 4, 0, 2),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)SKF_NET_OFF + 12),
+        BPF_JUMP(BPF_JMP | BPF_JA, 1, 0, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)SKF_NET_OFF + 20),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, _shardCount),
+        BPF_STMT(BPF_RET | BPF_A, 0)
+    };
+    sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(sock_filter);
+    prog.filter = code;
+    if (setsockopt(sockFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        _log.error("IAX setsockopt SO_ATTACH_REUSEPORT_CBPF failed (%d)", errno);
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+void LineIAX2::_handOffCall(Call& call, unsigned shard) {
+
+    // The address is resolved at this point so the other shard gets an 
+    // explicit address and doesn't need to repeat the lookup.
+    char addr[64];
+    formatIPAddrAndPort((const sockaddr&)call.peerAddr, addr, 64);
+    PayloadCall payload;
+    strcpyLimited(payload.localNumber, call.localNumber.c_str(), sizeof(payload.localNumber));
+    int len = snprintf(payload.targetNumber, sizeof(payload.targetNumber), "iax:%s@%s/%s%s%s",
+        call.callUser.c_str(), addr, call.remoteNumber.c_str(), 
+        call.password.empty() ? "" : ",", call.password.c_str());
+
+    if (len < 0 || (unsigned)len >= sizeof(payload.targetNumber)) {
+        _publishCallFailed(call.localNumber.c_str(), call.remoteNumber.c_str(),
+            "Address too long for shard");
+        _terminateCall(call);
+        return;
+    }
+
+    _log.info("Call %s -> %s handed to shard %u", call.localNumber.c_str(), 
+        call.remoteNumber.c_str(), shard);
+
+    MessageWrapper msg(Message::Type::SIGNAL, Message::SignalType::CALL_NODE, 
+        sizeof(payload), (const uint8_t*)&payload, 0, _clock.time());
+    msg.setSource(_busId, Message::UNKNOWN_CALL_ID);
+    msg.setDest(_firstShardBusId + shard, Message::UNKNOWN_CALL_ID);
+    _bus.consume(msg);
+
+    // Nothing has been published for this call yet (i.e. no CALL_START) 
+    // so it can just be released.
+    call.reset();
+}
+
+void LineIAX2::_indexCall(Call& call) {
+    _unindexCall(call);
+    const unsigned ix = &call - _calls;
+    assert(ix < _maxCalls);
+    call.indexedLocalCallId = call.localCallId;
+    call.indexedMiniKey = _miniFrameKey((const sockaddr&)call.peerAddr, call.remoteCallId);
+    _fullFrameIndex.insert(call.indexedLocalCallId, ix);
+    _miniFrameIndex.insert(call.indexedMiniKey, ix);
+    call.indexed = true;
+}
+
+void LineIAX2::_unindexCall(Call& call) {
+    if (!call.indexed)
+        return;
+    const unsigned ix = &call - _calls;
+    _fullFrameIndex.remove(call.indexedLocalCallId, ix);
+    _miniFrameIndex.remove(call.indexedMiniKey, ix);
+    call.indexed = false;
+}
+
+uint64_t LineIAX2::_miniFrameKey(const sockaddr& peerAddr, unsigned remoteCallId) {
+    // Only the IP address is used (not the port) so that the key never
+    // rules out a call that Call::isPeerAddr() would accept.
+    uint64_t h = 0;
+    if (peerAddr.sa_family == AF_INET) {
+        h = ((const sockaddr_in&)peerAddr).sin_addr.s_addr;
+    }
+    else if (peerAddr.sa_family == AF_INET6) {
+        // FNV-1a
+        const uint8_t* a = ((const sockaddr_in6&)peerAddr).sin6_addr.s6_addr;
+        h = 14695981039346656037ULL;
+        for (unsigned i = 0; i < 16; i++) {
+            h ^= a[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    return (h << 16) ^ (remoteCallId & 0xffff);
+}
+
 void LineIAX2::_processReceivedDNSPacket(const uint8_t* buf, unsigned bufLen,
     const sockaddr& peerAddr) {
     if (bufLen < 12)
@@ -2296,6 +2509,16 @@ void LineIAX2::_progressCaller(Call& call) {
         _terminateCall(call);
     }
     else if (call.state == Call::State::STATE_INITIATION_REQUESTED) { 
+
+        // In sharded mode the call needs to be placed by the shard that
+        // will receive the peer's responses.
+        if (_shardCount > 1 && _shardSteering) {
+            unsigned shard = _shardOf((const sockaddr&)call.peerAddr);
+            if (shard != _shardIndex) {
+                _handOffCall(call, shard);
+                return;
+            }
+        }
         
         char addr[64];
         formatIPAddrAndPort((const sockaddr&)call.peerAddr, addr, 64);
@@ -2312,6 +2535,7 @@ void LineIAX2::_progressCaller(Call& call) {
         call.localCallId = _localCallIdCounter++;
         call.remoteCallId = 0;
         call.reTx.clear();
+        _indexCall(call);
 
         // Make a NEW frame
         //
@@ -2668,16 +2892,14 @@ void LineIAX2::consume(const Message& msg) {
                     }
                     // If no wrap then we can safely use a mini-frame
                     else {
-                        // NOTE: Make this large enough for the biggest code!
-                        const unsigned miniFrameMaxSize = 160 * 2 * 2 + 4;
-                        assert(msg.size() <= miniFrameMaxSize - 4);
-                        uint8_t miniFrame[miniFrameMaxSize];
+                        assert(msg.size() <= MAX_MINI_FRAME_SIZE - 4);
+                        uint8_t miniFrame[MAX_MINI_FRAME_SIZE];
                         // We make sure the F bit =0 to indicate a mini-frame
                         pack_uint16_be((0x7fff & call.localCallId), miniFrame);
                         // Send only the lower 16 bits of the timestamp per the spec
                         pack_uint16_be(0xffff & elapsed, miniFrame + 2);
                         memcpy(miniFrame + 4, msg.body(), msg.size());
-                        line->_sendFrameToPeer(miniFrame, msg.size() + 4, 
+                        line->_queueFrameToPeer(miniFrame, msg.size() + 4, 
                             (const sockaddr&)call.peerAddr);
                     }
 
@@ -2805,13 +3027,17 @@ void LineIAX2::_sendFrameToPeer(const IAX2FrameFull& frame,
 
 //static int dropSendCount = 0;
 
-// NOTE: This is the ONLY place where IAX socket transmissions happen.
+// NOTE: This and _flushTxQueue() are the ONLY places where IAX socket 
+// transmissions happen.
 void LineIAX2::_sendFrameToPeer(const uint8_t* b, unsigned len, 
     const sockaddr& peerAddr) {
 
     if (_iaxSockFd == -1)
         return;
 
+    // Anything that was queued goes first to keep things in order
+    _flushTxQueue();
+
     // Used for testing message recovery
     //if (++dropSendCount % 10 == 0) {
     //    _log.info("Dropped outbound packet");
@@ -2826,8 +3052,10 @@ void LineIAX2::_sendFrameToPeer(const uint8_t* b, unsigned len,
         b,
 #endif
         len, 0, &peerAddr, getIPAddrSize(peerAddr));
+    _socketStats.txCalls++;
 
     if (rc < 0) {
+        _socketStats.txDrops++;
 // No errno on Windows
 #ifdef _WIN32
         if (WSAGetLastError() == WSAENETUNREACH) {
@@ -2844,17 +3072,304 @@ void LineIAX2::_sendFrameToPeer(const uint8_t* b, unsigned len,
         }
     }
     else {
+        _socketStats.txPackets++;
+        _socketStats.txMaxBatch = std::max(_socketStats.txMaxBatch, 1U);
         _captureTxPacket(b, len, peerAddr);
     }
+}
+
+void LineIAX2::_queueFrameToPeer(const uint8_t* b, unsigned len, 
+    const sockaddr& peerAddr) {
+#ifdef _WIN32
+    _sendFrameToPeer(b, len, peerAddr);
+#else
+    if (_iaxSockFd == -1)
+        return;
+    assert(len <= MAX_MINI_FRAME_SIZE);
+#ifdef AMP_IO_URING
+    // The kernel might still be using the queue from the last flush. If
+    // it can't keep up then the frame is dropped, just like a full 
+    // socket buffer would.
+    if (_txInFlight > 0 && _ring != nullptr) {
+        _ring->dispatch();
+        if (_txInFlight > 0) {
+            _socketStats.txDrops++;
+            return;
+        }
+    }
+#endif
+    if (_txCount == TX_BATCH_SIZE) {
+        _socketStats.txBatchFull++;
+        _flushTxQueue();
+    }
+    const unsigned i = _txCount++;
+    memcpy(_txBuffers[i], b, len);
+    memcpy(&_txAddrs[i], &peerAddr, getIPAddrSize(peerAddr));
+    _txIovs[i].iov_base = _txBuffers[i];
+    _txIovs[i].iov_len = len;
+    memset(&_txMsgs[i], 0, sizeof(mmsghdr));
+    _txMsgs[i].msg_hdr.msg_name = &_txAddrs[i];
+    _txMsgs[i].msg_hdr.msg_namelen = getIPAddrSize(peerAddr);
+    _txMsgs[i].msg_hdr.msg_iov = &_txIovs[i];
+    _txMsgs[i].msg_hdr.msg_iovlen = 1;
+#endif
+}
 
+void LineIAX2::_flushTxQueue() {
 #ifndef _WIN32
-    // Take a look at the kernel buffer. Relevant for large-scale
-    // servers where the UDP buffers may overflow.
-    int bytes_in_buffer = 0;
-    if (ioctl(_iaxSockFd, SIOCOUTQ, &bytes_in_buffer) == -1) {
-    } else {
-        if ((unsigned)bytes_in_buffer > ((_txSocketBufferSize * 3) / 4))
-            _log.info("Socket transmit buffer >75 percent at %d", bytes_in_buffer);
+    if (_txCount == 0)
+        return;
+    const unsigned count = _txCount;
+    _txCount = 0;
+    if (_iaxSockFd == -1)
+        return;
+
+#ifdef AMP_IO_URING
+    if (_ring != nullptr) {
+        _flushTxQueueRing(count);
+        return;
+    }
+#endif
+
+    unsigned sent = 0;
+    while (sent < count) {
+        int rc = sendmmsg(_iaxSockFd, _txMsgs + sent, count - sent, 0);
+        _socketStats.txCalls++;
+        if (rc > 0) {
+            for (int i = 0; i < rc; i++) {
+                const unsigned k = sent + i;
+                _captureTxPacket(_txBuffers[k], _txMsgs[k].msg_len, 
+                    (const sockaddr&)_txAddrs[k]);
+            }
+            _socketStats.txPackets += rc;
+            _socketStats.txMaxBatch = std::max(_socketStats.txMaxBatch, (unsigned)rc);
+            sent += rc;
+        }
+        // The kernel buffer is full, nothing more is going to fit
+        else if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            _log.error("Socket transmit buffer full, %u dropped", count - sent);
+            _socketStats.txDrops += count - sent;
+            break;
+        }
+        // An error is reported against the first datagram (ex: that
+        // peer is unreachable) so it is skipped and the rest are tried
+        // again.
+        else {
+            char temp[64];
+            formatIPAddrAndPort((const sockaddr&)_txAddrs[sent], temp, 64);
+            if (errno == 101)
+                _log.error("Network is unreachable to %s", temp);
+            else
+                _log.error("Send error %d %s %d", errno, temp, 
+                    (int)_txIovs[sent].iov_len);
+            _socketStats.txDrops++;
+            sent++;
+        }
+    }
+#endif
+}
+
+void LineIAX2::attachRing(IoUring* ring) {
+#ifdef AMP_IO_URING
+    if (ring == _ring)
+        return;
+
+    if (_ring != nullptr) {
+        _cancelRingRx();
+        _ringRxBuffers.detach();
+        _ring->removeHandler(_ringHandlerId);
+        _ring = nullptr;
+        _ringHandlerId = -1;
+        _txInFlight = 0;
+    }
+
+    if (ring == nullptr)
+        return;
+
+    int handlerId = ring->addHandler(this);
+    if (handlerId < 0) {
+        _log.error("No room on the io_uring");
+        return;
+    }
+
+    // Each buffer gets the header, the peer address and the ancillary 
+    // data in front of the datagram.
+    const unsigned bufferSize = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage) +
+        SocketHealth::CONTROL_SIZE + RX_BUFFER_SIZE;
+    int rc = _ringRxBuffers.attach(*ring, RING_RX_BUFFERS, bufferSize);
+    if (rc < 0) {
+        _log.info("io_uring provided buffers aren't supported (%d), using recvmmsg()", rc);
+        ring->removeHandler(handlerId);
+        return;
+    }
+
+    _ring = ring;
+    _ringHandlerId = handlerId;
+    _ringRxUnsupported = false;
+    _armRingRx();
+#endif
+}
+
+#ifdef AMP_IO_URING
+
+void LineIAX2::_armRingRx() {
+
+    if (_ring == nullptr || _ringRxArmed || _ringRxUnsupported || _iaxSockFd == -1)
+        return;
+
+    // Only the lengths matter, they reserve space in each buffer
+    memset(&_ringRxMsg, 0, sizeof(_ringRxMsg));
+    _ringRxMsg.msg_namelen = sizeof(sockaddr_storage);
+    _ringRxMsg.msg_controllen = SocketHealth::CONTROL_SIZE;
+
+    io_uring_sqe* sqe = _ring->getSqe(_ringHandlerId, RING_RX | ++_ringRxGen);
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = _iaxSockFd;
+    sqe->addr = (uint64_t)&_ringRxMsg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = _ringRxBuffers.getGroupId();
+    _ring->submit();
+    _ringRxArmed = true;
+}
+
+void LineIAX2::_cancelRingRx() {
+    if (_ring == nullptr)
+        return;
+    if (_ringRxArmed) {
+        _ring->cancel(_ringHandlerId, RING_RX | _ringRxGen);
+        _ringRxArmed = false;
+    }
+    // Anything still on the way belongs to the old receive
+    _ringRxGen++;
+    for (unsigned i = 0; i < _ringRxPendingCount; i++)
+        _ringRxBuffers.recycle(_ringRxPending[i].bufferId);
+    _ringRxPendingCount = 0;
+}
+
+void LineIAX2::_processRingRx() {
+
+    // NOTE: More can be added while this is running (i.e. if sending
+    // something causes the ring to be dispatched), so the count is 
+    // checked every time.
+    unsigned i = 0;
+    for (; i < _ringRxPendingCount; i++) {
+        const RingRx rx = _ringRxPending[i];
+        uint8_t* buf = _ringRxBuffers.getBuffer(rx.bufferId);
+        const io_uring_recvmsg_out& out = *(const io_uring_recvmsg_out*)buf;
+        const uint8_t* name = buf + sizeof(io_uring_recvmsg_out);
+        uint8_t* control = buf + sizeof(io_uring_recvmsg_out) + _ringRxMsg.msg_namelen;
+        const uint8_t* payload = control + _ringRxMsg.msg_controllen;
+
+        if (rx.len >= sizeof(io_uring_recvmsg_out) && !(out.flags & MSG_TRUNC)) {
+            msghdr hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_control = control;
+            hdr.msg_controllen = out.controllen;
+            _socketHealth.consumeControl(hdr);
+            const sockaddr& peerAddr = (const sockaddr&)*name;
+            // Capture/trace
+            _captureRxPacket(payload, out.payloadlen, peerAddr);
+            // The actual processing of the received packet
+            _processReceivedIAXPacket(payload, out.payloadlen, peerAddr, _clock.time());
+        }
+        _ringRxBuffers.recycle(rx.bufferId);
+    }
+    _ringRxPendingCount = 0;
+
+    if (i > 0) {
+        _socketStats.rxPackets += i;
+        _socketStats.rxMaxBatch = std::max(_socketStats.rxMaxBatch, i);
+    }
+}
+
+void LineIAX2::_flushTxQueueRing(unsigned count) {
+
+    unsigned queued = 0;
+    for (; queued < count; queued++) {
+        io_uring_sqe* sqe = _ring->getSqe(_ringHandlerId, RING_TX | queued);
+        if (sqe == nullptr) {
+            _log.error("io_uring is full, %u dropped", count - queued);
+            _socketStats.txDrops += count - queued;
+            break;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = _iaxSockFd;
+        sqe->addr = (uint64_t)&_txMsgs[queued].msg_hdr;
+        sqe->len = 1;
+    }
+    _txInFlight = queued;
+
+    int rc = _ring->submit();
+    if (rc < 0) 
+        _log.error("io_uring submit failed (%d)", rc);
+    _socketStats.txCalls++;
+    _socketStats.txMaxBatch = std::max(_socketStats.txMaxBatch, queued);
+
+    // Datagram sends are normally finished by the time the submit 
+    // returns, so the queue is usually free again right away.
+    _ring->dispatch();
+}
+
+#endif
+
+void LineIAX2::ringComplete(uint64_t data, int res, uint32_t flags) {
+#ifdef AMP_IO_URING
+    const uint64_t kind = data & ~0xffffffffULL;
+    const uint32_t n = data & 0xffffffff;
+
+    if (kind == RING_TX) {
+        if (_txInFlight > 0)
+            _txInFlight--;
+        if (n >= TX_BATCH_SIZE)
+            return;
+        if (res < 0) {
+            char temp[64];
+            formatIPAddrAndPort((const sockaddr&)_txAddrs[n], temp, 64);
+            if (res == -ENETUNREACH)
+                _log.error("Network is unreachable to %s", temp);
+            else
+                _log.error("Send error %d %s %d", -res, temp, (int)_txIovs[n].iov_len);
+            _socketStats.txDrops++;
+        } else {
+            _socketStats.txPackets++;
+            _captureTxPacket(_txBuffers[n], res, (const sockaddr&)_txAddrs[n]);
+        }
+    }
+    else if (kind == RING_RX) {
+        const bool hasBuffer = (flags & IORING_CQE_F_BUFFER) != 0;
+        const uint16_t bufferId = flags >> IORING_CQE_BUFFER_SHIFT;
+        // Left over from an earlier receive
+        if (n != _ringRxGen) {
+            if (hasBuffer)
+                _ringRxBuffers.recycle(bufferId);
+            return;
+        }
+        // The receive has stopped, it gets armed again in run2()
+        if (!(flags & IORING_CQE_F_MORE))
+            _ringRxArmed = false;
+        if (res < 0) {
+            if (hasBuffer)
+                _ringRxBuffers.recycle(bufferId);
+            if (res == -EINVAL || res == -EOPNOTSUPP) {
+                _log.info("Multishot receive isn't supported, using recvmmsg()");
+                _ringRxUnsupported = true;
+            }
+            // Running out of buffers just means that run2() is behind
+            else if (res != -ENOBUFS && res != -ECANCELED) {
+                _log.error("IAX2 read error %d", res);
+            }
+            return;
+        }
+        if (hasBuffer) {
+            if (_ringRxPendingCount < RING_RX_BUFFERS)
+                _ringRxPending[_ringRxPendingCount++] = { bufferId, (unsigned)res };
+            else
+                _ringRxBuffers.recycle(bufferId);
+        }
     }
 #endif
 }
@@ -2933,7 +3448,15 @@ int LineIAX2::_sendDNSRequestTXT(uint16_t requestId, const char* name) {
     return _sendDNSRequest(dnsPacket, dnsPacketLen);
 }
 
+void LineIAX2::quarterSecTick() {
+    _socketHealth.sample();
+}
+
 void LineIAX2::oneSecTick() { 
+
+    if (_iaxSockFd != -1) 
+        _publishNetworkStatus();
+
     _visitActiveCallsIf(
         // This function will be called for each active call in the system.
         // (Even the terminated ones)
@@ -2964,8 +3487,33 @@ void LineIAX2::oneSecTick() {
     );
 }
 
+void LineIAX2::_publishNetworkStatus() {
+    PayloadNetworkStatus status;
+    status.txBufferSize = _socketHealth.getTxBufferSize();
+    status.txQueuedMax = _socketHealth.getTxQueuedMax();
+    status.rxBufferSize = _socketHealth.getRxBufferSize();
+    status.rxQueuedMax = _socketHealth.getRxQueuedMax();
+    status.rxDrops = _socketHealth.getRxDrops();
+    status.txDrops = _socketStats.txDrops;
+    status.rxPackets = _socketStats.rxPackets;
+    status.txPackets = _socketStats.txPackets;
+    MessageWrapper msg(Message::Type::SIGNAL, Message::SignalType::NETWORK_STATUS, 
+        sizeof(status), (const uint8_t*)&status, 0, _clock.time());
+    msg.setSource(_busId, Message::UNKNOWN_CALL_ID);
+    msg.setDest(_destLineId, Message::UNKNOWN_CALL_ID);
+    _bus.consume(msg);
+    // The peaks are per reporting interval
+    _socketHealth.resetPeaks();
+}
+
 void LineIAX2::tenSecTick() {
 
+    if (_trace)
+        _log.info("IAX2 socket rx %u calls/%u packets (max %u) tx %u calls/%u packets (max %u) drops %u full %u",
+            _socketStats.rxCalls, _socketStats.rxPackets, _socketStats.rxMaxBatch,
+            _socketStats.txCalls, _socketStats.txPackets, _socketStats.txMaxBatch,
+            _socketStats.txDrops, _socketStats.txBatchFull);
+
     _visitActiveCallsIf(
         [line = this](Call& call) {
             call.tenSecTick(line->_log, line->_clock, *line);
@@ -3155,6 +3703,8 @@ LineIAX2::Call::Call()
 
 void LineIAX2::Call::reset() {
 
+    if (line)
+        line->_unindexCall(*this);
     resetStats();
 
     active = false;
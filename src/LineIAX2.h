@@ -20,6 +20,8 @@
 #include <winsock2.h>
 #else
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #endif 
 
 #include <functional>
@@ -35,6 +37,9 @@
 #include "IAX2FrameFull.h"
 #include "Message.h"
 #include "MessageConsumer.h"
+#include "SocketHealth.h"
+#include "CallIndex.h"
+#include "IoUring.h"
 
 namespace kc1fsz {
 
@@ -84,7 +89,7 @@ public:
  * An implementation of the Line interface that communicates with
  * IAX2 stations via UDP. 
  */
-class LineIAX2 : public Line {
+class LineIAX2 : public Line, public IoUring::Handler {
 public:
 
     class Call;
@@ -165,6 +170,22 @@ public:
      */
     void setAuthenticationChecked(bool ac) { _authenticationChecked = ac; }
 
+    /**
+     * Makes this line one of several receive shards that share the 
+     * same UDP port (SO_REUSEPORT), normally on separate threads (see 
+     * LineIAX2Shards). Must be called before open(), and the shards 
+     * must be opened in index order.
+     *
+     * @param firstShardBusId The bus ID of shard 0, the others follow 
+     * in sequence.
+     * @param steer Installs a CBPF program on the port so that a peer 
+     * always lands on shard (IP address mod count). Without this the 
+     * kernel hashes on the address and port, which keeps a peer on 
+     * one shard but doesn't tell us which one, so outbound calls 
+     * can't be handed to the right shard.
+     */
+    void setShard(unsigned index, unsigned count, unsigned firstShardBusId, bool steer);
+
     /**
      * Opens the network connection for in/out traffic for this line.
      *  
@@ -226,6 +247,33 @@ public:
      */
     fixedstring getRemoveTalkerName(unsigned localCallId);
 
+    /**
+     * Counters for the IAX2 socket I/O. These are used to tune the batch 
+     * sizes. In io_uring mode the receives don't take any system calls
+     * and a transmit call is the io_uring_enter() that submits a batch.
+     */
+    struct SocketStats {
+        // System calls that returned data (recvmmsg()/recvfrom())
+        unsigned rxCalls = 0;
+        unsigned rxPackets = 0;
+        // The most datagrams returned by one call
+        unsigned rxMaxBatch = 0;
+        // System calls made to send (sendmmsg()/sendto())
+        unsigned txCalls = 0;
+        unsigned txPackets = 0;
+        // The most datagrams sent by one call
+        unsigned txMaxBatch = 0;
+        // Datagrams that the kernel wouldn't take
+        unsigned txDrops = 0;
+        // The number of times the transmit batch filled up and had to be
+        // sent before the end of the tick.
+        unsigned txBatchFull = 0;
+    };
+
+    const SocketStats& getSocketStats() const { return _socketStats; }
+
+    void resetSocketStats() { _socketStats = SocketStats(); }
+
     // ----- Line/MessageConsumer-----------------------------------------------------
 
     virtual void consume(const Message& m);
@@ -234,6 +282,7 @@ public:
 
     virtual bool run2();
     virtual void audioRateTick(uint32_t tickTimeMs);
+    virtual void quarterSecTick();
     virtual void oneSecTick();
     virtual void tenSecTick();
 
@@ -243,6 +292,19 @@ public:
      */
     virtual int getPolls(pollfd* fds, unsigned fdsCapacity);
 
+    /**
+     * Moves the IAX2 socket I/O onto the event loop's io_uring: a 
+     * multishot receive into a ring of provided buffers stays armed on 
+     * the socket and the queued voice frames are sent as a batch of 
+     * submission entries. If the kernel doesn't support any of this the 
+     * line stays on recvmmsg()/sendmmsg().
+     */
+    virtual void attachRing(IoUring* ring);
+
+    // ----- IoUring::Handler ------------------------------------------------
+
+    virtual void ringComplete(uint64_t data, int res, uint32_t flags);
+
     // There is one instance of this call for each active call on the Channel.
     // This is where all of the call-specific state should live.
 
@@ -322,6 +384,11 @@ public:
         bool isRegistered = false;
         unsigned localCallId = 0;
         unsigned remoteCallId = 0;
+        // The keys that this call is currently stored under in the 
+        // lookup indices (see LineIAX2::_indexCall())
+        bool indexed = false;
+        unsigned indexedLocalCallId = 0;
+        uint64_t indexedMiniKey = 0;
         uint32_t localStartMs = 0;
         // Used by dispenseElapsed() function. 
         uint32_t lastElapsedMsDispensed = 0;
@@ -472,8 +539,14 @@ private:
     int _iaxListenPort = 0;
     // The UDP socket on which IAX messages are received/sent
     int _iaxSockFd = -1;
-    // The size of the transmit buffer as reported by the kernel
-    unsigned _txSocketBufferSize = 0;
+    // Watches the kernel buffers of the IAX socket
+    SocketHealth _socketHealth;
+
+    // Sharded mode (see setShard())
+    unsigned _shardIndex = 0;
+    unsigned _shardCount = 1;
+    unsigned _firstShardBusId = 0;
+    bool _shardSteering = false;
 
     // Used to assign unique IDs to the calls.  Starting at 100
     // because call ID 1 may have special significance on 
@@ -483,6 +556,12 @@ private:
     Call* const _calls;
     const unsigned _maxCalls;
 
+    // Finds the call for an inbound full frame (by local call number)
+    CallIndex _fullFrameIndex;
+    // Finds the call for an inbound mini frame (by peer address and 
+    // remote call number, see _miniFrameKey())
+    CallIndex _miniFrameIndex;
+
     // Enables detailed network tracing
     bool _trace = false;
     // The UDP socket with which DNS calls are made
@@ -508,6 +587,59 @@ private:
     bool _captureEnabled = false;
     std::ofstream _captureFile;
 
+    // The largest mini frame (a frame of SLIN_16K plus the header)
+    static const unsigned MAX_MINI_FRAME_SIZE = 160 * 2 * 2 + 4;
+
+    SocketStats _socketStats;
+
+#ifndef _WIN32
+    // Receive space for recvmmsg(). The socket is drained in batches of 
+    // up to RX_BATCH_SIZE datagrams.
+    static const unsigned RX_BATCH_SIZE = 16;
+    static const unsigned RX_BUFFER_SIZE = 2048;
+    uint8_t _rxBuffers[RX_BATCH_SIZE][RX_BUFFER_SIZE];
+    sockaddr_storage _rxAddrs[RX_BATCH_SIZE];
+    iovec _rxIovs[RX_BATCH_SIZE];
+    mmsghdr _rxMsgs[RX_BATCH_SIZE];
+    // Ancillary data (the kernel drop counter)
+    uint8_t _rxControl[RX_BATCH_SIZE][SocketHealth::CONTROL_SIZE];
+
+    // The voice frames that are waiting for the next sendmmsg(). This 
+    // is flushed at the end of the audio tick, or sooner if it fills up.
+    static const unsigned TX_BATCH_SIZE = 64;
+    uint8_t _txBuffers[TX_BATCH_SIZE][MAX_MINI_FRAME_SIZE];
+    sockaddr_storage _txAddrs[TX_BATCH_SIZE];
+    iovec _txIovs[TX_BATCH_SIZE];
+    mmsghdr _txMsgs[TX_BATCH_SIZE];
+    unsigned _txCount = 0;
+
+    // io_uring mode (see attachRing())
+    static const unsigned RING_RX_BUFFERS = 256;
+    static const uint64_t RING_RX = 1ULL << 32;
+    static const uint64_t RING_TX = 2ULL << 32;
+    IoUring* _ring = nullptr;
+    int _ringHandlerId = -1;
+    IoUring::BufferRing _ringRxBuffers;
+    // Tells the kernel how to lay out the provided buffers
+    msghdr _ringRxMsg;
+    bool _ringRxArmed = false;
+    // Set if the kernel turns down the multishot receive
+    bool _ringRxUnsupported = false;
+    // Changed whenever the receive is armed or cancelled so that late
+    // completions can be recognized
+    uint32_t _ringRxGen = 0;
+    // Received datagrams that are waiting for run2()
+    struct RingRx {
+        uint16_t bufferId;
+        unsigned len;
+    };
+    RingRx _ringRxPending[RING_RX_BUFFERS];
+    unsigned _ringRxPendingCount = 0;
+    // The number of queued frames that the kernel hasn't finished 
+    // sending. The transmit queue can't be touched until this is zero.
+    unsigned _txInFlight = 0;
+#endif
+
     /**
      * Drops all calls that match the predicate.
      * @returns The number of calls dropped
@@ -532,6 +664,28 @@ private:
     void _processFullFrameInCall(const IAX2FrameFull& frame, Call& call, 
         uint32_t stampMs);
 
+    /**
+     * Puts the call into the lookup indices under its current call 
+     * numbers and peer address. Needs to be called any time that these 
+     * change.
+     */
+    void _indexCall(Call& call);
+    void _unindexCall(Call& call);
+    static uint64_t _miniFrameKey(const sockaddr& peerAddr, unsigned remoteCallId);
+
+    /**
+     * @returns The shard that the kernel will deliver the peer's traffic
+     * to when steering is enabled.
+     */
+    unsigned _shardOf(const sockaddr& peerAddr) const;
+    int _attachShardSteering(int sockFd);
+
+    /**
+     * Passes an outbound call to the shard that will receive the peer's
+     * traffic. The call is released here.
+     */
+    void _handOffCall(Call& call, unsigned shard);
+
     void _sendACK(uint32_t timeStamp, Call& call); 
     void _sendREJECT(uint16_t destCall, const sockaddr& peerAddr, const char* cause);
 
@@ -568,6 +722,28 @@ private:
     void _sendFrameToPeer(const IAX2FrameFull& frame, const sockaddr& peerAddr);
     void _sendFrameToPeer(const uint8_t* frame, unsigned frameSize, const sockaddr& peerAddr);
 
+    /**
+     * Holds a voice frame so that all of the frames from an audio tick can 
+     * be sent with one system call (see _flushTxQueue()). Frames go out in 
+     * the order they were sent/queued.
+     */
+    void _queueFrameToPeer(const uint8_t* frame, unsigned frameSize, const sockaddr& peerAddr);
+
+    /**
+     * Sends everything that has been queued by _queueFrameToPeer().
+     */
+    void _flushTxQueue();
+    void _flushTxQueueRing(unsigned count);
+
+    void _armRingRx();
+    void _cancelRingRx();
+    void _processRingRx();
+
+    /**
+     * Sends the socket counters to the destination line.
+     */
+    void _publishNetworkStatus();
+
     int _sendDNSRequestSRV(uint16_t requestId, const char* name);
     int _sendDNSRequestA(uint16_t requestId, const char* name);
     int _sendDNSRequestTXT(uint16_t requestId, const char* name);
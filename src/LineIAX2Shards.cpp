@@ -0,0 +1,260 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include <cstdio>
+#include <cerrno>
+
+#include "kc1fsz-tools/Log.h"
+
+#include "EventLoop.h"
+#include "MultiRouter.h"
+#include "ThreadUtil.h"
+#include "LineIAX2Shards.h"
+
+namespace kc1fsz {
+
+// ===== LineIAX2Shards::Waker =================================================
+
+LineIAX2Shards::Waker::Waker() {
+    _fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+LineIAX2Shards::Waker::~Waker() {
+    if (_fd != -1)
+        ::close(_fd);
+}
+
+void LineIAX2Shards::Waker::wake() {
+    if (!_pending.exchange(true)) {
+        uint64_t one = 1;
+        if (write(_fd, &one, sizeof(one)) < 0) { 
+            // Only fails if the counter is saturated, which still wakes
+        }
+    }
+}
+
+void LineIAX2Shards::Waker::clear() {
+    // Anything queued after this point will signal again
+    _pending.store(false);
+    uint64_t count;
+    if (read(_fd, &count, sizeof(count)) < 0) {
+        // Nothing was pending
+    }
+}
+
+// ===== LineIAX2Shards::ShardOutput ===========================================
+
+void LineIAX2Shards::ShardOutput::consume(const Message& msg) {
+    if (queue.push(msg))
+        _group._outputWaker.wake();
+    else 
+        drops++;
+}
+
+// ===== LineIAX2Shards::ShardLog ==============================================
+
+void LineIAX2Shards::ShardLog::_out(const char* sev, const char*, const char* msg) {
+    Line line;
+    // The severity is the first letter ("E" for an error)
+    line.error = (sev[0] == 'E' || sev[0] == 'e');
+    snprintf(line.msg, sizeof(line.msg), "%s", msg);
+    if (queue.push(line))
+        _group._outputWaker.wake();
+    else 
+        drops++;
+}
+
+// ===== LineIAX2Shards::Shard =================================================
+
+LineIAX2Shards::Shard::Shard(LineIAX2Shards& group, unsigned busId,
+    NumberAuthorizer* destAuthorizer, NumberAuthorizer* sourceAuthorizer, 
+    LocalRegistry* locReg, LocalAuthenticator* locAuth,
+    unsigned destLineId, const char* publicUser, unsigned callCount)
+:   output(group),
+    log(group),
+    calls(new LineIAX2::Call[callCount]),
+    line(log, log, group._clock, busId, output, 
+        destAuthorizer, sourceAuthorizer, locReg, locAuth, destLineId, 
+        publicUser, calls.get(), callCount) {
+}
+
+void LineIAX2Shards::Shard::consume(const Message& msg) {
+    if (input.push(msg))
+        inputWaker.wake();
+    else 
+        inputDrops++;
+}
+
+int LineIAX2Shards::Shard::getPolls(pollfd* fds, unsigned fdsCapacity) {
+    if (fdsCapacity < 1)
+        return -1;
+    fds[0].fd = inputWaker.getFd();
+    fds[0].events = POLLIN;
+    return 1;
+}
+
+bool LineIAX2Shards::Shard::run2() {
+    inputWaker.clear();
+    bool worked = false;
+    MessageCarrier msg;
+    while (input.pop(msg)) {
+        line.consume(msg);
+        worked = true;
+    }
+    return worked;
+}
+
+// ===== LineIAX2Shards ========================================================
+
+LineIAX2Shards::LineIAX2Shards(Log& log, Clock& clock, unsigned shardCount, 
+    unsigned busId, unsigned firstShardBusId, MessageConsumer& bus,
+    NumberAuthorizer* destAuthorizer, NumberAuthorizer* sourceAuthorizer, 
+    LocalRegistry* locReg, LocalAuthenticator* locAuth,
+    unsigned destLineId, const char* publicUser, unsigned callsPerShard) 
+:   _log(log),
+    _clock(clock),
+    _busId(busId),
+    _firstShardBusId(firstShardBusId),
+    _bus(bus) {
+    assert(shardCount > 0);
+    for (unsigned i = 0; i < shardCount; i++)
+        _shards.push_back(std::make_unique<Shard>(*this, firstShardBusId + i,
+            destAuthorizer, sourceAuthorizer, locReg, locAuth, destLineId, 
+            publicUser, callsPerShard));
+}
+
+LineIAX2Shards::~LineIAX2Shards() {
+    stop();
+}
+
+void LineIAX2Shards::addRoutes(MultiRouter& router) {
+    router.addRoute(this, _busId);
+    for (unsigned i = 0; i < _shards.size(); i++)
+        router.addRoute(_shards[i].get(), _firstShardBusId + i);
+}
+
+int LineIAX2Shards::start(short addrFamily, int listenPort, bool steer, bool useRing) {
+
+    assert(!_running);
+
+    // The order matters here, the steering program selects the shard by 
+    // its position in the SO_REUSEPORT group, which is the bind order.
+    for (unsigned i = 0; i < _shards.size(); i++) {
+        LineIAX2& line = _shards[i]->line;
+        line.setShard(i, _shards.size(), _firstShardBusId, steer);
+        int rc = line.open(addrFamily, listenPort);
+        if (rc != 0) {
+            _log.error("Unable to open IAX2 shard %u (%d)", i, rc);
+            for (unsigned j = 0; j < i; j++)
+                _shards[j]->line.close();
+            _drainLogs();
+            return rc;
+        }
+    }
+    // Anything logged during the setup
+    _drainLogs();
+
+    _useRing = useRing;
+    _running = true;
+    for (unsigned i = 0; i < _shards.size(); i++)
+        _shards[i]->thread = std::thread(&LineIAX2Shards::_shardLoop, this, i);
+
+    _log.info("Started %u IAX2 shards on port %d", (unsigned)_shards.size(), listenPort);
+    return 0;
+}
+
+void LineIAX2Shards::stop() {
+    if (!_running)
+        return;
+    _running = false;
+    for (auto& shard : _shards) {
+        // Make sure the loop notices
+        shard->inputWaker.wake();
+        shard->thread.join();
+        shard->line.close();
+    }
+    _drainLogs();
+}
+
+void LineIAX2Shards::_shardLoop(unsigned i) {
+
+    char name[16];
+    snprintf(name, sizeof(name), "iax2-shard-%u", i);
+    amp::setThreadName(name);
+
+    Shard& shard = *_shards[i];
+    Runnable2* tasks[] = { &shard, &shard.line };
+    EventLoop::run(shard.log, _clock, 0, 0, tasks, std::size(tasks), 
+        [this](Log&, Clock&) { return _running.load(); }, false, _useRing);
+}
+
+void LineIAX2Shards::consume(const Message& msg) {
+    if (msg.isSignal(Message::SignalType::CALL_NODE)) {
+        _shards[0]->consume(msg);
+    } else {
+        for (auto& shard : _shards)
+            shard->consume(msg);
+    }
+}
+
+int LineIAX2Shards::getPolls(pollfd* fds, unsigned fdsCapacity) {
+    if (fdsCapacity < 1)
+        return -1;
+    fds[0].fd = _outputWaker.getFd();
+    fds[0].events = POLLIN;
+    return 1;
+}
+
+void LineIAX2Shards::_drainLogs() {
+    ShardLog::Line line;
+    for (unsigned i = 0; i < _shards.size(); i++) {
+        while (_shards[i]->log.queue.pop(line)) {
+            if (line.error)
+                _log.error("Shard %u: %s", i, line.msg);
+            else 
+                _log.info("Shard %u: %s", i, line.msg);
+        }
+    }
+}
+
+bool LineIAX2Shards::run2() {
+    _outputWaker.clear();
+    _drainLogs();
+    bool worked = false;
+    MessageCarrier msg;
+    for (auto& shard : _shards) {
+        while (shard->output.queue.pop(msg)) {
+            _bus.consume(msg);
+            worked = true;
+        }
+    }
+    return worked;
+}
+
+void LineIAX2Shards::tenSecTick() {
+    for (unsigned i = 0; i < _shards.size(); i++) {
+        const Shard& shard = *_shards[i];
+        if (shard.inputDrops || shard.output.drops || shard.log.drops)
+            _log.info("IAX2 shard %u queue drops in %u out %u log %u", i, 
+                shard.inputDrops, shard.output.drops.load(), shard.log.drops.load());
+    }
+}
+
+}
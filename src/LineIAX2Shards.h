@@ -0,0 +1,229 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+
+#include "Message.h"
+#include "MessageConsumer.h"
+#include "Runnable2.h"
+#include "SpscQueue.h"
+#include "LineIAX2.h"
+
+namespace kc1fsz {
+
+class MultiRouter;
+
+/**
+ * Runs an IAX2 line as several receive shards that share one UDP port 
+ * (SO_REUSEPORT), each with its own LineIAX2 and its own thread/EventLoop,
+ * so the inbound packet processing can use more than one core.
+ *
+ * Messages pass between the shards and the thread that runs this object
+ * (i.e. the one with the Bridge) through lock-free queues. An eventfd 
+ * wakes the other side up when something is queued.
+ *
+ * Setup:
+ * 1. Construct and configure each shard (getShard()).
+ * 2. addRoutes() on the main router.
+ * 3. start()
+ * 4. Run this object on the main EventLoop.
+ *
+ * Each shard logs through its own queue and the lines are passed on to
+ * the Log by the thread that runs this object, so the Log doesn't need 
+ * to be thread-safe.
+ *
+ * IMPORTANT: The authorizer/registry interfaces are shared by all of the
+ * shards so they must be safe to use from several threads.
+ *
+ * NOTE: Linux only.
+ */
+class LineIAX2Shards : public MessageConsumer, public Runnable2 {
+public:
+
+    /**
+     * @param busId The ID that the rest of the system uses to address
+     * the line as a whole. 
+     * @param firstShardBusId The bus ID of shard 0, the others follow
+     * in sequence. These are the IDs that the calls are reported under.
+     * @param bus Where the messages from the shards are delivered.
+     */
+    LineIAX2Shards(Log& log, Clock& clock, unsigned shardCount, 
+        unsigned busId, unsigned firstShardBusId, MessageConsumer& bus,
+        NumberAuthorizer* destAuthorizer, NumberAuthorizer* sourceAuthorizer, 
+        LocalRegistry* locReg, LocalAuthenticator* locAuth,
+        unsigned destLineId, const char* publicUser, unsigned callsPerShard);
+    ~LineIAX2Shards();
+
+    unsigned getShardCount() const { return _shards.size(); }
+
+    /**
+     * Used for configuration. NOT safe to use after start().
+     */
+    LineIAX2& getShard(unsigned i) { return _shards.at(i)->line; }
+
+    /**
+     * Adds the routes for the line and for each shard.
+     */
+    void addRoutes(MultiRouter& router);
+
+    /**
+     * Opens all of the shards on the same port and starts their threads.
+     *
+     * @param steer See LineIAX2::setShard(). Needed for outbound calls.
+     * @param useRing Run the shard event loops on io_uring where it is
+     * supported (see EventLoop::run()).
+     * @returns 0 on success.
+     */
+    int start(short addrFamily, int listenPort, bool steer, bool useRing = false);
+
+    /**
+     * Stops and joins the shard threads.
+     */
+    void stop();
+
+    // ----- MessageConsumer --------------------------------------------------
+
+    /**
+     * Messages addressed to the line as a whole. Outbound calls go to
+     * shard 0 (which hands them on to the right shard) and everything 
+     * else goes to all of the shards.
+     */
+    virtual void consume(const Message& msg);
+
+    // ----- Runnable2 --------------------------------------------------------
+
+    virtual int getPolls(pollfd* fds, unsigned fdsCapacity);
+
+    /**
+     * Delivers the messages from the shards.
+     */
+    virtual bool run2();
+
+    virtual void tenSecTick();
+
+private:
+
+    static const unsigned QUEUE_SIZE = 1024;
+    static const unsigned LOG_QUEUE_SIZE = 256;
+    static const unsigned LOG_LINE_SIZE = 256;
+
+    /**
+     * One of these on each side of a queue. The wakeup is only signaled
+     * if the other side hasn't already been woken up, so a burst of 
+     * messages costs one write().
+     */
+    class Waker {
+    public:
+        Waker();
+        ~Waker();
+        void wake();
+        /**
+         * Called by the woken side before it looks at the queue.
+         */
+        void clear();
+        int getFd() const { return _fd; }
+    private:
+        int _fd = -1;
+        std::atomic<bool> _pending = false;
+    };
+
+    class Shard;
+
+    /**
+     * The Log given to a shard's LineIAX2 and EventLoop. Queues the lines
+     * for the main thread. Before start() and after stop() the producer
+     * is the main thread, in between it is the shard's thread.
+     */
+    class ShardLog : public Log {
+    public:
+        ShardLog(LineIAX2Shards& group) : _group(group) { }
+        struct Line {
+            bool error = false;
+            char msg[LOG_LINE_SIZE];
+        };
+        SpscQueue<Line> queue = SpscQueue<Line>(LOG_QUEUE_SIZE);
+        std::atomic<unsigned> drops = 0;
+    protected:
+        virtual void _out(const char* sev, const char* dt, const char* msg);
+    private:
+        LineIAX2Shards& _group;
+    };
+
+    /**
+     * The bus given to a shard's LineIAX2. Queues everything for 
+     * the main thread.
+     */
+    class ShardOutput : public MessageConsumer {
+    public:
+        ShardOutput(LineIAX2Shards& group) : _group(group) { }
+        virtual void consume(const Message& msg);
+        SpscQueue<MessageCarrier> queue = SpscQueue<MessageCarrier>(QUEUE_SIZE);
+        std::atomic<unsigned> drops = 0;
+    private:
+        LineIAX2Shards& _group;
+    };
+
+    /**
+     * The route to the shard from the main thread (MessageConsumer), and 
+     * the task on the shard's thread that passes the messages along to 
+     * its LineIAX2 (Runnable2).
+     */
+    class Shard : public MessageConsumer, public Runnable2 {
+    public:
+        Shard(LineIAX2Shards& group, unsigned busId, 
+            NumberAuthorizer* destAuthorizer, NumberAuthorizer* sourceAuthorizer, 
+            LocalRegistry* locReg, LocalAuthenticator* locAuth,
+            unsigned destLineId, const char* publicUser, unsigned callCount);
+        virtual void consume(const Message& msg);
+        virtual int getPolls(pollfd* fds, unsigned fdsCapacity);
+        virtual bool run2();
+
+        ShardOutput output;
+        ShardLog log;
+        std::unique_ptr<LineIAX2::Call[]> calls;
+        LineIAX2 line;
+        SpscQueue<MessageCarrier> input = SpscQueue<MessageCarrier>(QUEUE_SIZE);
+        Waker inputWaker;
+        unsigned inputDrops = 0;
+        std::thread thread;
+    };
+
+    void _shardLoop(unsigned i);
+
+    /**
+     * Passes the lines that the shards have logged on to the Log.
+     */
+    void _drainLogs();
+
+    Log& _log;
+    Clock& _clock;
+    const unsigned _busId;
+    const unsigned _firstShardBusId;
+    MessageConsumer& _bus;
+
+    // Wakes the main thread up when a shard has queued something
+    Waker _outputWaker;
+    std::atomic<bool> _running = false;
+    bool _useRing = false;
+    std::vector<std::unique_ptr<Shard>> _shards;
+};
+
+}
@@ -30,61 +30,6 @@ using namespace std;
 
 namespace kc1fsz {
 
-/**
- * Floating-point complex number
- */
-struct cf32 {
-
-    float r = 0;
-    float i = 0;
-
-    cf32() : r(0), i(0) {}
-    cf32(float ar, float ai) : r(ar), i(ai) {}
-    cf32(const cf32& other) : r(other.r), i(other.i) { }
-
-    float mag() const {
-        return std::sqrt(magSquared());
-    }
-    float magSquared() const {
-        return r * r + i * i;
-    }
-    /**
-     * @returns Phase angle in radians.
-     */
-    float phase() const {
-        return std::atan2(i, r);
-    }
-    /**
-     * @returns this number plus b.
-     */
-    cf32 add(cf32 b) const {
-        return cf32(r + b.r, i + b.i);
-    }
-    /**
-     * @returns this number times b.
-     */
-    cf32 mult(cf32 b) const {
-        return cf32(r * b.r - i * b.i, r * b.i + i * b.r);
-    }
-};
-
-/**
- * This is an out-of-the-book implementation to use for sanity checking.
-*/
-static void simpleDFT(cf32* in, cf32* out, uint16_t n) {
-    for (uint16_t k = 0; k < n; k++) { 
-        float sumreal = 0;
-        float sumimag = 0;
-        for (uint16_t t = 0; t < n; t++) {  // For each input element
-            float angle = 2.0 * PI * (float)t * (float)k / (float)n;
-            sumreal +=  in[t].r * std::cos(angle) + in[t].i * std::sin(angle);
-            sumimag += -in[t].r * std::sin(angle) + in[t].i * std::cos(angle);
-        }
-        out[k].r = sumreal / (float)n;
-        out[k].i = sumimag / (float)n;
-    }
-}
-
 // A very nice tool for testing/building:
 // https://naturalstatenetwork.com/atb.html
 
@@ -165,18 +110,21 @@ LineRadio::LineRadio(Log& log, Clock& clock, MessageConsumer& captureConsumer,
     _networkDestLineId(networkDestLineId),
     _startTimeMs(_clock.time()),
     _dtmfDetector(clock, BLOCK_SIZE_8K / 2),
-    _tonePhi(0),
-    _injectTonePhi(0),
+    _spectrum(8000, 2048, 4),
     _playState(&_clock, PlayState::STATE_IDLE) {
 
     _resampler.setRates(48000, 8000);
+    _spectrumResampler.setRates(48000, 8000);
 
-    _injectToneOmega = 2.0f * 3.1415926f * 400.0f / 48000.0f;
+    // 5ms ramps avoid clicks between the steps of a courtesy tone
+    _tone.setRampSamples(AUDIO_RATE / 200);
+    _tone.setAmplitude(dbvToPeak(-10), true);
 
-    _plToneOmega = 2.0f * 3.1415926f * 88.5f / 48000.0f;
-    _plTonePhi = 0;
-    _plTonePhiAdjust = 0;
-    _plToneAmp = 0;
+    // -10dBFS
+    _injectTone.setFreq(400);
+    _injectTone.setAmplitude(0.31, true);
+
+    _plTone.setFreq(88.5);
     _plToneEnabled = false;
     _chickenDelayMs = 0;
 }
@@ -190,10 +138,6 @@ void LineRadio::resetStatistics() {
     _playPcmValueMax = 0;
     _playPcmValueSum = 0;
     _playPcmValueCount = 0;
-    _fftMaxMag = 0;
-    _fftMaxFreq = 0;
-    // Prepare for another capture
-    _fftTrigger = true;
 }
 
 void LineRadio::setCaptureDelay(unsigned ms) { 
@@ -269,7 +213,7 @@ void LineRadio::consume(const Message& msg) {
         memcpy(&payload, msg.body(), msg.size());
 
         // Enable some tone generation
-        _toneOmega = 2.0f * 3.1415926f * payload.freq / 48000.0f;
+        _tone.setFreq(payload.freq);
 
         // This takes priority over whatever the state machine was doing
         if (_playState == PlayState::STATE_IDLE)
@@ -310,15 +254,8 @@ void LineRadio::_generateToneFrame() {
 
     int16_t pcm48k_2[BLOCK_SIZE_48K];
 
-    for (unsigned i = 0; i < BLOCK_SIZE_48K; i++) {
-        pcm48k_2[i] = 32767.0f * _toneAmpTarget * std::cos(_tonePhi);
-        // IMPORTANT: Phase continuity at all times
-        _tonePhi += _toneOmega;
-    }
-
-    // Avoids strange artifacts when phi becomes very large and precision problems
-    // creep in.
-    _tonePhi = std::fmod(_tonePhi, 2.0f * 3.1415926f);
+    // IMPORTANT: Phase continuity at all times
+    _tone.generate(pcm48k_2, BLOCK_SIZE_48K);
 
     // Here is where statistical analysis and/or local recording can take 
     // place for diagnostic purposes.
@@ -360,6 +297,13 @@ void LineRadio::oneSecTick() {
     payload.rx1Db = -99;
     payload.tx0Db = radioTxDb;
     payload.tx1Db = -99;
+    // The spectrum is only reported while the radio is being received
+    if (_spectrumEnabled && _spectrum.isReady() &&
+        _clock.isInWindow(_lastCaptureMs, 2000)) {
+        payload.rx0PeakHz = _spectrum.getPeakFrequency();
+        payload.rx0SinadDb = _spectrum.getSinadDb();
+        payload.rx0HumDb = _spectrum.getHumDbfs();
+    }
 
     _sendSignal(Message::SignalType::CALL_LEVELS, &payload, sizeof(payload));
 
@@ -514,31 +458,11 @@ void LineRadio::_analyzeCapturedAudio(const int16_t* frame, unsigned frameLen) {
         _capturePcmValueCount++;
     }
 
-    // Perform rolling FFT
-    if (_fftEnabled && _fftTrigger) {
-
-        // Slide everything to the left to make room for a new block
-        //memmove(_fftBlock, _fftBlock + BLOCK_SIZE_48K, sizeof(int16_t) * (FFT_SIZE - BLOCK_SIZE_48K));
-        //memcpy(_fftBlock + FFT_SIZE - BLOCK_SIZE_48K, frame, BLOCK_SIZE_48K);
-
-        // NOTE: FFT SIZE IS SMALLER THAN FRAME SIZE!
-        cf32 inBlock[FFT_SIZE];
-        for (unsigned i = 0; i < FFT_SIZE; i++) {
-            inBlock[i].r = frame[i];
-            inBlock[i].i = 0;
-        }
-        cf32 outBlock[FFT_SIZE];
-        simpleDFT(inBlock, outBlock, FFT_SIZE);
-
-        // Find largest power
-        for (unsigned i = 1; i < FFT_SIZE / 2; i++) {
-            if (outBlock[i].mag() > _fftMaxMag) {
-                _fftMaxMag = outBlock[i].mag();
-                _fftMaxFreq = (48000.0f / (float)FFT_SIZE) * (float)i;
-            }
-        }
-
-        _fftTrigger = false;
+    // Rolling spectrum. This runs at most one FFT per tick.
+    if (_spectrumEnabled) {
+        int16_t pcm8k[BLOCK_SIZE_8K];
+        _spectrumResampler.resample(frame, frameLen, pcm8k, BLOCK_SIZE_8K);
+        _spectrum.consume(pcm8k, BLOCK_SIZE_8K);
     }
 }
 
@@ -588,11 +512,7 @@ void LineRadio::_distributeCapturedAudio(const int16_t* block, unsigned blockLen
 
     if (_injectToneActive) {
         int16_t toneBlock[BLOCK_SIZE_48K];
-        for (unsigned i = 0; i < BLOCK_SIZE_48K; i++) {
-            toneBlock[i] = _injectToneAmp * std::cos(_injectTonePhi) * 32767.0f;
-            _injectTonePhi += _injectToneOmega;
-        }
-        _injectTonePhi = std::fmod(_injectTonePhi, 2.0f * 3.1415926f);
+        _injectTone.generate(toneBlock, BLOCK_SIZE_48K);
         transcoder.encode(toneBlock, blockLen, outBuffer, BLOCK_SIZE_48K * 2);
     } else {
         transcoder.encode(block, blockLen, outBuffer, BLOCK_SIZE_48K * 2);
@@ -623,6 +543,9 @@ void LineRadio::_analyzePlayedAudio(const int16_t* frame, unsigned frameLen) {
 }
 
 void LineRadio::_captureStart() {
+    // Each transmission is analyzed separately
+    _spectrum.reset();
+    _spectrumResampler.reset();
     if (_record) {
         _captureRecordCounter++;
         _log.info("Started audio capturing %u-%u", _startTimeMs, _captureRecordCounter);
@@ -690,7 +613,7 @@ void LineRadio::setToneEnabled(bool b) {
 }
 
 void LineRadio::setToneFreq(float hz) {
-    _toneOmega = 2.0f * 3.1415926f * hz / (float)AUDIO_RATE;
+    _tone.setFreq(hz);
 }
 
 /**
@@ -698,12 +621,11 @@ void LineRadio::setToneFreq(float hz) {
  * harsh transitions (i.e. "clicks").
  */
 void LineRadio::setToneLevel(float dbv) {
-    _toneAmpTarget = dbvToPeak(dbv);
+    _tone.setAmplitude(dbvToPeak(dbv));
 }
 
 void LineRadio::_plToneOn() {
     _plToneEnabled = true;
-    _plTonePhiAdjust = 0;
 }
 
 void LineRadio::_plToneOff() {
@@ -716,11 +638,7 @@ void LineRadio::_plToneChicken() {
 
 void LineRadio::_addPlTone(int16_t* pcm48k, unsigned blockSize) {    
     if (_plToneEnabled) 
-        for (unsigned i = 0; i < blockSize; i++) {
-            float a = (float)_plToneAmp * std::cos(_plTonePhi + _plTonePhiAdjust);
-            pcm48k[i] += (int16_t)a;
-            _plTonePhi += _plToneOmega;
-        }
+        _plTone.add(pcm48k, blockSize);
 }
 
 void LineRadio::_runPlayStateMachine() {
@@ -742,8 +660,8 @@ void LineRadio::_runPlayStateMachine() {
         else {
             // Move to the next step in the sequence
             setToneFreq(_courtesyToneSteps[_courtesyToneStepPtr].f0);
-            _toneAmpTarget = (float)_courtesyToneSteps[_courtesyToneStepPtr].amp /
-                32767.0f;
+            _tone.setAmplitude((float)_courtesyToneSteps[_courtesyToneStepPtr].amp /
+                32767.0f);
             _playState.setState(PlayState::STATE_COURTESY_PLAYING, 
                 _courtesyToneSteps[_courtesyToneStepPtr].durMs, 
                 PlayState::STATE_COURTESY_SEQ);
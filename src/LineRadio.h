@@ -27,6 +27,9 @@
 #include "PCM16Frame.h"
 #include "amp/Ampersand.h"
 #include "amp/Resampler.h"
+#include "amp/WelchSpectrum.h"
+#include "amp/ToneOscillator.h"
+#include "amp/FixedMath.h"
 
 // #### TODO: MOVE INCLUDE FILES FOR THIS PROJECT
 #include "AudioCoreOutputPort.h"
@@ -36,7 +39,6 @@
 
 #include "Line.h"
 
-#define FFT_SIZE (512)
 
 namespace kc1fsz {
 
@@ -51,14 +53,24 @@ public:
      * Example for sanity: 0dBv is 0.5 Vp.
      */
     static float dbvToPeak(float dbv) {
+#ifdef AMP_FIXED_POINT
+        return (float)amp::dbToGainQ(dbv * 256.0f, 16) / 131072.0f;
+#else
         return pow(10, (dbv / 20)) * 0.5;
+#endif
     }
 
     static float dbVfs(int16_t v) {
+#ifdef AMP_FIXED_POINT
+        if (v <= 0)
+            return -96;
+        return (float)amp::amplitudeRatioDbQ8(v, 32767) / 256.0f;
+#else
         float fv = (float)v / 32767.0;
         if (fv == 0)
             return -96;
         return 20.0 * log10(fv);
+#endif
     }
 
     /**
@@ -96,6 +108,12 @@ public:
     void setCourtesyTone(const char* ct) { _courtesyToneSteps = parseToneSeq(ct); }
     void setCaptureDelay(unsigned ms);
 
+    /**
+     * Controls the spectrum analysis of the captured audio (peak frequency,
+     * SINAD and hum), which is reported with the audio levels.
+     */
+    void setSpectrumEnabled(bool b) { _spectrumEnabled = b; }
+
     // ----- MessageConsumer -------------------------------------------------
     
     void consume(const Message& frame);
@@ -238,9 +256,7 @@ protected:
     unsigned _playRecordCounter = 0;
     unsigned _captureRecordCounter = 0;
 
-    float _toneAmpTarget = dbvToPeak(-10);
-    float _toneOmega = 0;
-    float _tonePhi = 0;
+    amp::ToneOscillator _tone;
 
     // Statistical analysis
     uint32_t _captureClipCount = 0;
@@ -258,17 +274,18 @@ protected:
     unsigned _playClips = 0;
 
     bool _injectToneActive = false;
-    // -10dBFS
-    float _injectToneAmp = 0.31;
-    float _injectToneOmega = 2.0f * 3.1415926f * 440.0f / 48000.0f;
-    float _injectTonePhi = 0;
-
-    bool _fftEnabled = false;
-    int16_t _fftWindow[FFT_SIZE] = {};
-    int16_t _fftBlock[FFT_SIZE] = {};
-    float _fftMaxMag = 0;
-    float _fftMaxFreq = 0;
-    bool _fftTrigger = false;
+    amp::ToneOscillator _injectTone;
+
+#ifdef AMP_FIXED_POINT
+    // The spectrum uses a floating point FFT
+    bool _spectrumEnabled = false;
+#else
+    bool _spectrumEnabled = true;
+#endif
+    // The spectrum is analyzed at 8K, which gives ~4 Hz resolution with 
+    // a 2048-point FFT (enough to separate 50/60 Hz hum).
+    amp::Resampler _spectrumResampler;
+    amp::WelchSpectrum _spectrum;
 
     bool _triggerTone = false;
 
@@ -315,10 +332,7 @@ private:
     unsigned _captureDelayLineThreshold = 0;
 
     unsigned _chickenDelayMs = 0;
-    float _plToneOmega = 0;
-    float _plTonePhi = 0;
-    float _plTonePhiAdjust = 0;
-    unsigned _plToneAmp = 0;
+    amp::ToneOscillator _plTone;
     bool _plToneEnabled = false;
 };
 
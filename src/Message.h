@@ -85,7 +85,9 @@ public:
         // Used to publish the list of connected nodes
         LINK_REPORT,
         // Requests a test tone
-        TONE
+        TONE,
+        // Used to publish the health of a network line's socket
+        NETWORK_STATUS
     };
 
     // Message needs to be large enough for 20ms of PCM16 at 48K 
@@ -240,6 +242,10 @@ struct PayloadCallLevels {
     int tx0Db;
     int rx1Db;
     int tx1Db;
+    // Spectrum analysis of the rx0 audio, zero when not available
+    float rx0PeakHz = 0;
+    float rx0SinadDb = 0;
+    float rx0HumDb = 0;
 };
 
 struct PayloadDtmfGen {
@@ -265,4 +271,18 @@ struct PayloadTone {
     unsigned durationMs;
 };
 
+struct PayloadNetworkStatus {
+    // Kernel buffer sizes and the largest queue depths seen (bytes)
+    unsigned txBufferSize = 0;
+    unsigned txQueuedMax = 0;
+    unsigned rxBufferSize = 0;
+    unsigned rxQueuedMax = 0;
+    // Datagrams dropped by the kernel because the receive buffer was full
+    unsigned rxDrops = 0;
+    // Datagrams that the kernel wouldn't take
+    unsigned txDrops = 0;
+    unsigned rxPackets = 0;
+    unsigned txPackets = 0;
+};
+
 }
@@ -0,0 +1,284 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cassert>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MIX_X86 1
+#include <immintrin.h>
+#endif
+
+// NEON is decided at compile time (i.e. by the -mfpu flags on 32-bit ARM,
+// always present on 64-bit ARM).
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MIX_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "amp/MixKernels.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+// ===== Scalar (Reference) ===================================================
+
+static void scaleAccumulate_scalar(int32_t* acc, const int16_t* in, unsigned n,
+    int16_t scale_q15, int16_t scale_q11) {
+    assert(scale_q15 != -32768);
+    for (unsigned i = 0; i < n; i++) {
+        // Fixed-point multiply and accumulate is spelled out here
+        // to give the compiler the best chance at optimization.
+        int32_t product = (int32_t)scale_q15 * (int32_t)in[i];
+        product >>= 15;
+        // Now multiply the q15 audio value by the q11 scaling factor
+        product *= (int32_t)scale_q11;
+        product >>= 11;
+        acc[i] += product;
+    }
+}
+
+static void narrowSaturate_scalar(int16_t* out, const int32_t* acc, unsigned n) {
+    for (unsigned i = 0; i < n; i++) {
+        int32_t v = acc[i];
+        if (v > 32767)
+            v = 32767;
+        else if (v < -32768)
+            v = -32768;
+        out[i] = v;
+    }
+}
+
+static void blendHalf_scalar(int16_t* out, const int16_t* a, const int16_t* b,
+    unsigned n) {
+    for (unsigned i = 0; i < n; i++)
+        out[i] = (a[i] >> 1) + (b[i] >> 1);
+}
+
+static const MixKernels scalarKernels = {
+    scaleAccumulate_scalar, narrowSaturate_scalar, blendHalf_scalar,
+    MixKernels::Backend::SCALAR, "scalar"
+};
+
+// ===== SSE2/AVX2 ============================================================
+
+#ifdef MIX_X86
+
+static void scaleAccumulate_sse2(int32_t* acc, const int16_t* in, unsigned n,
+    int16_t scale_q15, int16_t scale_q11) {
+    assert(scale_q15 != -32768);
+    const __m128i s15 = _mm_set1_epi16(scale_q15);
+    const __m128i s11 = _mm_set1_epi16(scale_q11);
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+        // 16x16->32 multiply built from the low/high halves
+        __m128i lo = _mm_mullo_epi16(x, s15);
+        __m128i hi = _mm_mulhi_epi16(x, s15);
+        __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15);
+        __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15);
+        // The q15 result always fits in 16 bits so this pack is exact
+        __m128i p = _mm_packs_epi32(p0, p1);
+        lo = _mm_mullo_epi16(p, s11);
+        hi = _mm_mulhi_epi16(p, s11);
+        __m128i q0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 11);
+        __m128i q1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 11);
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(acc + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(acc + i + 4));
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi32(a0, q0));
+        _mm_storeu_si128((__m128i*)(acc + i + 4), _mm_add_epi32(a1, q1));
+    }
+    if (i < n)
+        scaleAccumulate_scalar(acc + i, in + i, n - i, scale_q15, scale_q11);
+}
+
+static void narrowSaturate_sse2(int16_t* out, const int32_t* acc, unsigned n) {
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(acc + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(acc + i + 4));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a0, a1));
+    }
+    if (i < n)
+        narrowSaturate_scalar(out + i, acc + i, n - i);
+}
+
+static void blendHalf_sse2(int16_t* out, const int16_t* a, const int16_t* b,
+    unsigned n) {
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_srai_epi16(_mm_loadu_si128((const __m128i*)(a + i)), 1);
+        __m128i y = _mm_srai_epi16(_mm_loadu_si128((const __m128i*)(b + i)), 1);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi16(x, y));
+    }
+    if (i < n)
+        blendHalf_scalar(out + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void scaleAccumulate_avx2(int32_t* acc, const int16_t* in, unsigned n,
+    int16_t scale_q15, int16_t scale_q11) {
+    assert(scale_q15 != -32768);
+    const __m256i s15 = _mm256_set1_epi32(scale_q15);
+    const __m256i s11 = _mm256_set1_epi32(scale_q11);
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+        __m256i p = _mm256_srai_epi32(_mm256_mullo_epi32(x, s15), 15);
+        __m256i q = _mm256_srai_epi32(_mm256_mullo_epi32(p, s11), 11);
+        __m256i a = _mm256_loadu_si256((const __m256i*)(acc + i));
+        _mm256_storeu_si256((__m256i*)(acc + i), _mm256_add_epi32(a, q));
+    }
+    if (i < n)
+        scaleAccumulate_scalar(acc + i, in + i, n - i, scale_q15, scale_q11);
+}
+
+__attribute__((target("avx2")))
+static void narrowSaturate_avx2(int16_t* out, const int32_t* acc, unsigned n) {
+    unsigned i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)(acc + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + i + 8));
+        // The pack works within 128-bit lanes so the 64-bit quarters
+        // need to be put back in order.
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a0, a1), 0xd8);
+        _mm256_storeu_si256((__m256i*)(out + i), p);
+    }
+    if (i < n)
+        narrowSaturate_sse2(out + i, acc + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void blendHalf_avx2(int16_t* out, const int16_t* a, const int16_t* b,
+    unsigned n) {
+    unsigned i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i*)(a + i)), 1);
+        __m256i y = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i*)(b + i)), 1);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi16(x, y));
+    }
+    if (i < n)
+        blendHalf_sse2(out + i, a + i, b + i, n - i);
+}
+
+static const MixKernels sse2Kernels = {
+    scaleAccumulate_sse2, narrowSaturate_sse2, blendHalf_sse2,
+    MixKernels::Backend::SSE2, "sse2"
+};
+
+static const MixKernels avx2Kernels = {
+    scaleAccumulate_avx2, narrowSaturate_avx2, blendHalf_avx2,
+    MixKernels::Backend::AVX2, "avx2"
+};
+
+#endif
+
+// ===== NEON =================================================================
+
+#ifdef MIX_NEON
+
+static void scaleAccumulate_neon(int32_t* acc, const int16_t* in, unsigned n,
+    int16_t scale_q15, int16_t scale_q11) {
+    assert(scale_q15 != -32768);
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        int32x4_t p0 = vshrq_n_s32(vmull_n_s16(vget_low_s16(x), scale_q15), 15);
+        int32x4_t p1 = vshrq_n_s32(vmull_n_s16(vget_high_s16(x), scale_q15), 15);
+        // The q15 result always fits in 16 bits so this narrow is exact
+        int32x4_t q0 = vshrq_n_s32(vmull_n_s16(vmovn_s32(p0), scale_q11), 11);
+        int32x4_t q1 = vshrq_n_s32(vmull_n_s16(vmovn_s32(p1), scale_q11), 11);
+        vst1q_s32(acc + i, vaddq_s32(vld1q_s32(acc + i), q0));
+        vst1q_s32(acc + i + 4, vaddq_s32(vld1q_s32(acc + i + 4), q1));
+    }
+    if (i < n)
+        scaleAccumulate_scalar(acc + i, in + i, n - i, scale_q15, scale_q11);
+}
+
+static void narrowSaturate_neon(int16_t* out, const int32_t* acc, unsigned n) {
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x4_t lo = vqmovn_s32(vld1q_s32(acc + i));
+        int16x4_t hi = vqmovn_s32(vld1q_s32(acc + i + 4));
+        vst1q_s16(out + i, vcombine_s16(lo, hi));
+    }
+    if (i < n)
+        narrowSaturate_scalar(out + i, acc + i, n - i);
+}
+
+static void blendHalf_neon(int16_t* out, const int16_t* a, const int16_t* b,
+    unsigned n) {
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t x = vshrq_n_s16(vld1q_s16(a + i), 1);
+        int16x8_t y = vshrq_n_s16(vld1q_s16(b + i), 1);
+        vst1q_s16(out + i, vaddq_s16(x, y));
+    }
+    if (i < n)
+        blendHalf_scalar(out + i, a + i, b + i, n - i);
+}
+
+static const MixKernels neonKernels = {
+    scaleAccumulate_neon, narrowSaturate_neon, blendHalf_neon,
+    MixKernels::Backend::NEON, "neon"
+};
+
+#endif
+
+// ===== Dispatch =============================================================
+
+bool MixKernels::isSupported(Backend backend) {
+    if (backend == Backend::SCALAR)
+        return true;
+#ifdef MIX_X86
+    else if (backend == Backend::SSE2)
+        return __builtin_cpu_supports("sse2");
+    else if (backend == Backend::AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef MIX_NEON
+    else if (backend == Backend::NEON)
+        return true;
+#endif
+    return false;
+}
+
+const MixKernels& MixKernels::get(Backend backend) {
+    assert(isSupported(backend));
+#ifdef MIX_X86
+    if (backend == Backend::SSE2)
+        return sse2Kernels;
+    else if (backend == Backend::AVX2)
+        return avx2Kernels;
+#endif
+#ifdef MIX_NEON
+    if (backend == Backend::NEON)
+        return neonKernels;
+#endif
+    return scalarKernels;
+}
+
+const MixKernels& MixKernels::get() {
+    // Best first
+    static const MixKernels& best =
+        isSupported(Backend::AVX2) ? get(Backend::AVX2) :
+        isSupported(Backend::SSE2) ? get(Backend::SSE2) :
+        isSupported(Backend::NEON) ? get(Backend::NEON) :
+        get(Backend::SCALAR);
+    return best;
+}
+
+    }
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <cassert>
+
+#include "amp/RealFft.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+RealFft::RealFft(unsigned n)
+:   _n(n),
+    _cos(n / 2),
+    _sin(n / 2),
+    _rev(n / 2),
+    _zr(n / 2),
+    _zi(n / 2) {
+
+    assert(n >= 4 && (n & (n - 1)) == 0);
+
+    for (unsigned k = 0; k < n / 2; k++) {
+        double angle = 2.0 * M_PI * (double)k / (double)n;
+        _cos[k] = std::cos(angle);
+        _sin[k] = -std::sin(angle);
+    }
+
+    const unsigned m = n / 2;
+    unsigned bits = 0;
+    while ((1U << bits) < m)
+        bits++;
+    for (unsigned i = 0; i < m; i++) {
+        unsigned r = 0;
+        for (unsigned b = 0; b < bits; b++)
+            if (i & (1 << b))
+                r |= 1 << (bits - 1 - b);
+        _rev[i] = r;
+    }
+}
+
+void RealFft::transform(const float* in, float* re, float* im) {
+
+    const unsigned m = _n / 2;
+
+    // Pack the even samples into the real part and the odd samples into
+    // the imaginary part, in bit-reversed order.
+    for (unsigned i = 0; i < m; i++) {
+        _zr[_rev[i]] = in[2 * i];
+        _zi[_rev[i]] = in[2 * i + 1];
+    }
+
+    // Iterative radix-2 complex FFT of size m. The twiddles for a size-m
+    // transform are every other entry of the size-n table.
+    for (unsigned len = 2; len <= m; len <<= 1) {
+        const unsigned half = len / 2;
+        const unsigned step = _n / len;
+        for (unsigned start = 0; start < m; start += len) {
+            for (unsigned j = 0; j < half; j++) {
+                const float wr = _cos[j * step], wi = _sin[j * step];
+                const unsigned a = start + j, b = a + half;
+                const float tr = _zr[b] * wr - _zi[b] * wi;
+                const float ti = _zr[b] * wi + _zi[b] * wr;
+                _zr[b] = _zr[a] - tr;
+                _zi[b] = _zi[a] - ti;
+                _zr[a] += tr;
+                _zi[a] += ti;
+            }
+        }
+    }
+
+    // Split into the spectra of the even (E) and odd (O) samples and
+    // combine: X[k] = E[k] + W^k O[k]
+    for (unsigned k = 0; k <= m; k++) {
+        const unsigned k0 = k % m, k1 = (m - k) % m;
+        // E = (Z[k] + conj(Z[m - k])) / 2
+        const float er = 0.5f * (_zr[k0] + _zr[k1]);
+        const float ei = 0.5f * (_zi[k0] - _zi[k1]);
+        // O = (Z[k] - conj(Z[m - k])) / 2j
+        const float or_ = 0.5f * (_zi[k0] + _zi[k1]);
+        const float oi = -0.5f * (_zr[k0] - _zr[k1]);
+        // W^m = -1
+        const float wr = (k < m) ? _cos[k] : -1.0f;
+        const float wi = (k < m) ? _sin[k] : 0.0f;
+        re[k] = er + or_ * wr - oi * wi;
+        im[k] = ei + or_ * wi + oi * wr;
+    }
+}
+
+    }
+}
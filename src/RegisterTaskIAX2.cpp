@@ -74,6 +74,8 @@ void RegisterTaskIAX2::tenSecTick() {
 
 bool RegisterTaskIAX2::run2() {
 
+    bool worked = false;
+
     if (_state == State::STATE_IDLE) {
     }
     else if (_state == State::STATE_REG_PENDING) {
@@ -86,7 +88,7 @@ bool RegisterTaskIAX2::run2() {
     }
     else if (_state == State::STATE_0 ||
         _state == State::STATE_1) {
-        _processInboundIAXData();
+        worked = _processInboundIAXData();
     }
     else if (_state == State::STATE_FAILED) {
         _closeIAX();
@@ -94,7 +96,9 @@ bool RegisterTaskIAX2::run2() {
     }
     else assert(false);
 
-    return true;
+    // The socket isn't polled, so the event loop comes back on its 
+    // own schedule to look for the response.
+    return worked;
 }
 
 bool RegisterTaskIAX2::_openIAX() {
@@ -42,6 +42,11 @@ const int16_t Resampler::F16_COEFFS[] = {
     -154, 69, 246, 198, -47, -269, -249, 17, 292, 309, 24, -314, -380, -79, 334, 465, 151, -353, -573, -252, 369, 715, 396, -382, -918, -620, 393, 1254, 1025, -401, -1956, -2010, 406, 4678, 8771, 10456, 8771, 4678, 406, -2010, -1956, -401, 1025, 1254, 393, -620, -918, -382, 396, 715, 369, -252, -573, -353, 151, 465, 334, -79, -380, -314, 24, 309, 292, 17, -249, -269, -47, 198, 246, 69, -154
 };
 
+const int16_t Resampler::F8_COEFFS[] = {
+// Kaiser Window, N1 = 41, beta1 = 3, cutoff_hz1 = 3700
+    -75, 86, 149, -91, -252, 63, 383, 18, -536, -174, 700, 438, -862, -868, 1009, 1605, -1126, -3170, 1202, 10317, 15135, 10317, 1202, -3170, -1126, 1605, 1009, -868, -862, 438, 700, -174, -536, 18, 383, 63, -252, -91, 149, 86, -75
+};
+
 void Resampler::setRates(unsigned inRate, unsigned outRate) {
 
     reset();
@@ -52,17 +57,17 @@ void Resampler::setRates(unsigned inRate, unsigned outRate) {
     if (_inRate == _outRate) {
         // No filter needed
     } else if (_inRate == 8000 && _outRate == 48000) {
-        arm_fir_init_q15(&_lpfFilter, F1_TAPS, F1_COEFFS, _lpfState, BLOCK_SIZE_48K);
+        _initInterpolator(F1_COEFFS, F1_TAPS, 6);
     } else if (_inRate == 48000 && _outRate == 8000) {
-        //arm_fir_init_q15(&_lpfFilter, F2_TAPS, F2_COEFFS, _lpfState, BLOCK_SIZE_48K);
-        arm_fir_decimate_init_q15(&_lpfDecimationFilter, F2_TAPS, 6, F2_COEFFS, 
-            _lpfState, BLOCK_SIZE_48K);
+        _initDecimator(F2_COEFFS, F2_TAPS, 6, BLOCK_SIZE_48K);
     } else if (_inRate == 16000 && _outRate == 48000) {
-        arm_fir_init_q15(&_lpfFilter, F16_TAPS, F16_COEFFS, _lpfState, BLOCK_SIZE_48K);
+        _initInterpolator(F16_COEFFS, F16_TAPS, 3);
     } else if (_inRate == 48000 && _outRate == 16000) {
-        //arm_fir_init_q15(&_lpfFilter, F16_TAPS, F16_COEFFS, _lpfState, BLOCK_SIZE_48K);
-        arm_fir_decimate_init_q15(&_lpfDecimationFilter, F16_TAPS, 3, F16_COEFFS, 
-            _lpfState, BLOCK_SIZE_48K);
+        _initDecimator(F16_COEFFS, F16_TAPS, 3, BLOCK_SIZE_48K);
+    } else if (_inRate == 8000 && _outRate == 16000) {
+        _initInterpolator(F8_COEFFS, F8_TAPS, 2);
+    } else if (_inRate == 16000 && _outRate == 8000) {
+        _initDecimator(F8_COEFFS, F8_TAPS, 2, BLOCK_SIZE_16K);
     } else {
         assert(false);
     }
@@ -72,6 +77,84 @@ void Resampler::reset() {
     memset(_lpfState, 0, sizeof(_lpfState));
 }
 
+void Resampler::_initInterpolator(const int16_t* coeffs, unsigned taps, 
+    unsigned factor) {
+
+    _upFactor = factor;
+    // The number of input samples that contribute to each output sample
+    _phaseTaps = (taps - 2 + factor) / factor + 1;
+    assert(factor <= MAX_UP_FACTOR);
+    assert(_phaseTaps <= MAX_PHASE_TAPS);
+
+    // With the hold, output sample (n * factor + p) sees input sample 
+    // (n - d) through taps j = [d * factor + p - factor + 1, d * factor + p].
+    for (unsigned p = 0; p < factor; p++) {
+        for (unsigned d = 0; d < _phaseTaps; d++) {
+            int32_t sum = 0;
+            for (int j = (int)(d * factor + p) - (int)factor + 1; 
+                j <= (int)(d * factor + p); j++)
+                if (j >= 0 && j < (int)taps)
+                    sum += coeffs[j];
+            // The hold never pushes these LPFs outside of Q15, and the 
+            // kernels can't take -32768.
+            assert(sum > -32768 && sum <= 32767);
+            // Oldest input first
+            _phaseCoeffs[p * _phaseTaps + (_phaseTaps - 1 - d)] = sum;
+        }
+    }
+}
+
+void Resampler::_interpolate(const int16_t* inBlock, unsigned inSize, 
+    int16_t* outBlock) {
+    // The history holds the last (_phaseTaps - 1) input samples
+    int16_t* hist = _lpfState;
+    memcpy(hist + _phaseTaps - 1, inBlock, inSize * sizeof(int16_t));
+    // Each phase fills every _upFactor'th output sample
+    const FirKernels& k = FirKernels::get();
+    for (unsigned p = 0; p < _upFactor; p++)
+        k.fir(outBlock + p, _upFactor, hist, 1, _phaseCoeffs + p * _phaseTaps,
+            _phaseTaps, inSize);
+    memmove(hist, hist + inSize, (_phaseTaps - 1) * sizeof(int16_t));
+}
+
+#ifdef AMP_FIR_SIMD
+
+void Resampler::_initDecimator(const int16_t* coeffs, unsigned taps, 
+    unsigned factor, unsigned) {
+    for (unsigned i = 0; i < taps; i++)
+        assert(coeffs[i] != -32768);
+    _downFactor = factor;
+    _downCoeffs = coeffs;
+    _downTaps = taps;
+}
+
+void Resampler::_decimate(const int16_t* inBlock, unsigned inSize, 
+    int16_t* outBlock) {
+    // Same state layout as arm_fir_decimate_q15(): the last (_downTaps - 1) 
+    // input samples followed by the new block. Only the outputs that are 
+    // kept are computed.
+    int16_t* hist = _lpfState;
+    memcpy(hist + _downTaps - 1, inBlock, inSize * sizeof(int16_t));
+    FirKernels::get().fir(outBlock, 1, hist, _downFactor, _downCoeffs, _downTaps,
+        inSize / _downFactor);
+    memmove(hist, hist + inSize, (_downTaps - 1) * sizeof(int16_t));
+}
+
+#else
+
+void Resampler::_initDecimator(const int16_t* coeffs, unsigned taps, 
+    unsigned factor, unsigned blockSize) {
+    arm_fir_decimate_init_q15(&_lpfDecimationFilter, taps, factor, coeffs, 
+        _lpfState, blockSize);
+}
+
+void Resampler::_decimate(const int16_t* inBlock, unsigned inSize, 
+    int16_t* outBlock) {
+    arm_fir_decimate_q15(&_lpfDecimationFilter, inBlock, outBlock, inSize);
+}
+
+#endif
+
 unsigned Resampler::getInBlockSize() const {
     return _getBlockSize(_inRate);
 }
@@ -101,15 +184,8 @@ void Resampler::resample(const int16_t* inBlock, unsigned inSize,
     else if (_inRate == 8000 && _outRate == 48000) {
         assert(inSize == BLOCK_SIZE_8K);
         assert(outSize == BLOCK_SIZE_48K);
-        // Perform the upsampling to 48k.
-        int16_t pcm48k_1[BLOCK_SIZE_48K];
-        int16_t* p1 = pcm48k_1;
-        const int16_t* p0 = inBlock;
-        for (unsigned i = 0; i < BLOCK_SIZE_8K; i++, p0++)
-            for (unsigned j = 0; j < 6; j++)
-                *(p1++) = *p0;
-        // Apply the LPF anti-aliasing filter
-        arm_fir_q15(&_lpfFilter, pcm48k_1, outBlock, BLOCK_SIZE_48K);
+        // Upsample to 48k with the anti-aliasing LPF
+        _interpolate(inBlock, BLOCK_SIZE_8K, outBlock);
     }
     // NOTE: This is a particularly performance-critical area given the 
     // scenario with a lot of 8K callers attached to a conference bridge
@@ -119,27 +195,34 @@ void Resampler::resample(const int16_t* inBlock, unsigned inSize,
         assert(outSize == BLOCK_SIZE_8K);
         // Decimate from 48k to 8k
         // Apply a LPF to the block because we are decimating.
-        arm_fir_decimate_q15(&_lpfDecimationFilter, inBlock, outBlock, BLOCK_SIZE_48K);
+        _decimate(inBlock, BLOCK_SIZE_48K, outBlock);
     }
     else if (_inRate == 16000 && _outRate == 48000) {
         assert(inSize == BLOCK_SIZE_16K);
         assert(outSize == BLOCK_SIZE_48K);
-        // Perform the upsampling to 48k.
-        int16_t pcm48k_1[BLOCK_SIZE_48K];
-        int16_t* p1 = pcm48k_1;
-        const int16_t* p0 = inBlock;
-        for (unsigned i = 0; i < BLOCK_SIZE_16K; i++, p0++)
-            for (unsigned j = 0; j < 3; j++)
-                *(p1++) = *p0;
-        // Apply the LPF anti-aliasing filter
-        arm_fir_q15(&_lpfFilter, pcm48k_1, outBlock, BLOCK_SIZE_48K);
+        // Upsample to 48k with the anti-aliasing LPF
+        _interpolate(inBlock, BLOCK_SIZE_16K, outBlock);
     }
     else if (_inRate == 48000 && _outRate == 16000) {
         assert(inSize == BLOCK_SIZE_48K);
         assert(outSize == BLOCK_SIZE_16K);
         // Decimate from 48k 
         // Apply a LPF to the block because we are decimating.
-        arm_fir_decimate_q15(&_lpfDecimationFilter, inBlock, outBlock, BLOCK_SIZE_48K);
+        _decimate(inBlock, BLOCK_SIZE_48K, outBlock);
+    }
+    // These two are used when the conference is running at 16K
+    else if (_inRate == 8000 && _outRate == 16000) {
+        assert(inSize == BLOCK_SIZE_8K);
+        assert(outSize == BLOCK_SIZE_16K);
+        // Upsample to 16k with the anti-aliasing LPF
+        _interpolate(inBlock, BLOCK_SIZE_8K, outBlock);
+    }
+    else if (_inRate == 16000 && _outRate == 8000) {
+        assert(inSize == BLOCK_SIZE_16K);
+        assert(outSize == BLOCK_SIZE_8K);
+        // Decimate from 16k to 8k
+        // Apply a LPF to the block because we are decimating.
+        _decimate(inBlock, BLOCK_SIZE_16K, outBlock);
     }
     else {
         assert(false);
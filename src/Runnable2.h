@@ -24,6 +24,8 @@ struct pollfd;
 
 namespace kc1fsz {
 
+class IoUring;
+
 class Runnable2 : public Runnable {
 public:
 
@@ -36,6 +38,15 @@ public:
      */
     virtual int getPolls(pollfd* fds, unsigned fdsCapacity) { return 0; }
 
+    /**
+     * Called by an event loop that is running on io_uring (once at the 
+     * start, and with nullptr before the ring goes away). A task that
+     * wants to do its I/O through the ring can do so, and should then 
+     * leave those file descriptors out of getPolls(). Tasks that ignore 
+     * this keep working as before.
+     */
+    virtual void attachRing(IoUring* ring) { }
+
     virtual void run() { run2(); }
 
     /**
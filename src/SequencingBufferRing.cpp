@@ -0,0 +1,412 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "kc1fsz-tools/Common.h"
+
+#include "amp/SequencingBufferStd.h"
+
+#include "SequencingBufferRing.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+SequencingBufferRing::SequencingBufferRing() {
+    reset();
+}
+
+void SequencingBufferRing::setPayloadCapacity(unsigned bytes) {
+    _payloadCapacity = bytes;
+    // NOTE: The vector keeps its storage if the size goes down, so
+    // re-using the buffer for a new call doesn't allocate.
+    _slab.resize(CAPACITY * bytes);
+    _clearSlots();
+}
+
+void SequencingBufferRing::setInitialMargin(int32_t ms) {
+    _initialMargin = ms;
+    // Seed the adaptive buffer
+    _jitter.reset(ms);
+}
+
+void SequencingBufferRing::reset() {
+    _clearSlots();
+    // Diagnostics
+    _maxBufferDepth = 0;
+    _overflowCount = 0;
+    _lateVoiceFrameCount = 0;
+    _interpolatedVoiceFrameCount = 0;
+    // Tracking
+    _lastPlayedLocal = 0;
+    _originCursor = 0;
+    _originCursorValid = false;
+    _inTalkspurt = false;
+    _talkSpurtCount = 0;
+    _talkspurtFrameCount = 0;
+    _talkspurtFirstOrigin = 0;
+    _voicePlayoutCount = 0;
+    _voiceConsumedCount = 0;
+    _jitter.reset(0);
+    _worstMargin = INT32_MAX;
+    _totalMargin = 0;
+    _startMs = 0;
+    _timeScale = TS_NORMAL;
+    _holdNext = false;
+    _lastTimeScaleMs = 0;
+    _flightBase = 0;
+    _compressCount = 0;
+    _expandCount = 0;
+    _totalAddedDelay = 0;
+    _addedDelayCount = 0;
+    _maxAddedDelay = 0;
+}
+
+void SequencingBufferRing::_clearSlots() {
+    for (unsigned i = 0; i < CAPACITY; i++)
+        _slots[i].used = false;
+    _count = 0;
+    _lowTick = 0;
+}
+
+void SequencingBufferRing::_release(unsigned i) {
+    assert(_slots[i].used);
+    _slots[i].used = false;
+    _count--;
+}
+
+int SequencingBufferRing::_oldest() {
+    if (_count == 0)
+        return -1;
+    // Normally the oldest frame is found at (or shortly after) the low-water
+    // mark. Each step forward is permanent so this is O(1) on average.
+    for (unsigned i = 0; i < CAPACITY; i++, _lowTick++) {
+        const Slot& s = _slots[_lowTick % CAPACITY];
+        if (s.used && _tickOf(s.origMs) == _lowTick)
+            return _lowTick % CAPACITY;
+    }
+    // If the origin clock wrapped then fall back to a full scan
+    int best = -1;
+    for (unsigned i = 0; i < CAPACITY; i++)
+        if (_slots[i].used &&
+            (best == -1 || LT_MOD32(_slots[i].origMs, _slots[best].origMs)))
+            best = i;
+    assert(best != -1);
+    _lowTick = _tickOf(_slots[best].origMs);
+    return best;
+}
+
+int SequencingBufferRing::_playable(int32_t originMs) const {
+    const unsigned i = _tickOf(originMs) % CAPACITY;
+    const Slot& s = _slots[i];
+    if (s.used &&
+        LE_MOD32(originMs, s.origMs) &&
+        LT_MOD32(s.origMs, originMs + _voiceTickSize))
+        return i;
+    return -1;
+}
+
+/**
+ * @returns v rounded up to a whole number of ticks.
+ */
+#ifdef AMP_FIXED_POINT
+static int32_t ceilToTick(int32_t v, int32_t tick) {
+    return (v > 0 ? (v + tick - 1) / tick : -(-v / tick)) * tick;
+}
+#else
+static int32_t ceilToTick(float v, int32_t tick) {
+    return std::ceil(v / (float)tick) * tick;
+}
+#endif
+
+JitterEstimator::ms_t SequencingBufferRing::_targetDelay() const {
+    return std::max(_jitter.getIdealDelay(), 
+        _jitter.getDelay() + (JitterEstimator::ms_t)_minAdaptiveMargin);
+}
+
+int32_t SequencingBufferRing::_startMargin(unsigned i) const {
+    if (!_adaptiveDelay || _voiceConsumedCount < _adaptiveWarmupFrames)
+        return _initialMargin;
+    // The first frame has already used up part of the delay in flight
+    const int32_t flight = (int32_t)(_slots[i].rxMs - _slots[i].origMs) - _flightBase;
+    const int32_t m = ceilToTick(_targetDelay() - (JitterEstimator::ms_t)flight, 
+        _voiceTickSize);
+    return std::clamp(m, (int32_t)_voiceTickSize, _maxAdaptiveMargin);
+}
+
+bool SequencingBufferRing::consume(Log& log, const Message& payload) {
+
+    if (payload.size() > _payloadCapacity) {
+        _overflowCount++;
+        log.info("OF size=%u capacity=%u", payload.size(), _payloadCapacity);
+        return false;
+    }
+
+    const uint32_t tick = _tickOf(payload.getOrigMs());
+    const unsigned i = tick % CAPACITY;
+    Slot& s = _slots[i];
+
+    if (s.used) {
+        // A second frame for the same tick is ignored
+        if (_tickOf(s.origMs) == tick) {
+            log.info("Duplicate orig=%6d", payload.getOrigMs());
+            return false;
+        }
+        // A frame that is already expired can be replaced quietly. Anything
+        // else means that the buffer is full.
+        if (_originCursorValid &&
+            LT_MOD32(s.origMs, payload.getOrigMs()) &&
+            LT_MOD32(s.origMs, _originCursor)) {
+            _release(i);
+        }
+        else {
+            _overflowCount++;
+            log.info("OF orig=%6d cursor=%6d", payload.getOrigMs(), _originCursor);
+            return false;
+        }
+    }
+
+    s.used = true;
+    s.type = payload.getType();
+    s.format = payload.getFormat();
+    s.size = payload.size();
+    s.origMs = payload.getOrigMs();
+    s.rxMs = payload.getRxMs();
+    s.sourceBusId = payload.getSourceBusId();
+    s.sourceCallId = payload.getSourceCallId();
+    s.destBusId = payload.getDestBusId();
+    s.destCallId = payload.getDestCallId();
+    if (payload.size())
+        memcpy(_slab.data() + i * _payloadCapacity, payload.body(), payload.size());
+
+    if (_count == 0 || (int32_t)(tick - _lowTick) < 0)
+        _lowTick = tick;
+    _count++;
+
+    if (_traceLog)
+        _traceLog->info("RXV, %u, %u", payload.getOrigMs(), _originCursor);
+
+    // Use the frame information to keep the delay estimate up to date. We do
+    // this as early as possible (on consume) so that the estimate is as
+    // up-to-date as possible.
+    bool startOfCall = _voiceConsumedCount == 0;
+    _voiceConsumedCount++;
+    _updateDelayTarget(log, startOfCall, payload.getRxMs(), payload.getOrigMs());
+
+    return true;
+}
+
+void SequencingBufferRing::_play(unsigned i, uint32_t localMs, playCb& playSink) {
+    const Slot& s = _slots[i];
+    MessageWrapper msg((Message::Type)s.type, s.format, s.size,
+        _slab.data() + i * _payloadCapacity, s.origMs, s.rxMs);
+    msg.setSource(s.sourceBusId, s.sourceCallId);
+    msg.setDest(s.destBusId, s.destCallId);
+    playSink(msg, localMs);
+}
+
+/**
+ * The same flow as SequencingBufferStd::playOut(), see the notes there.
+ */
+void SequencingBufferRing::playOut(Log& log, uint32_t localMs, playCb playSink,
+    interpCb interpSink) {
+
+    bool framePlayed = false;
+    bool hold = false;
+    uint32_t framePlayedOriginMs = 0;
+    uint32_t framePlayedRxMs = 0;
+
+    _timeScale = TS_NORMAL;
+
+    // For diagnostic purposes
+    _maxBufferDepth = std::max(_maxBufferDepth, _count);
+
+    // Look for the special case that is treated as a bypass of the
+    // sequencing buffer.
+    if (_initialMargin == 0) {
+        int i = _oldest();
+        if (i != -1) {
+            // Just play the oldest frame, no questions asked
+            _play(i, localMs, playSink);
+            framePlayed = true;
+            framePlayedOriginMs = _slots[i].origMs;
+            framePlayedRxMs = _slots[i].rxMs;
+            _voicePlayoutCount++;
+            _release(i);
+        }
+    }
+    // Otherwise, the playout is controlled by a cursor
+    else {
+        // Has the cursor been setup yet? If not, establish based on the timestamp
+        // of the first frame on the buffer.
+        if (!_originCursorValid) {
+            int i = _oldest();
+            if (i != -1) {
+                // In adaptive mode this is where silence gets added/removed
+                _originCursor = SequencingBufferStd<MessageCarrier>::roundToTick(
+                    SUB_MOD32(_slots[i].origMs, _startMargin(i)), _voiceTickSize);
+                _originCursorValid = true;
+            }
+        }
+
+        if (_originCursorValid) {
+
+            // Clean anything that is expired
+            int i;
+            while ((i = _oldest()) != -1 &&
+                LT_MOD32(_slots[i].origMs, _originCursor)) {
+                log.info("Discarding %u < %u", _slots[i].origMs, _originCursor);
+                _lateVoiceFrameCount++;
+                _release(i);
+            }
+
+            // The previous frame is being stretched across this tick
+            if (_holdNext) {
+                _holdNext = false;
+                _timeScale = TS_HOLD;
+                hold = true;
+            }
+            // If we've got a frame that is inside of the current tick then play
+            // it. Since the cursor is on a tick boundary this is the only slot
+            // that needs to be checked, even for frames that are not aligned.
+            else if ((i = _playable(_originCursor)) != -1) {
+
+                // In adaptive mode, see if the delay inside of the talkspurt
+                // has drifted far enough from the target to do something.
+                if (_adaptiveDelay && _inTalkspurt &&
+                    _voiceConsumedCount >= _adaptiveWarmupFrames &&
+                    localMs - _lastTimeScaleMs >= _timeScaleIntervalMs) {
+                    const JitterEstimator::ms_t delay = (JitterEstimator::ms_t)
+                        ((int32_t)(localMs - (uint32_t)_originCursor) - _flightBase);
+                    const JitterEstimator::ms_t target = _targetDelay();
+                    const JitterEstimator::ms_t tick = _voiceTickSize;
+                    if (delay > target + 2 * tick &&
+                        _playable(_originCursor + _voiceTickSize) != -1) {
+                        _timeScale = TS_COMPRESS;
+                        _compressCount++;
+                    }
+                    else if (delay + tick < target &&
+                        _count < CAPACITY / 2) {
+                        _timeScale = TS_EXPAND;
+                        _expandCount++;
+                        _holdNext = true;
+                    }
+                    if (_timeScale != TS_NORMAL)
+                        _lastTimeScaleMs = localMs;
+                }
+
+                _play(i, localMs, playSink);
+                framePlayed = true;
+                framePlayedOriginMs = _slots[i].origMs;
+                framePlayedRxMs = _slots[i].rxMs;
+                _voicePlayoutCount++;
+                _release(i);
+
+                // The second frame goes out on the same tick
+                if (_timeScale == TS_COMPRESS) {
+                    _originCursor += _voiceTickSize;
+                    int j = _playable(_originCursor);
+                    _play(j, localMs, playSink);
+                    _voicePlayoutCount++;
+                    _release(j);
+                }
+            }
+        }
+    }
+
+    // All playout complete, now deal with tracking/stats
+    if (framePlayed) {
+
+        _lastPlayedLocal = localMs;
+
+        // Is this the leading edge of a talkspurt?
+        if (!_inTalkspurt) {
+            _inTalkspurt = true;
+            _talkspurtFrameCount = 0;
+            _talkspurtFirstOrigin = framePlayedOriginMs;
+            _worstMargin = INT32_MAX;
+            _totalMargin = 0;
+            log.info("Start TS %u", _talkspurtFirstOrigin);
+        }
+
+        // Keep margin tracking up to date
+        int32_t margin = (int32_t)localMs - (int32_t)framePlayedRxMs;
+        if (margin < _worstMargin)
+            _worstMargin = margin;
+        _totalMargin += margin;
+        _talkspurtFrameCount++;
+        _totalAddedDelay += std::max(margin, 0);
+        _addedDelayCount++;
+        _maxAddedDelay = std::max(_maxAddedDelay, margin);
+    }
+    else if (hold) {
+        _lastPlayedLocal = localMs;
+    }
+    else {
+        // Is there a gap in the talkspurt? If so, interpolate it.
+        if (_inTalkspurt) {
+
+            interpSink(_originCursor, localMs, _voiceTickSize);
+            _interpolatedVoiceFrameCount++;
+
+            // Is this the trailing edge of a talkspurt?
+            if (localMs >= (_lastPlayedLocal + _talkspurtTimeoutInteval)) {
+                _inTalkspurt = false;
+                _talkSpurtCount++;
+                int32_t avgMargin = (_talkspurtFrameCount != 0) ?
+                    _totalMargin / _talkspurtFrameCount : 0;
+                log.info("End TS, avgM: %d, shortM: %d, OC: %u, size: %d, interp: %u",
+                    avgMargin,
+                    _worstMargin,
+                    _originCursor,
+                    size(),
+                    _interpolatedVoiceFrameCount);
+                // Unlink the cursor so we can re-establish
+                _originCursorValid = false;
+            }
+        }
+    }
+
+    // Always move the expectation forward one click to keep in sync with
+    // the clock moving forward on the remote side. (Except for the extra
+    // tick created by an expansion.)
+    if (!hold)
+        _originCursor += _voiceTickSize;
+}
+
+void SequencingBufferRing::_updateDelayTarget(Log& log, bool startOfCall,
+    uint32_t frameRxMs, uint32_t frameOrigMs) {
+
+    // Calculate the flight time of this frame. This is relative to the
+    // first frame since the two clocks can be far apart.
+    const int32_t flight = (int32_t)(frameRxMs - frameOrigMs);
+    if (startOfCall)
+        _flightBase = flight;
+    const int32_t ni = flight - _flightBase;
+
+    // Assume no variance at the beginning
+    if (startOfCall)
+        _jitter.reset(ni);
+    // Re-estimate the variance statistics on each frame (Ramjee Algorithm 1)
+    else 
+        _jitter.consume(ni);
+}
+
+    }
+}
@@ -0,0 +1,260 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "kc1fsz-tools/Log.h"
+
+#include "amp/SequencingBuffer.h"
+#include "amp/JitterEstimator.h"
+
+#include "Message.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * A variant of SequencingBufferStd<MessageCarrier> that uses far less memory.
+ * The playout behavior (cursor, talkspurts, Ramjee Algorithm 1 delay
+ * estimate) is the same.
+ *
+ * The frames are stored in a ring of slots indexed by (origMs / 20) modulo
+ * the capacity, so insert and playout are O(1) without any sorting. Each
+ * slot has a small header and the payload is kept in a slab that is sized
+ * for the CODEC in use (see setPayloadCapacity()) instead of a full
+ * MessageCarrier. For G.711 this is about 1/10th of the memory.
+ *
+ * Frames are passed to the play callback as a MessageWrapper that points
+ * into the slab. The content is only valid for the duration of the call.
+ */
+class SequencingBufferRing : public SequencingBuffer<Message> {
+public:
+
+    // 64 slots provides room to track 1.28 seconds of audio
+    static const unsigned CAPACITY = 64;
+
+    /**
+     * What the most recent playOut() did to the timeline. This is set 
+     * before the play callback is made so the sink can check it.
+     */
+    enum TimeScale { 
+        // Zero or one frame played
+        TS_NORMAL, 
+        // Two frames played, to be squeezed into one tick
+        TS_COMPRESS, 
+        // One frame played, to be stretched across this tick and the next 
+        TS_EXPAND, 
+        // Nothing played, the tick is covered by the previous TS_EXPAND
+        TS_HOLD 
+    };
+
+    SequencingBufferRing();
+
+    /**
+     * Sets the largest payload that can be stored. This would normally be
+     * the voice frame size of the CODEC. Anything in the buffer is discarded.
+     */
+    void setPayloadCapacity(unsigned bytes);
+
+    unsigned getPayloadCapacity() const { return _payloadCapacity; }
+
+    void setTraceLog(Log* l) { _traceLog = l; }
+
+    void lockDelay() { _delayLocked = true; }
+
+    void unlockDelay() { _delayLocked = false; }
+
+    void setInitialMargin(int32_t ms);
+
+    void setTalkspurtTimeoutInterval(uint32_t ms) { _talkspurtTimeoutInteval = ms; }
+
+    /**
+     * Enables the adaptive playout delay. The target delay comes from the 
+     * Ramjee estimate (with a minimum margin). It's applied at the start
+     * of each talkspurt by adding or removing silence, and inside of a 
+     * talkspurt by asking the sink to compress/expand the audio (see 
+     * getTimeScale()). When disabled the delay is fixed at the initial 
+     * margin.
+     */
+    void setAdaptiveDelay(bool b) { _adaptiveDelay = b; }
+
+    TimeScale getTimeScale() const { return _timeScale; }
+
+    bool empty() const { return _count == 0; }
+    unsigned size() const { return _count; }
+    unsigned maxSize() const { return CAPACITY; }
+    void setStartMs(uint32_t ms) { _startMs = ms; }
+
+    // ----- Diagnostics -----------------------------------------------
+
+    unsigned getLateVoiceFrameCount() const { return _lateVoiceFrameCount; }
+    unsigned getInterpolatedVoiceFrameCount() const { return _interpolatedVoiceFrameCount; }
+    unsigned getOverflowCount() const { return _overflowCount; }
+    unsigned getMaxBufferDepth() const { return _maxBufferDepth; }
+    unsigned getCompressCount() const { return _compressCount; }
+    unsigned getExpandCount() const { return _expandCount; }
+    unsigned getVoicePlayoutCount() const { return _voicePlayoutCount; }
+
+    /**
+     * @returns The average time (ms) that the played frames spent waiting
+     * in the buffer, i.e. the delay added by the buffer.
+     */
+    float getAverageAddedDelay() const { 
+        return _addedDelayCount ? (float)_totalAddedDelay / (float)_addedDelayCount : 0; 
+    }
+
+    int32_t getMaxAddedDelay() const { return _maxAddedDelay; }
+
+    // ----- SequencingBuffer -------------------------------------------------
+
+    virtual void reset();
+    virtual bool inTalkspurt() const { return _inTalkspurt; }
+    virtual bool consume(Log& log, const Message& payload);
+    virtual void playOut(Log& log, uint32_t localMs, playCb playSink,
+        interpCb interpSink);
+
+private:
+
+    /**
+     * Everything about a stored frame except the payload.
+     */
+    struct Slot {
+        bool used = false;
+        uint8_t type = Message::Type::NONE;
+        uint16_t size = 0;
+        unsigned format = 0;
+        uint32_t origMs = 0;
+        uint32_t rxMs = 0;
+        unsigned sourceBusId = 0, sourceCallId = 0;
+        unsigned destBusId = 0, destCallId = 0;
+    };
+
+    uint32_t _tickOf(uint32_t origMs) const { return origMs / _voiceTickSize; }
+
+    /**
+     * @returns The slot index of the oldest frame, or -1 if empty.
+     */
+    int _oldest();
+
+    /**
+     * @returns The slot index of the frame in the tick that starts at 
+     * originMs, or -1 if there isn't one.
+     */
+    int _playable(int32_t originMs) const;
+
+    /**
+     * @returns The playout delay that we are aiming for, relative to
+     * _flightBase.
+     */
+    JitterEstimator::ms_t _targetDelay() const;
+
+    /**
+     * @returns The margin to use at the start of a talkspurt that begins 
+     * with the frame in slot i.
+     */
+    int32_t _startMargin(unsigned i) const;
+
+    void _clearSlots();
+
+    void _release(unsigned i);
+
+    void _play(unsigned i, uint32_t localMs, playCb& playSink);
+
+    void _updateDelayTarget(Log& log, bool startOfCall,
+        uint32_t frameRxMs, uint32_t frameOrigMs);
+
+    // ------ Configuration Constants ----------------------------------------
+
+    // The size of an audio tick in milliseconds
+    const uint32_t _voiceTickSize = 20;
+    // The number of ms of silence before we delcare a talkspurt ended.
+    uint32_t _talkspurtTimeoutInteval = 60;
+    // The adaptive delay is never less than this past the average delay
+    const int32_t _minAdaptiveMargin = 40;
+    // ... and the talkspurt margin is never more than this
+    const int32_t _maxAdaptiveMargin = 500;
+    // The estimate needs some history before it can be used
+    const unsigned _adaptiveWarmupFrames = 50;
+    // Time-scale changes inside of a talkspurt are spread out by at least
+    // this much.
+    const uint32_t _timeScaleIntervalMs = 200;
+
+    Log* _traceLog = 0;
+
+    Slot _slots[CAPACITY];
+    // CAPACITY payloads of _payloadCapacity bytes each
+    std::vector<uint8_t> _slab;
+    unsigned _payloadCapacity = 0;
+    unsigned _count = 0;
+    // All frames in the buffer are at or after this tick. Advanced lazily
+    // when looking for the oldest frame.
+    uint32_t _lowTick = 0;
+
+    uint32_t _startMs = 0;
+
+    // This always points to the next origin time to be played. This will
+    // always be on a 20ms boundary.
+    int32_t _originCursor = 0;
+    bool _originCursorValid = false;
+    uint32_t _talkspurtFirstOrigin = 0;
+    // Used for detecting the end of a talkspurt
+    uint32_t _lastPlayedLocal = 0;
+
+    bool _inTalkspurt = false;
+    unsigned _talkspurtFrameCount = 0;
+
+    bool _delayLocked = false;
+
+    bool _adaptiveDelay = false;
+    TimeScale _timeScale = TS_NORMAL;
+    // Set after a TS_EXPAND so that the next tick is a TS_HOLD
+    bool _holdNext = false;
+    uint32_t _lastTimeScaleMs = 0;
+
+    // The flight time (including any clock offset) of the first frame
+    // of the call. The delay estimates are relative to this to keep the 
+    // numbers small and exact.
+    int32_t _flightBase = 0;
+
+    // Used to estimate delay and delay variance
+    JitterEstimator _jitter;
+    // Starting estimate of margin
+    // MUST BE A MULTIPLE OF _voiceTickSize
+    unsigned _initialMargin = _voiceTickSize * 5;
+
+    // ----- Diagnostic/Metrics Stuff ----------------------------------------
+
+    unsigned _overflowCount = 0;
+    unsigned _lateVoiceFrameCount = 0;
+    unsigned _interpolatedVoiceFrameCount = 0;
+    unsigned _voicePlayoutCount = 0;
+    unsigned _voiceConsumedCount = 0;
+    int32_t _worstMargin = 0;
+    int32_t _totalMargin = 0;
+    unsigned _talkSpurtCount = 0;
+    unsigned _maxBufferDepth = 0;
+    unsigned _compressCount = 0;
+    unsigned _expandCount = 0;
+    uint64_t _totalAddedDelay = 0;
+    unsigned _addedDelayCount = 0;
+    int32_t _maxAddedDelay = 0;
+};
+
+    }
+}
@@ -0,0 +1,114 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h> // Required for SIOCOUTQ/SIOCINQ
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include "kc1fsz-tools/Log.h"
+
+#include "SocketHealth.h"
+
+namespace kc1fsz {
+
+int SocketHealth::attach(Log& log, int fd) {
+
+    _log = &log;
+    _fd = fd;
+    _txBufferSize = 0;
+    _rxBufferSize = 0;
+    _txHighCount = 0;
+    _rxDrops = 0;
+    resetPeaks();
+
+#ifndef _WIN32
+    int rc = 0;
+    int optval = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &optval, sizeof(optval)) == -1) {
+        _log->error("Unable to enable SO_RXQ_OVFL (%d)", errno);
+        rc = -1;
+    }
+
+    int bufferSize = 0;
+    socklen_t optlen = sizeof(bufferSize);
+    if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, &optlen) < 0) {
+        _log->error("Unable to get TX buffer size");
+        rc = -1;
+    } else {
+        _txBufferSize = bufferSize;
+    }
+
+    optlen = sizeof(bufferSize);
+    if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, &optlen) < 0) {
+        _log->error("Unable to get RX buffer size");
+        rc = -1;
+    } else {
+        _rxBufferSize = bufferSize;
+    }
+
+    return rc;
+#else
+    return 0;
+#endif
+}
+
+void SocketHealth::detach() {
+    _fd = -1;
+}
+
+void SocketHealth::sample() {
+#ifndef _WIN32
+    if (_fd == -1)
+        return;
+    int bytes = 0;
+    if (ioctl(_fd, SIOCOUTQ, &bytes) != -1) {
+        _txQueuedMax = std::max(_txQueuedMax, (unsigned)bytes);
+        if ((unsigned)bytes > ((_txBufferSize * 3) / 4)) {
+            _txHighCount++;
+            _log->info("Socket transmit buffer >75 percent at %d", bytes);
+        }
+    }
+    bytes = 0;
+    if (ioctl(_fd, SIOCINQ, &bytes) != -1) 
+        _rxQueuedMax = std::max(_rxQueuedMax, (unsigned)bytes);
+#endif
+}
+
+#ifndef _WIN32
+void SocketHealth::consumeControl(const msghdr& hdr) {
+    for (const cmsghdr* c = CMSG_FIRSTHDR(&hdr); c != 0; 
+        c = CMSG_NXTHDR((msghdr*)&hdr, (cmsghdr*)c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL &&
+            c->cmsg_len >= CMSG_LEN(sizeof(uint32_t))) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+            // This is the running total for the socket
+            if (drops != _rxDrops) {
+                _log->info("Socket receive drops %u", drops - _rxDrops);
+                _rxDrops = drops;
+            }
+        }
+    }
+}
+#endif
+
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+namespace kc1fsz {
+
+class Log;
+
+/**
+ * Keeps an eye on the kernel buffers of a UDP socket on a large server
+ * where they may overflow. The queue depths are sampled on a slow tick 
+ * (see sample()) rather than after every send, and the kernel's count 
+ * of dropped receive datagrams arrives as ancillary data on the received
+ * datagrams (SO_RXQ_OVFL), so no extra system calls are needed for it.
+ */
+class SocketHealth {
+public:
+
+    /**
+     * The space needed for the ancillary data of a received datagram.
+     */
+    static const unsigned CONTROL_SIZE = 64;
+
+    /**
+     * Starts watching a socket. Turns on the receive drop reporting and 
+     * reads the buffer sizes.
+     * @returns 0 on success
+     */
+    int attach(Log& log, int fd);
+
+    void detach();
+
+    /**
+     * Looks at the queue depths. Intended to be called a few times per
+     * second.
+     */
+    void sample();
+
+#ifndef _WIN32
+    /**
+     * Picks up the kernel's drop count from the ancillary data of a 
+     * received datagram (if present).
+     */
+    void consumeControl(const msghdr& hdr);
+#endif
+
+    unsigned getTxBufferSize() const { return _txBufferSize; }
+    unsigned getRxBufferSize() const { return _rxBufferSize; }
+
+    /**
+     * @returns The largest transmit queue depth (bytes) seen since 
+     * the last resetPeaks().
+     */
+    unsigned getTxQueuedMax() const { return _txQueuedMax; }
+
+    /**
+     * @returns The largest receive queue depth (bytes) seen since 
+     * the last resetPeaks(). NOTE: For a UDP socket the kernel only 
+     * reports the size of the next datagram, so this mostly shows 
+     * whether anything was waiting.
+     */
+    unsigned getRxQueuedMax() const { return _rxQueuedMax; }
+
+    /**
+     * @returns The number of datagrams that the kernel has dropped 
+     * because the receive buffer was full.
+     */
+    uint32_t getRxDrops() const { return _rxDrops; }
+
+    /**
+     * @returns The number of samples that found the transmit buffer 
+     * more than 75% full.
+     */
+    unsigned getTxHighCount() const { return _txHighCount; }
+
+    void resetPeaks() { 
+        _txQueuedMax = 0;
+        _rxQueuedMax = 0;
+    }
+
+private:
+
+    Log* _log = 0;
+    int _fd = -1;
+    unsigned _txBufferSize = 0;
+    unsigned _rxBufferSize = 0;
+    unsigned _txQueuedMax = 0;
+    unsigned _rxQueuedMax = 0;
+    unsigned _txHighCount = 0;
+    uint32_t _rxDrops = 0;
+};
+
+}
@@ -0,0 +1,84 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cassert>
+
+namespace kc1fsz {
+
+/**
+ * A bounded queue between exactly one producer thread and one consumer 
+ * thread that doesn't use locks, so neither side can be stalled by the
+ * other (ex: in the middle of an audio tick). The slots are allocated 
+ * once and items are copied in and out.
+ */
+template<typename T> class SpscQueue {
+public:
+
+    /**
+     * @param capacity A power of 2.
+     */
+    SpscQueue(unsigned capacity) 
+    :   _slots(new T[capacity]),
+        _mask(capacity - 1) {
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    }
+
+    /**
+     * Producer side.
+     * @returns false if the queue is full (the item is not added).
+     */
+    template<typename U> bool push(const U& item) {
+        const unsigned tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) > _mask)
+            return false;
+        _slots[tail & _mask] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side.
+     * @returns false if the queue is empty.
+     */
+    bool pop(T& item) {
+        const unsigned head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+            return false;
+        item = _slots[head & _mask];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == 
+            _tail.load(std::memory_order_acquire);
+    }
+
+private:
+
+    std::unique_ptr<T[]> _slots;
+    const unsigned _mask;
+    // Kept on separate cache lines since they are written by different 
+    // threads.
+    alignas(64) std::atomic<unsigned> _head = 0;
+    alignas(64) std::atomic<unsigned> _tail = 0;
+};
+
+}
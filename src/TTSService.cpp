@@ -31,6 +31,7 @@
 #include "ThreadUtil.h"
 #include "Transcoder_SLIN_48K.h"
 #include "amp/Resampler.h"
+#include "amp/ToneOscillator.h"
 
 using namespace std;
 
@@ -68,9 +69,9 @@ static MessageCarrier makeTTSAudioMsg(const Message& req,
 static void queueComfortNoise(const Message& req, unsigned ms,
     threadsafequeue2<MessageCarrier>* ttsQueueRes) {    
 
-    float omega = 10.0f * 2.0f * 3.1415926f / 48000.0f;
-    float phi = 0;
-    float amp = 0.01;
+    amp::ToneOscillator tone;
+    tone.setFreq(10);
+    tone.setAmplitude(0.01, true);
     //Transcoder_SLIN_48K trans;
 
     for (unsigned i = 0; i < ms / 20; i++) {
@@ -78,10 +79,7 @@ static void queueComfortNoise(const Message& req, unsigned ms,
         int16_t pcm48k[BLOCK_SIZE_48K];
 
         // For now we are using a low tone
-        for (unsigned j = 0; j < BLOCK_SIZE_48K; j++) {
-            pcm48k[j] = amp * 32767.0f * std::cos(phi);
-            phi += omega;
-        }
+        tone.generate(pcm48k, BLOCK_SIZE_48K);
 
         /*
         // Transcode to SLIN 48K
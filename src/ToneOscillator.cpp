@@ -0,0 +1,105 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <algorithm>
+
+#include "amp/ToneOscillator.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+static const unsigned TABLE_BITS = 10;
+static const unsigned TABLE_SIZE = 1 << TABLE_BITS;
+static const int32_t AMP_ONE = 1 << 30;
+
+struct CosTable {
+    // One extra entry so that interpolation never needs to wrap
+    int16_t v[TABLE_SIZE + 1];
+
+    CosTable() {
+        for (unsigned i = 0; i <= TABLE_SIZE; i++)
+            v[i] = std::lround(32767.0 * std::cos(2.0 * M_PI * (double)i / (double)TABLE_SIZE));
+    }
+};
+
+static const CosTable& table() {
+    static const CosTable t;
+    return t;
+}
+
+ToneOscillator::ToneOscillator(unsigned sampleRate) 
+:   _sampleRate(sampleRate) {
+    // Make sure the table is built before the first audio tick
+    table();
+}
+
+void ToneOscillator::reset() {
+    _phase = 0;
+    _amp = 0;
+    _ampStep = 0;
+    _ampTarget = 0;
+    _rampLeft = 0;
+}
+
+void ToneOscillator::setFreq(float hz) {
+    _phaseInc = (uint32_t)std::llround((double)hz / (double)_sampleRate * 4294967296.0);
+}
+
+void ToneOscillator::setAmplitude(float amp, bool immediate) {
+    _ampTarget = std::clamp(amp, 0.0f, 1.0f) * (float)AMP_ONE;
+    if (immediate || _rampSamples == 0) {
+        _amp = _ampTarget;
+        _ampStep = 0;
+        _rampLeft = 0;
+    } else {
+        _ampStep = (_ampTarget - _amp) / (int32_t)_rampSamples;
+        _rampLeft = _rampSamples;
+    }
+}
+
+int32_t ToneOscillator::_next() {
+
+    const int16_t* t = table().v;
+    // Top bits select the table entry, the next 15 bits interpolate
+    const unsigned i = _phase >> (32 - TABLE_BITS);
+    const int32_t frac = (_phase >> (32 - TABLE_BITS - 15)) & 0x7fff;
+    const int32_t c = t[i] + (((int32_t)(t[i + 1] - t[i]) * frac) >> 15);
+    _phase += _phaseInc;
+
+    const int32_t s = ((int64_t)c * (int64_t)_amp) >> 30;
+
+    if (_rampLeft) {
+        if (--_rampLeft == 0)
+            _amp = _ampTarget;
+        else 
+            _amp += _ampStep;
+    }
+    return s;
+}
+
+void ToneOscillator::generate(int16_t* out, unsigned n) {
+    for (unsigned i = 0; i < n; i++)
+        out[i] = _next();
+}
+
+void ToneOscillator::add(int16_t* pcm, unsigned n) {
+    for (unsigned i = 0; i < n; i++)
+        pcm[i] = std::clamp((int32_t)pcm[i] + _next(), (int32_t)-32768, (int32_t)32767);
+}
+
+    }
+}
@@ -16,6 +16,8 @@
  */
 #pragma once
 
+#include <cstdint>
+
 namespace kc1fsz {
 
 class Transcoder {
@@ -36,6 +38,18 @@ public:
      */
     virtual bool encode(const int16_t* sourcePCM, unsigned sourceLen, 
         uint8_t* dest, unsigned destLen) = 0;
+
+    /**
+     * Measures the energy of an encoded frame without decoding it (i.e.
+     * directly in the "code domain"). This is much cheaper than a full 
+     * decode and is used to find silent frames early.
+     * 
+     * @param sumSquares Set to the sum of the squared PCM16 sample values.
+     * @returns false if this isn't possible for the code (ex: stateful 
+     * codes like G.726 need to be decoded).
+     */
+    virtual bool frameEnergy(const uint8_t* source, unsigned sourceLen, 
+        uint64_t& sumSquares) const { return false; }
 };
 
 }
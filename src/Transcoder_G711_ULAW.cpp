@@ -27,6 +27,43 @@ using namespace std;
 
 namespace kc1fsz {
 
+struct UlawTables {
+    int16_t decode[256];
+    // Indexed by the PCM16 sample (as unsigned) >> 2
+    uint8_t encode[1 << 14];
+    // The squared PCM value for each of the 256 codes. Both zero codes
+    // map to zero energy.
+    uint32_t energy[256];
+
+    UlawTables() {
+        for (unsigned i = 0; i < 256; i++) {
+            decode[i] = decode_ulaw(i);
+            energy[i] = (int32_t)decode[i] * (int32_t)decode[i];
+        }
+        for (unsigned i = 0; i < (1 << 14); i++)
+            encode[i] = encode_ulaw((int16_t)(i << 2));
+    }
+};
+
+static const UlawTables& tables() {
+    static const UlawTables t;
+    return t;
+}
+
+void Transcoder_G711_ULAW::decodeBlock(const uint8_t* source, int16_t* dest, 
+    unsigned n) {
+    const int16_t* t = tables().decode;
+    for (unsigned i = 0; i < n; i++)
+        dest[i] = t[source[i]];
+}
+
+void Transcoder_G711_ULAW::encodeBlock(const int16_t* source, uint8_t* dest, 
+    unsigned n) {
+    const uint8_t* t = tables().encode;
+    for (unsigned i = 0; i < n; i++)
+        dest[i] = t[(uint16_t)source[i] >> 2];
+}
+
 Transcoder_G711_ULAW::Transcoder_G711_ULAW() {
 }
 
@@ -37,8 +74,7 @@ bool Transcoder_G711_ULAW::decode(const uint8_t* source, unsigned sourceLen,
     assert(destLen == BLOCK_SIZE_8K);
     
     // Convert the G711 uLaw encoding into 16-bit PCM audio
-    for (unsigned i = 0; i < BLOCK_SIZE_8K; i++)
-        destPCM[i] = decode_ulaw(source[i]);
+    decodeBlock(source, destPCM, BLOCK_SIZE_8K);
 
     return true;
 }
@@ -50,8 +86,20 @@ bool Transcoder_G711_ULAW::encode(const int16_t* sourcePCM, unsigned sourceLen,
     assert(destLen == BLOCK_SIZE_8K);
 
     // Make an 8k G711 buffer using the CODEC
+    encodeBlock(sourcePCM, g711Buffer, BLOCK_SIZE_8K);
+
+    return true;
+}
+
+bool Transcoder_G711_ULAW::frameEnergy(const uint8_t* source, unsigned sourceLen,
+    uint64_t& sumSquares) const {
+
+    assert(sourceLen == BLOCK_SIZE_8K);
+
+    const uint32_t* energyTable = tables().energy;
+    sumSquares = 0;
     for (unsigned i = 0; i < BLOCK_SIZE_8K; i++)
-        g711Buffer[i] = encode_ulaw(sourcePCM[i]);
+        sumSquares += energyTable[source[i]];
 
     return true;
 }
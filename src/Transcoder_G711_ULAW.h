@@ -27,15 +27,36 @@
 
 namespace kc1fsz {
 
+/**
+ * G.711 u-law. The conversions are table-driven: a 256-entry decode table
+ * and an encode table indexed by the top 14 bits of the PCM16 sample (the
+ * G.711 encoder only looks at 14 bits). Both tables are built from the
+ * reference CODEC so the results are identical.
+ */
 class Transcoder_G711_ULAW : public Transcoder {
 public:
 
+    /**
+     * Decodes any number of samples. Several frames can be converted in 
+     * one pass by laying them out back-to-back.
+     */
+    static void decodeBlock(const uint8_t* source, int16_t* dest, unsigned n);
+
+    /**
+     * Encodes any number of samples. Several frames can be converted in 
+     * one pass by laying them out back-to-back.
+     */
+    static void encodeBlock(const int16_t* source, uint8_t* dest, unsigned n);
+
     Transcoder_G711_ULAW();
 
     virtual bool decode(const uint8_t* source, unsigned sourceLen, 
         int16_t* dest, unsigned destLen);
     virtual bool encode(const int16_t* source, unsigned sourceLen, 
         uint8_t* dest, unsigned destLen);
+
+    virtual bool frameEnergy(const uint8_t* source, unsigned sourceLen, 
+        uint64_t& sumSquares) const;
 };
 
 }
@@ -0,0 +1,54 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+
+#include "Transcoder_PCM_48K.h"
+
+namespace kc1fsz {
+
+bool Transcoder_PCM_48K::decode(const uint8_t* source, unsigned sourceLen, 
+    int16_t* dest, unsigned destLen) {            
+    if (sourceLen != BLOCK_SIZE_48K * 2)
+        return false;
+    if (destLen != BLOCK_SIZE_48K)
+        return false;
+    memcpy(dest, source, BLOCK_SIZE_48K * 2);
+    return true;
+}
+
+bool Transcoder_PCM_48K::encode(const int16_t* source, unsigned sourceLen, 
+    uint8_t* dest, unsigned destLen) {
+    if (sourceLen != BLOCK_SIZE_48K)
+        return false;
+    if (destLen != BLOCK_SIZE_48K * 2)
+        return false;
+    memcpy(dest, source, BLOCK_SIZE_48K * 2);
+    return true;
+}
+
+bool Transcoder_PCM_48K::frameEnergy(const uint8_t* source, unsigned sourceLen,
+    uint64_t& sumSquares) const {
+    if (sourceLen != BLOCK_SIZE_48K * 2)
+        return false;
+    const int16_t* src = (const int16_t*)source;
+    sumSquares = 0;
+    for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
+        sumSquares += (uint32_t)((int32_t)src[i] * (int32_t)src[i]);
+    return true;
+}
+
+}
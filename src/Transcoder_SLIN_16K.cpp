@@ -57,4 +57,17 @@ bool Transcoder_SLIN_16K::encode(const int16_t* source, unsigned sourceLen,
     return true;
 }
 
+bool Transcoder_SLIN_16K::frameEnergy(const uint8_t* source, unsigned sourceLen,
+    uint64_t& sumSquares) const {
+    if (sourceLen != BLOCK_SIZE_16K * 2)
+        return false;
+    sumSquares = 0;
+    const uint8_t* p = source;
+    for (unsigned i = 0; i < BLOCK_SIZE_16K; i++, p += 2) {
+        int32_t v = unpack_int16_le(p);
+        sumSquares += (uint32_t)(v * v);
+    }
+    return true;
+}
+
 }
@@ -48,4 +48,17 @@ bool Transcoder_SLIN_48K::encode(const int16_t* source, unsigned sourceLen,
     return true;
 }
 
+bool Transcoder_SLIN_48K::frameEnergy(const uint8_t* source, unsigned sourceLen,
+    uint64_t& sumSquares) const {
+    if (sourceLen != BLOCK_SIZE_48K * 2)
+        return false;
+    sumSquares = 0;
+    const uint8_t* p = source;
+    for (unsigned i = 0; i < BLOCK_SIZE_48K; i++, p += 2) {
+        int32_t v = unpack_int16_le(p);
+        sumSquares += (uint32_t)(v * v);
+    }
+    return true;
+}
+
 }
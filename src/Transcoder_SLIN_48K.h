@@ -32,6 +32,9 @@ public:
         int16_t* dest, unsigned destLen);
     virtual bool encode(const int16_t* source, unsigned sourceLen, 
         uint8_t* dest, unsigned destLen);
+
+    virtual bool frameEnergy(const uint8_t* source, unsigned sourceLen, 
+        uint64_t& sumSquares) const;
 };
 
 }
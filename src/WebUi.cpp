@@ -134,6 +134,9 @@ void WebUi::consume(const Message& msg) {
         o["usb-tx-meter"] = payload->tx0Db;
         o["net-rx-meter"] = payload->rx1Db;
         o["net-tx-meter"] = payload->tx1Db;
+        o["usb-rx-peak-hz"] = payload->rx0PeakHz;
+        o["usb-rx-sinad"] = payload->rx0SinadDb;
+        o["usb-rx-hum"] = payload->rx0HumDb;
         _levels.set(o);
     }
 }
@@ -0,0 +1,159 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include "amp/WelchSpectrum.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+// Components below this are treated as hum rather than signal
+static const float MIN_SIGNAL_HZ = 150.0f;
+// The Hann main lobe is +/- 2 bins, plus a little for frequencies
+// that fall between bins.
+static const unsigned SIGNAL_HALF_WIDTH = 3;
+
+WelchSpectrum::WelchSpectrum(unsigned sampleRate, unsigned fftSize,
+    unsigned averageCount)
+:   _sampleRate(sampleRate),
+    _fftSize(fftSize),
+    _hop(fftSize / 2),
+    _averageCount(averageCount),
+    _fft(fftSize),
+    _window(fftSize),
+    _history(fftSize),
+    _frame(fftSize),
+    _re(fftSize / 2 + 1),
+    _im(fftSize / 2 + 1),
+    _psd(fftSize / 2 + 1) {
+
+    assert(averageCount > 0);
+
+    for (unsigned i = 0; i < fftSize; i++) {
+        _window[i] = 0.5f - 0.5f * std::cos(2.0f * (float)M_PI * (float)i / (float)fftSize);
+        _windowPower += _window[i] * _window[i];
+    }
+}
+
+void WelchSpectrum::reset() {
+    _historyPos = 0;
+    _historyCount = 0;
+    _newSamples = 0;
+    std::fill(_psd.begin(), _psd.end(), 0.0f);
+    _frameCount = 0;
+    _ready = false;
+    _peakHz = 0;
+    _peakDbfs = -99;
+    _sinadDb = 0;
+    _humDbfs = -99;
+}
+
+void WelchSpectrum::consume(const int16_t* pcm, unsigned n) {
+    for (unsigned i = 0; i < n; i++) {
+        _history[_historyPos] = pcm[i];
+        _historyPos = (_historyPos + 1) % _fftSize;
+    }
+    _historyCount = std::min(_historyCount + n, _fftSize);
+    _newSamples += n;
+
+    if (_historyCount < _fftSize || _newSamples < _hop)
+        return;
+    // Anything beyond one hop is skipped
+    _newSamples = std::min(_newSamples - _hop, _hop - 1);
+
+    _analyzeFrame();
+    if (++_frameCount == _averageCount) {
+        _publish();
+        std::fill(_psd.begin(), _psd.end(), 0.0f);
+        _frameCount = 0;
+    }
+}
+
+void WelchSpectrum::_analyzeFrame() {
+    // Oldest sample first
+    for (unsigned i = 0; i < _fftSize; i++)
+        _frame[i] = _window[i] * (float)_history[(_historyPos + i) % _fftSize];
+    _fft.transform(_frame.data(), _re.data(), _im.data());
+    for (unsigned k = 0; k <= _fftSize / 2; k++)
+        _psd[k] += _re[k] * _re[k] + _im[k] * _im[k];
+}
+
+float WelchSpectrum::_bandPower(unsigned k0, unsigned k1) const {
+    float sum = 0;
+    for (unsigned k = k0; k <= k1 && k <= _fftSize / 2; k++)
+        sum += _psd[k];
+    return sum;
+}
+
+float WelchSpectrum::_toDbfs(float power) const {
+    // Parseval (one-sided) gives the mean-square of the windowed signal,
+    // which is then compared to a full-scale sine.
+    const float meanSquare = 2.0f * power /
+        ((float)_averageCount * (float)_fftSize * _windowPower);
+    const float fullScale = 32767.0f * 32767.0f / 2.0f;
+    if (meanSquare <= 0)
+        return -99;
+    return std::max(-99.0f, 10.0f * std::log10(meanSquare / fullScale));
+}
+
+void WelchSpectrum::_publish() {
+
+    const float binHz = (float)_sampleRate / (float)_fftSize;
+    const unsigned last = _fftSize / 2;
+
+    // Strongest component above the hum range
+    unsigned kMin = std::max(2U, (unsigned)std::ceil(MIN_SIGNAL_HZ / binHz));
+    unsigned peak = kMin;
+    for (unsigned k = kMin; k < last; k++)
+        if (_psd[k] > _psd[peak])
+            peak = k;
+
+    // Quadratic interpolation on the log power
+    float offset = 0;
+    if (peak > 0 && peak < last && _psd[peak] > 0) {
+        const float a = std::log(_psd[peak - 1] + 1e-9f);
+        const float b = std::log(_psd[peak]);
+        const float c = std::log(_psd[peak + 1] + 1e-9f);
+        const float d = a - 2.0f * b + c;
+        if (d < 0)
+            offset = std::clamp(0.5f * (a - c) / d, -0.5f, 0.5f);
+    }
+    _peakHz = ((float)peak + offset) * binHz;
+
+    const unsigned s0 = peak > SIGNAL_HALF_WIDTH ? peak - SIGNAL_HALF_WIDTH : 0;
+    const float signal = _bandPower(s0, peak + SIGNAL_HALF_WIDTH);
+    _peakDbfs = _toDbfs(signal);
+
+    // Everything except DC (which the window spreads into bin 1)
+    const float total = _bandPower(2, last);
+    const float rest = std::max(total - signal, total * 1e-9f);
+    _sinadDb = (total > 0) ? 10.0f * std::log10(total / rest) : 0;
+
+    // Hum, including the window spread
+    auto humAt = [this, binHz](float hz) {
+        unsigned k = (unsigned)std::lround(hz / binHz);
+        return _toDbfs(_bandPower(k > 1 ? k - 1 : 0, k + 1));
+    };
+    _humDbfs = std::max(humAt(50.0f), humAt(60.0f));
+
+    _ready = true;
+}
+
+    }
+}
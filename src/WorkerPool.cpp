@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cassert>
+
+#include "WorkerPool.h"
+
+using namespace std;
+
+namespace kc1fsz {
+    namespace amp {
+
+WorkerPool::WorkerPool(unsigned threadCount) 
+:   _threadCount(threadCount) {
+    assert(threadCount > 0);
+    // The calling thread is worker 0
+    for (unsigned i = 1; i < _threadCount; i++)
+        _threads.emplace_back(&WorkerPool::_workerLoop, this, i);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _startCv.notify_all();
+    for (auto& t : _threads)
+        t.join();
+}
+
+void WorkerPool::run(unsigned count, const std::function<void(unsigned)>& fn) {
+
+    if (_threadCount == 1) {
+        for (unsigned i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _fn = &fn;
+        _count = count;
+        _pending = _threadCount - 1;
+        _generation++;
+    }
+    _startCv.notify_all();
+
+    // Do our own share 
+    for (unsigned i = 0; i < count; i += _threadCount)
+        fn(i);
+
+    // Wait for everyone else
+    unique_lock<mutex> lock(_mutex);
+    _doneCv.wait(lock, [this]() { return _pending == 0; });
+    _fn = nullptr;
+}
+
+void WorkerPool::_workerLoop(unsigned index) {
+
+    uint64_t lastGeneration = 0;
+
+    while (true) {
+
+        unique_lock<mutex> lock(_mutex);
+        _startCv.wait(lock, [this, lastGeneration]() { 
+            return _stop || _generation != lastGeneration; 
+        });
+        if (_stop)
+            return;
+        lastGeneration = _generation;
+        const std::function<void(unsigned)>* fn = _fn;
+        const unsigned count = _count;
+        lock.unlock();
+
+        for (unsigned i = index; i < count; i += _threadCount)
+            (*fn)(i);
+
+        lock.lock();
+        if (--_pending == 0)
+            _doneCv.notify_one();
+    }
+}
+
+    }
+}
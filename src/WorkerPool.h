@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace kc1fsz {
+    namespace amp {
+
+/**
+ * A small fork/join pool used to spread per-call work across cores. 
+ * Each run() is a barrier: it returns only after every item is finished.
+ * 
+ * Within a run() each item is handled by exactly one thread, so the 
+ * state that belongs to an item never needs to be locked. Nothing is 
+ * promised about which thread that is from one run() to the next.
+ */
+class WorkerPool {
+public:
+
+    /**
+     * @param threadCount The total number of threads, including the 
+     * calling thread which does its share of the work. So 1 means that
+     * everything runs on the calling thread.
+     */
+    WorkerPool(unsigned threadCount);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned getThreadCount() const { return _threadCount; }
+
+    /**
+     * Calls fn(i) for every i in [0, count) and waits for all of 
+     * the calls to finish.
+     */
+    void run(unsigned count, const std::function<void(unsigned)>& fn);
+
+private:
+
+    void _workerLoop(unsigned index);
+
+    const unsigned _threadCount;
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _startCv;
+    std::condition_variable _doneCv;
+    // Incremented on each run() to release the workers
+    uint64_t _generation = 0;
+    // The number of workers that haven't finished the current run()
+    unsigned _pending = 0;
+    bool _stop = false;
+
+    // The current job
+    unsigned _count = 0;
+    const std::function<void(unsigned)>* _fn = nullptr;
+};
+
+    }
+}
@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "amp/Ampersand.h"
+#include "amp/Wsola.h"
+#include "amp/FixedMath.h"
+
+namespace kc1fsz {
+    namespace amp {
+
+#ifdef AMP_FIXED_POINT
+/**
+ * An integer stand-in for the normalized cross-correlation 
+ * ab / sqrt(aa * bb) that sorts the same way. Positive correlations 
+ * are ranked by 2 log2(ab) - log2(aa) - log2(bb), above zero (silence),
+ * above negative correlations.
+ */
+static int64_t correlationScore(int64_t ab, int64_t aa, int64_t bb) {
+    const int64_t ZERO = (int64_t)1 << 40;
+    if (aa == 0 || bb == 0 || ab == 0)
+        return ZERO;
+    const int64_t s = 2 * (int64_t)log2Q16(ab > 0 ? ab : -ab) 
+        - log2Q16(aa) - log2Q16(bb);
+    return (ab > 0) ? 2 * ZERO + s : -s;
+}
+#endif
+
+unsigned Wsola::_bestSplice(const int16_t* a, const int16_t* b, unsigned n) {
+
+    const unsigned len = overlapSize(n);
+    // The search is done at a resolution of about 8K to keep the cost
+    // the same at all rates.
+    const unsigned step = std::max(1U, n / BLOCK_SIZE_8K);
+
+    unsigned best = 0;
+#ifdef AMP_FIXED_POINT
+    int64_t bestScore = INT64_MIN;
+#else
+    float bestScore = -2.0f;
+#endif
+
+    for (unsigned t = 0; t + len <= n; t += step) {
+        // Normalized cross-correlation
+#ifdef AMP_FIXED_POINT
+        int64_t ab = 0, aa = 0, bb = 0;
+        for (unsigned i = 0; i < len; i += step) {
+            int32_t av = a[t + i], bv = b[t + i];
+            ab += av * bv;
+            aa += av * av;
+            bb += bv * bv;
+        }
+        const int64_t score = correlationScore(ab, aa, bb);
+#else
+        float ab = 0, aa = 0, bb = 0;
+        for (unsigned i = 0; i < len; i += step) {
+            float av = a[t + i], bv = b[t + i];
+            ab += av * bv;
+            aa += av * av;
+            bb += bv * bv;
+        }
+        float score = (aa > 0 && bb > 0) ? ab / std::sqrt(aa * bb) : 0;
+#endif
+        if (score > bestScore) {
+            bestScore = score;
+            best = t;
+        }
+    }
+
+    return best;
+}
+
+void Wsola::_crossFade(const int16_t* a, const int16_t* b, unsigned len,
+    int16_t* out) {
+    for (unsigned i = 0; i < len; i++)
+        out[i] = ((int32_t)a[i] * (int32_t)(len - i) + (int32_t)b[i] * (int32_t)i)
+            / (int32_t)len;
+}
+
+void Wsola::compress(const int16_t* x, unsigned n, int16_t* out) {
+    // Play x up to the splice point, then jump forward n samples
+    const unsigned len = overlapSize(n);
+    const unsigned t = _bestSplice(x, x + n, n);
+    memcpy(out, x, t * sizeof(int16_t));
+    _crossFade(x + t, x + n + t, len, out + t);
+    memcpy(out + t + len, x + n + t + len, (n - t - len) * sizeof(int16_t));
+}
+
+void Wsola::expand(const int16_t* x, unsigned n, int16_t* out) {
+    // Play the new block up to the splice point, then jump back n samples
+    // (into the previous block) and play through to the end again.
+    const unsigned len = overlapSize(n);
+    const unsigned t = _bestSplice(x + n, x, n);
+    memcpy(out, x + n, t * sizeof(int16_t));
+    _crossFade(x + n + t, x + t, len, out + t);
+    memcpy(out + t + len, x + t + len, (2 * n - t - len) * sizeof(int16_t));
+}
+
+    }
+}
@@ -0,0 +1,466 @@
+/**
+ * Copyright (C) 2025, Bruce MacKinnon KC1FSZ
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *
+ * Offline replay of the IAX2 voice in a pcap capture (for example the
+ * capture-*.pcap files written by LineIAX2) through the input side of the
+ * Bridge: jitter buffer, PLC, transcoding and resampling. Everything runs
+ * in virtual time using the original arrival timestamps, so a long capture
+ * can be evaluated against several playout settings in a few seconds.
+ *
+ * Each inbound voice stream is identified by the sender's address/port and
+ * source call number. Frames sent by the local node (source address 0.0.0.0
+ * in the LineIAX2 captures) are ignored.
+ *
+ * Example:
+ *
+ *   pcap-replay capture-1760000000.pcap --margins 60,120,200 --wav /tmp/replay
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <cstring>
+
+// 3rd party command-line parser
+#include <argparse/argparse.hpp>
+
+#include "kc1fsz-tools/Common.h"
+
+#include "amp/Ampersand.h"
+#include "amp/SequencingBufferStd.h"
+
+#include "Message.h"
+#include "NullLog.h"
+#include "IAX2Util.h"
+#include "BridgeIn.h"
+#include "tests/TestClock.h"
+
+using namespace std;
+using namespace kc1fsz;
+
+static const char* VERSION = "20260301.0";
+
+// The link types that can be found in the captures
+#define LINKTYPE_ETHERNET (1)
+#define LINKTYPE_RAW (101)
+#define LINKTYPE_LINUX_SLL (113)
+
+// IAX2 frame type for voice
+#define IAX2_TYPE_VOICE (2)
+
+struct VoiceFrame {
+    // Arrival time relative to the start of the capture
+    uint32_t rxMs;
+    uint32_t origMs;
+    vector<uint8_t> body;
+};
+
+struct VoiceStream {
+    uint32_t addr;
+    uint16_t port;
+    uint16_t callId;
+    CODECType codec = CODECType::IAX2_CODEC_UNKNOWN;
+    // Used to extend the mini-frame times
+    uint32_t lastOrigMs = 0;
+    uint32_t lastRxMs = 0;
+    vector<VoiceFrame> frames;
+};
+
+static uint32_t unpack_uint32_le(const uint8_t* p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+/**
+ * Converts the subclass of a voice frame into a CODEC.
+ */
+static CODECType subclassToCodec(uint8_t subclass) {
+    if (subclass & 0x80)
+        return (CODECType)(1 << (subclass & 0x7f));
+    else
+        return (CODECType)subclass;
+}
+
+/**
+ * Pulls the IAX2 voice out of one UDP payload.
+ */
+static void processIAX2(map<tuple<uint32_t, uint16_t, uint16_t>, VoiceStream>& streams,
+    uint32_t addr, uint16_t port, uint32_t rxMs, const uint8_t* buf, unsigned len) {
+
+    if (len < 4)
+        return;
+
+    // Full frame
+    if (buf[0] & 0x80) {
+        if (len < 12 || buf[10] != IAX2_TYPE_VOICE)
+            return;
+        uint16_t callId = unpack_uint16_be(buf) & 0x7fff;
+        VoiceStream& s = streams[{ addr, port, callId }];
+        s.addr = addr;
+        s.port = port;
+        s.callId = callId;
+        s.codec = subclassToCodec(buf[11]);
+        s.lastOrigMs = unpack_uint32_be(buf + 4);
+        s.lastRxMs = rxMs;
+        s.frames.push_back({ rxMs, s.lastOrigMs, vector<uint8_t>(buf + 12, buf + len) });
+    }
+    // Meta frames (trunk, video) are ignored
+    else if (buf[0] == 0 && buf[1] == 0) {
+    }
+    // Mini frame
+    else {
+        uint16_t callId = unpack_uint16_be(buf) & 0x7fff;
+        auto it = streams.find({ addr, port, callId });
+        // The CODEC isn't known until a full voice frame has been seen
+        if (it == streams.end())
+            return;
+        VoiceStream& s = it->second;
+        // Same approach as LineIAX2: the low 16 bits of the remote time are
+        // extended using our best guess at the full remote time.
+        uint32_t origMs = amp::SequencingBufferStd<MessageCarrier>::extendTime(
+            unpack_uint16_be(buf + 2), s.lastOrigMs + (rxMs - s.lastRxMs));
+        s.lastOrigMs = origMs;
+        s.lastRxMs = rxMs;
+        s.frames.push_back({ rxMs, origMs, vector<uint8_t>(buf + 4, buf + len) });
+    }
+}
+
+/**
+ * Reads all of the inbound IAX2 voice streams from a capture file.
+ * @returns 0 on success, -1 on error.
+ */
+static int readCapture(const char* fn,
+    map<tuple<uint32_t, uint16_t, uint16_t>, VoiceStream>& streams) {
+
+    ifstream f(fn, ios::binary);
+    if (!f.good()) {
+        cerr << "Unable to open " << fn << endl;
+        return -1;
+    }
+
+    // See https://www.ietf.org/archive/id/draft-gharris-opsawg-pcap-01.html
+    uint8_t header[24];
+    if (!f.read((char*)header, 24))
+        return -1;
+    // The magic number tells us the byte order and the time resolution
+    bool bigEndian, nanos;
+    if (unpack_uint32_be(header) == 0xA1B2C3D4)
+        bigEndian = true, nanos = false;
+    else if (unpack_uint32_be(header) == 0xA1B23C4D)
+        bigEndian = true, nanos = true;
+    else if (unpack_uint32_le(header) == 0xA1B2C3D4)
+        bigEndian = false, nanos = false;
+    else if (unpack_uint32_le(header) == 0xA1B23C4D)
+        bigEndian = false, nanos = true;
+    else {
+        cerr << "Not a pcap file" << endl;
+        return -1;
+    }
+    auto u32 = [bigEndian](const uint8_t* p) {
+        return bigEndian ? unpack_uint32_be(p) : unpack_uint32_le(p);
+    };
+    const uint32_t linkType = u32(header + 20) & 0xffff;
+    unsigned linkHeaderLen;
+    if (linkType == LINKTYPE_RAW)
+        linkHeaderLen = 0;
+    else if (linkType == LINKTYPE_ETHERNET)
+        linkHeaderLen = 14;
+    else if (linkType == LINKTYPE_LINUX_SLL)
+        linkHeaderLen = 16;
+    else {
+        cerr << "Unsupported link type " << linkType << endl;
+        return -1;
+    }
+
+    bool first = true;
+    uint64_t startUs = 0;
+    vector<uint8_t> packet;
+
+    while (true) {
+
+        uint8_t recHeader[16];
+        if (!f.read((char*)recHeader, 16))
+            break;
+        uint64_t us = (uint64_t)u32(recHeader) * 1000000ULL +
+            (nanos ? u32(recHeader + 4) / 1000 : u32(recHeader + 4));
+        uint32_t inclLen = u32(recHeader + 8);
+        if (inclLen > 65536) {
+            cerr << "Bad record length" << endl;
+            return -1;
+        }
+        packet.resize(inclLen);
+        if (!f.read((char*)packet.data(), inclLen))
+            break;
+
+        if (first) {
+            startUs = us;
+            first = false;
+        }
+        const uint32_t rxMs = (us - startUs) / 1000;
+
+        // IPv4/UDP only
+        if (inclLen < linkHeaderLen + 28)
+            continue;
+        const uint8_t* ip = packet.data() + linkHeaderLen;
+        if (linkType == LINKTYPE_ETHERNET && unpack_uint16_be(ip - 2) != 0x0800)
+            continue;
+        if (linkType == LINKTYPE_LINUX_SLL && unpack_uint16_be(ip - 2) != 0x0800)
+            continue;
+        if ((ip[0] >> 4) != 4 || ip[9] != 17)
+            continue;
+        const unsigned ihl = (ip[0] & 0x0f) * 4;
+        if (inclLen < linkHeaderLen + ihl + 8)
+            continue;
+        const uint32_t saddr = unpack_uint32_be(ip + 12);
+        // Our own transmissions
+        if (saddr == 0)
+            continue;
+        const uint8_t* udp = ip + ihl;
+        const uint16_t sport = unpack_uint16_be(udp);
+        const unsigned udpLen = std::min((unsigned)unpack_uint16_be(udp + 4),
+            inclLen - linkHeaderLen - ihl);
+        if (udpLen < 8)
+            continue;
+        processIAX2(streams, saddr, sport, rxMs, udp + 8, udpLen - 8);
+    }
+
+    return 0;
+}
+
+/**
+ * Minimal mono 16-bit WAV writer
+ */
+class WavWriter {
+public:
+
+    bool open(const string& fn, unsigned rate) {
+        _f.open(fn, ios::binary);
+        _rate = rate;
+        _samples = 0;
+        uint8_t header[44] = { 0 };
+        _f.write((const char*)header, 44);
+        return _f.good();
+    }
+
+    void write(const int16_t* pcm, unsigned n) {
+        for (unsigned i = 0; i < n; i++) {
+            uint8_t b[2];
+            pack_int16_le(pcm[i], b);
+            _f.write((const char*)b, 2);
+        }
+        _samples += n;
+    }
+
+    void close() {
+        uint8_t h[44];
+        auto le32 = [](uint32_t v, uint8_t* p) {
+            p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+        };
+        memcpy(h, "RIFF", 4);
+        le32(36 + _samples * 2, h + 4);
+        memcpy(h + 8, "WAVEfmt ", 8);
+        le32(16, h + 16);
+        // PCM, mono
+        le32(0x00010001, h + 20);
+        le32(_rate, h + 24);
+        le32(_rate * 2, h + 28);
+        // Block align 2, 16 bits
+        le32(0x00100002, h + 32);
+        memcpy(h + 36, "data", 4);
+        le32(_samples * 2, h + 40);
+        _f.seekp(0);
+        _f.write((const char*)h, 44);
+        _f.close();
+    }
+
+private:
+
+    ofstream _f;
+    unsigned _rate = 0;
+    uint32_t _samples = 0;
+};
+
+struct ReplayResult {
+    unsigned frames = 0;
+    unsigned played = 0;
+    unsigned late = 0;
+    unsigned interpolated = 0;
+    unsigned overflow = 0;
+    unsigned compressed = 0;
+    unsigned expanded = 0;
+    float avgDelay = 0;
+    int32_t maxDelay = 0;
+};
+
+/**
+ * Runs one stream through a BridgeIn in virtual time.
+ */
+static ReplayResult replay(const VoiceStream& s, unsigned margin, bool adaptive,
+    const string& wavFn) {
+
+    NullLog log;
+    TestClock clock;
+    amp::BridgeIn in;
+    in.init(&log, nullptr, &clock);
+
+    WavWriter wav;
+    bool wavOpen = !wavFn.empty() && wav.open(wavFn, 48000);
+    bool gotOutput = false;
+
+    in.setSink([&wav, &wavOpen, &gotOutput](const Message& msg) {
+        if (wavOpen && msg.getFormat() == CODECType::IAX2_CODEC_SLIN_48K) {
+            int16_t pcm[BLOCK_SIZE_48K];
+            for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
+                pcm[i] = unpack_int16_le(msg.body() + i * 2);
+            wav.write(pcm, BLOCK_SIZE_48K);
+        }
+        gotOutput = true;
+    });
+    in.setCodec(s.codec);
+    in.setJitterBufferInitialMargin(margin);
+    in.setAdaptiveJitterBuffer(adaptive);
+    in.setKerchunkFilterEnabled(false);
+
+    // Local time is offset a bit to stay away from zero
+    const uint32_t base = 1000;
+    const uint32_t endMs = s.frames.back().rxMs + 2000;
+    in.setStartTime(base);
+
+    unsigned next = 0;
+    for (uint32_t t = 0; t < endMs; t += 20) {
+        // Deliver everything that arrived before this tick
+        while (next < s.frames.size() && s.frames[next].rxMs <= t) {
+            const VoiceFrame& vf = s.frames[next++];
+            clock.setTime(base + vf.rxMs);
+            MessageWrapper msg(Message::Type::AUDIO, s.codec, vf.body.size(),
+                vf.body.data(), vf.origMs, base + vf.rxMs);
+            in.consume(msg);
+        }
+        clock.setTime(base + t);
+        gotOutput = false;
+        in.audioRateTick(base + t);
+        // Keep the audio file in step with time
+        if (wavOpen && !gotOutput) {
+            int16_t silence[BLOCK_SIZE_48K] = { 0 };
+            wav.write(silence, BLOCK_SIZE_48K);
+        }
+    }
+
+    if (wavOpen)
+        wav.close();
+
+    const amp::SequencingBufferRing& jb = in.getJitterBuffer();
+    ReplayResult r;
+    r.frames = s.frames.size();
+    r.played = jb.getVoicePlayoutCount();
+    r.late = jb.getLateVoiceFrameCount();
+    r.interpolated = jb.getInterpolatedVoiceFrameCount();
+    r.overflow = jb.getOverflowCount();
+    r.compressed = jb.getCompressCount();
+    r.expanded = jb.getExpandCount();
+    r.avgDelay = jb.getAverageAddedDelay();
+    r.maxDelay = jb.getMaxAddedDelay();
+    return r;
+}
+
+int main(int argc, const char** argv) {
+
+    argparse::ArgumentParser program("pcap-replay", VERSION);
+
+    program.add_argument("capture")
+        .help("pcap file with IAX2 traffic");
+
+    string margins;
+    program.add_argument("--margins")
+        .store_into(margins)
+        .default_value(string("40,100,200"))
+        .help("Comma-separated list of jitter buffer margins (ms) to try");
+
+    string adaptiveMode;
+    program.add_argument("--adaptive")
+        .store_into(adaptiveMode)
+        .default_value(string("both"))
+        .help("Adaptive playout: off, on or both");
+
+    string wavPrefix;
+    program.add_argument("--wav")
+        .store_into(wavPrefix)
+        .default_value(string(""))
+        .help("Export the decoded audio (48K WAV) to files starting with this prefix");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::exception& err) {
+        cerr << "Argument error: " << err.what() << endl;
+        std::exit(-2);
+    }
+
+    vector<unsigned> marginList;
+    stringstream ss(margins);
+    string item;
+    while (getline(ss, item, ','))
+        marginList.push_back(std::stoul(item));
+    vector<bool> adaptiveList;
+    if (adaptiveMode == "off" || adaptiveMode == "both")
+        adaptiveList.push_back(false);
+    if (adaptiveMode == "on" || adaptiveMode == "both")
+        adaptiveList.push_back(true);
+    if (marginList.empty() || adaptiveList.empty()) {
+        cerr << "Nothing to do" << endl;
+        return -1;
+    }
+
+    map<tuple<uint32_t, uint16_t, uint16_t>, VoiceStream> streams;
+    if (readCapture(program.get<string>("capture").c_str(), streams) != 0)
+        return -1;
+
+    unsigned streamIx = 0;
+    for (const auto& [key, s] : streams) {
+
+        char addr[32];
+        snprintf(addr, sizeof(addr), "%u.%u.%u.%u:%u", s.addr >> 24, (s.addr >> 16) & 0xff,
+            (s.addr >> 8) & 0xff, s.addr & 0xff, s.port);
+        cout << "Stream " << streamIx << " " << addr << " call " << s.callId
+            << " " << codecName(s.codec) << " frames " << s.frames.size() << endl;
+
+        if (codecSampleRate(s.codec) == 0 || s.frames.empty()) {
+            cout << "  (unsupported CODEC)" << endl;
+            streamIx++;
+            continue;
+        }
+
+        cout << "  margin adaptive  played   late interp     of  comp   exp  avgDelay  maxDelay" << endl;
+        for (unsigned margin : marginList) {
+            for (bool adaptive : adaptiveList) {
+                string wavFn;
+                if (!wavPrefix.empty())
+                    wavFn = wavPrefix + "-" + to_string(streamIx) + "-m" + to_string(margin) +
+                        (adaptive ? "a" : "") + ".wav";
+                ReplayResult r = replay(s, margin, adaptive, wavFn);
+                char line[128];
+                snprintf(line, sizeof(line), "  %6u %8s %7u %6u %6u %6u %5u %5u %9.1f %9d",
+                    margin, adaptive ? "yes" : "no", r.played, r.late, r.interpolated,
+                    r.overflow, r.compressed, r.expanded, r.avgDelay, r.maxDelay);
+                cout << line << endl;
+            }
+        }
+        streamIx++;
+    }
+
+    return 0;
+}
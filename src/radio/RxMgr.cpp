@@ -73,7 +73,7 @@ void RxMgr::setAudioDelayMs(unsigned ms) { _audioDelayMs = ms; }
 void RxMgr::setDebounceMs(unsigned ms) { _debounceMs = ms; }
 
 bool RxMgr::run2() {
-
+    return false;
 }
 
 void RxMgr::audioRateTick() {
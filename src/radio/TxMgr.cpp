@@ -49,6 +49,7 @@ void TxMgr::setToneBreak(bool b) {
 // ----- Runnable2 --------------------------------------------------------
 
 bool TxMgr::run2() {
+    return false;
 }
 
 void TxMgr::audioRateTick() {
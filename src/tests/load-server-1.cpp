@@ -76,7 +76,8 @@ int main(int, const char**) {
 
     // Setup the EventLoop with all of the tasks that need to be run on this thread
     Runnable2* tasks[] = { &iax2Channel1 };
-    EventLoop::run(log, clock, 0, 0, tasks, std::size(tasks), nullptr, false);
+    // io_uring is used if the kernel allows it, otherwise poll()
+    EventLoop::run(log, clock, 0, 0, tasks, std::size(tasks), nullptr, false, true);
 
     // #### TODO: At the moment there is no clean way to get out of the loop
 
@@ -1,7 +1,10 @@
 #include <iostream>
 #include <cmath> 
 #include <ctime>
+#include <cstring>
 #include <fstream>
+#include <chrono>
+#include <thread>
 #include <cassert>
 #include <ctime>
 #include <unistd.h>
@@ -13,10 +16,17 @@
 #include "kc1fsz-tools/fixedqueue.h"
 #include "kc1fsz-tools/NetUtils.h"
 #include "kc1fsz-tools/fixed_math.h"
+#include "kc1fsz-tools/threadsafequeue2.h"
 
 #include "itu-g711-codec/codec.h"
 #include "itu-g711-plc/Plc.h"
 #include "amp/Resampler.h"
+#include "amp/MixKernels.h"
+#include "amp/FirKernels.h"
+#include "amp/WelchSpectrum.h"
+#include "amp/ToneOscillator.h"
+#include "amp/FixedMath.h"
+#include "amp/Wsola.h"
 #include "amp/SequencingBufferStd.h"
 
 #include "Message.h"
@@ -26,11 +36,22 @@
 #include "NullConsumer.h"
 #include "KerchunkFilter.h"
 #include "LineIAX2.h"
+#include "LineIAX2Shards.h"
+#include "MultiRouter.h"
+#include "EventLoop.h"
 #include "voter/VoterUtil.h"
 #include "TestUtil.h"
 #include "dsp_util.h"
 #include "WebUi.h"
+#include "LatencyHistogram.h"
+#include "SequencingBufferRing.h"
 #include "LineRadio.h"
+#include "Transcoder_G711_ULAW.h"
+#include "CodecPipeline.h"
+#include "CallIndex.h"
+#include "SpscQueue.h"
+#include "IoUring.h"
+#include "DeferredLog.h"
 
 using namespace std;
 using namespace kc1fsz;
@@ -149,6 +170,76 @@ static void resampler_1() {
     amp::Resampler resampler;
 }
 
+/**
+ * A 1kHz tone taken from 8K up to 16K and back down should keep 
+ * its level.
+ */
+static void resampler_2() {
+    amp::Resampler up, down;
+    up.setRates(8000, 16000);
+    down.setRates(16000, 8000);
+    assert(up.getOutBlockSize() == BLOCK_SIZE_16K);
+    assert(down.getOutBlockSize() == BLOCK_SIZE_8K);
+    unsigned n = 0;
+    for (unsigned block = 0; block < 4; block++) {
+        int16_t pcm8k[BLOCK_SIZE_8K];
+        for (unsigned i = 0; i < BLOCK_SIZE_8K; i++, n++)
+            pcm8k[i] = 10000.0f * std::sin(2.0f * 3.14159f * 1000.0f * (float)n / 8000.0f);
+        int16_t pcm16k[BLOCK_SIZE_16K];
+        up.resample(pcm8k, BLOCK_SIZE_8K, pcm16k, BLOCK_SIZE_16K);
+        int16_t pcm8k_2[BLOCK_SIZE_8K];
+        down.resample(pcm16k, BLOCK_SIZE_16K, pcm8k_2, BLOCK_SIZE_8K);
+        // Skip the first block while the filters fill up
+        if (block > 0) {
+            int16_t peak = 0;
+            for (unsigned i = 0; i < BLOCK_SIZE_8K; i++)
+                peak = std::max(peak, pcm8k_2[i]);
+            assert(peak > 9000 && peak < 11000);
+        }
+    }
+}
+
+/**
+ * The polyphase interpolators must produce exactly what the original
+ * method (zero-order hold to the high rate + full-rate FIR) did.
+ */
+static void resampler_3() {
+    struct Case { unsigned inRate, outRate, factor, taps; const int16_t* coeffs; };
+    const Case cases[] = {
+        { 8000, 48000, 6, amp::Resampler::F1_TAPS, amp::Resampler::F1_COEFFS },
+        { 16000, 48000, 3, amp::Resampler::F16_TAPS, amp::Resampler::F16_COEFFS },
+        { 8000, 16000, 2, amp::Resampler::F8_TAPS, amp::Resampler::F8_COEFFS }
+    };
+    for (const Case& c : cases) {
+        amp::Resampler r;
+        r.setRates(c.inRate, c.outRate);
+        const unsigned inSize = r.getInBlockSize(), outSize = r.getOutBlockSize();
+        assert(inSize * c.factor == outSize);
+
+        arm_fir_instance_q15 ref;
+        int16_t refState[amp::Resampler::F1_TAPS + BLOCK_SIZE_48K - 1] = { 0 };
+        arm_fir_init_q15(&ref, c.taps, c.coeffs, refState, outSize);
+
+        unsigned n = 0;
+        for (unsigned block = 0; block < 5; block++) {
+            // Tone + full-scale steps to exercise the saturation
+            int16_t in[BLOCK_SIZE_16K];
+            for (unsigned i = 0; i < inSize; i++, n++)
+                in[i] = (block == 3) ? ((i / 7) % 2 ? 32767 : -32768) : 
+                    12000.0f * std::sin(2.0f * 3.14159f * 1200.0f * (float)n / (float)c.inRate);
+            int16_t held[BLOCK_SIZE_48K];
+            for (unsigned i = 0; i < outSize; i++)
+                held[i] = in[i / c.factor];
+            int16_t expected[BLOCK_SIZE_48K];
+            arm_fir_q15(&ref, held, expected, outSize);
+            int16_t got[BLOCK_SIZE_48K];
+            r.resample(in, inSize, got, outSize);
+            for (unsigned i = 0; i < outSize; i++)
+                assert(got[i] == expected[i]);
+        }
+    }
+}
+
 static void testRound() {
     assert(amp::SequencingBufferStd<MessageCarrier>::roundDownToTick(6755, 20) == 6740);
     assert(amp::SequencingBufferStd<MessageCarrier>::roundDownToTick(6752, 20) == 6740);
@@ -163,6 +254,7 @@ static void sizeCheck1() {
     cout << "BridgeCall       " << sizeof(amp::BridgeCall) << endl;
     cout << "BridgeIn         " << sizeof(amp::BridgeIn) << endl;
     cout << "SequencingBuffer " << sizeof(amp::SequencingBufferStd<MessageCarrier>) << endl;
+    cout << "SeqBufferRing    " << sizeof(amp::SequencingBufferRing) << endl;
     cout << "KerchunkFilter   " << sizeof(KerchunkFilter) << endl;
     cout << "Resampler        " << sizeof(amp::Resampler) << endl;
     cout << "Plc              " << sizeof(Plc) << endl;
@@ -434,6 +526,1432 @@ static void courtesyToneTest() {
     assert(steps.at(1).amp == 2048);
 }
 
+/**
+ * Makes sure that every SIMD mixing kernel supported by this CPU is 
+ * bit-exact with the scalar reference, including the odd tail lengths
+ * and the saturation limits.
+ */
+static void mixKernelTest() {
+
+    const unsigned maxN = BLOCK_SIZE_48K + 13;
+    int16_t in[maxN], in2[maxN];
+    // Simple LCG so that the test is repeatable
+    uint32_t r = 1;
+    for (unsigned i = 0; i < maxN; i++) {
+        r = r * 1103515245 + 12345;
+        in[i] = r >> 16;
+        r = r * 1103515245 + 12345;
+        in2[i] = r >> 16;
+    }
+    // Make sure the extremes are in there
+    in[0] = 32767; in[1] = -32768; in[2] = -1; in[3] = 1;
+
+    const int16_t scales_q15[] = { 0x7fff, 0x7fff / 2, 0x7fff / 7, 1, 0, -0x7fff };
+    const int16_t scales_q11[] = { 2048, -2048, 1024, 4095, -4096, 0, 32767 };
+    const unsigned lengths[] = { 0, 1, 7, 8, 15, 16, 17, 31, BLOCK_SIZE_48K, maxN };
+    const amp::MixKernels::Backend backends[] = { 
+        amp::MixKernels::Backend::SSE2, amp::MixKernels::Backend::AVX2, 
+        amp::MixKernels::Backend::NEON };
+
+    const amp::MixKernels& ref = amp::MixKernels::get(amp::MixKernels::Backend::SCALAR);
+
+    for (auto backend : backends) {
+        if (!amp::MixKernels::isSupported(backend))
+            continue;
+        const amp::MixKernels& k = amp::MixKernels::get(backend);
+        cout << "Testing mix kernels: " << k.name << endl;
+
+        for (unsigned n : lengths) {
+            for (int16_t s15 : scales_q15) {
+                for (int16_t s11 : scales_q11) {
+                    // Accumulate a few times so that the accumulator goes 
+                    // outside of the int16 range.
+                    int32_t acc0[maxN], acc1[maxN];
+                    for (unsigned i = 0; i < maxN; i++)
+                        acc0[i] = acc1[i] = (int32_t)in2[i] * 3;
+                    for (unsigned j = 0; j < 3; j++) {
+                        ref.scaleAccumulate(acc0, in, n, s15, s11);
+                        k.scaleAccumulate(acc1, in, n, s15, s11);
+                    }
+                    assert(memcmp(acc0, acc1, sizeof(acc0)) == 0);
+
+                    int16_t out0[maxN] = { 0 }, out1[maxN] = { 0 };
+                    ref.narrowSaturate(out0, acc0, n);
+                    k.narrowSaturate(out1, acc1, n);
+                    assert(memcmp(out0, out1, sizeof(out0)) == 0);
+                }
+            }
+
+            int16_t out0[maxN] = { 0 }, out1[maxN] = { 0 };
+            ref.blendHalf(out0, in, in2, n);
+            k.blendHalf(out1, in, in2, n);
+            assert(memcmp(out0, out1, sizeof(out0)) == 0);
+        }
+    }
+
+    // Saturation check
+    int32_t acc[4] = { 40000, -40000, 32767, -32768 };
+    int16_t out[4];
+    amp::MixKernels::get().narrowSaturate(out, acc, 4);
+    assert(out[0] == 32767 && out[1] == -32768 && out[2] == 32767 && out[3] == -32768);
+}
+
+/**
+ * Makes sure that every SIMD FIR kernel supported by this CPU is bit-exact 
+ * with the CMSIS FIR and decimation functions, including the saturation 
+ * limits and tap counts that aren't a multiple of the vector width.
+ */
+static void firKernelTest() {
+
+    const unsigned maxTaps = amp::Resampler::F1_TAPS;
+    int16_t x[maxTaps + BLOCK_SIZE_48K];
+    uint32_t r = 7;
+    for (unsigned i = 0; i < maxTaps + BLOCK_SIZE_48K; i++) {
+        r = r * 1103515245 + 12345;
+        x[i] = r >> 16;
+    }
+    // Full-scale runs to drive the output into saturation
+    for (unsigned i = 100; i < 200; i++)
+        x[i] = (i / 3) % 2 ? 32767 : -32768;
+
+    struct Case { const int16_t* coeffs; unsigned taps; unsigned step; };
+    const Case cases[] = {
+        { amp::Resampler::F1_COEFFS, amp::Resampler::F1_TAPS, 1 },
+        { amp::Resampler::F2_COEFFS, amp::Resampler::F2_TAPS, 6 },
+        { amp::Resampler::F16_COEFFS, amp::Resampler::F16_TAPS, 3 },
+        { amp::Resampler::F8_COEFFS, amp::Resampler::F8_TAPS, 2 },
+        { amp::Resampler::F8_COEFFS + 3, 9, 1 }
+    };
+    const amp::FirKernels::Backend backends[] = { 
+        amp::FirKernels::Backend::SCALAR, amp::FirKernels::Backend::SSE2, 
+        amp::FirKernels::Backend::AVX2, amp::FirKernels::Backend::NEON };
+
+    for (auto backend : backends) {
+        if (!amp::FirKernels::isSupported(backend))
+            continue;
+        const amp::FirKernels& k = amp::FirKernels::get(backend);
+        cout << "Testing FIR kernels: " << k.name << endl;
+
+        for (const Case& c : cases) {
+            const unsigned n = BLOCK_SIZE_48K / c.step;
+            // The CMSIS reference
+            int16_t state[maxTaps + BLOCK_SIZE_48K - 1];
+            memcpy(state, x, (c.taps - 1) * sizeof(int16_t));
+            int16_t expected[BLOCK_SIZE_48K];
+            if (c.step == 1) {
+                arm_fir_instance_q15 f;
+                arm_fir_init_q15(&f, c.taps, c.coeffs, state, BLOCK_SIZE_48K);
+                arm_fir_q15(&f, x + c.taps - 1, expected, BLOCK_SIZE_48K);
+            } else {
+                arm_fir_decimate_instance_q15 f;
+                arm_fir_decimate_init_q15(&f, c.taps, c.step, c.coeffs, state, BLOCK_SIZE_48K);
+                arm_fir_decimate_q15(&f, x + c.taps - 1, expected, BLOCK_SIZE_48K);
+            }
+            int16_t got[BLOCK_SIZE_48K];
+            k.fir(got, 1, x, c.step, c.coeffs, c.taps, n);
+            assert(memcmp(got, expected, n * sizeof(int16_t)) == 0);
+
+            // Strided output (one phase of an interpolator)
+            int16_t strided[BLOCK_SIZE_48K * 2] = { 0 };
+            k.fir(strided + 1, 2, x, c.step, c.coeffs, c.taps, n);
+            for (unsigned i = 0; i < n; i++)
+                assert(strided[2 * i] == 0 && strided[2 * i + 1] == expected[i]);
+        }
+    }
+}
+
+/**
+ * Throughput of the FIR kernels on the 48K->8K decimation that runs for 
+ * every 8K call on the conference bridge.
+ */
+static void firKernelSpeedTest() {
+
+    int16_t x[amp::Resampler::F2_TAPS + BLOCK_SIZE_48K];
+    for (unsigned i = 0; i < amp::Resampler::F2_TAPS + BLOCK_SIZE_48K; i++)
+        x[i] = 10000.0f * std::sin(2.0f * 3.14159f * 440.0f * (float)i / 48000.0f);
+    const unsigned blocks = 5000;
+
+    const amp::FirKernels::Backend backends[] = { 
+        amp::FirKernels::Backend::SCALAR, amp::FirKernels::Backend::SSE2, 
+        amp::FirKernels::Backend::AVX2, amp::FirKernels::Backend::NEON };
+
+    for (auto backend : backends) {
+        if (!amp::FirKernels::isSupported(backend))
+            continue;
+        const amp::FirKernels& k = amp::FirKernels::get(backend);
+        int16_t out[BLOCK_SIZE_8K];
+        int32_t check = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned b = 0; b < blocks; b++) {
+            k.fir(out, 1, x, 6, amp::Resampler::F2_COEFFS, amp::Resampler::F2_TAPS, 
+                BLOCK_SIZE_8K);
+            check += out[b % BLOCK_SIZE_8K];
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        cout << "FIR kernel " << k.name << " " << (1000.0 * us / blocks) 
+            << " ns/block (" << check << ")" << endl;
+    }
+}
+
+/**
+ * The table-driven u-law conversions must match the reference CODEC for
+ * every possible input.
+ */
+static void ulawTableTest() {
+    for (unsigned i = 0; i < 256; i++) {
+        uint8_t code = i;
+        int16_t pcm;
+        Transcoder_G711_ULAW::decodeBlock(&code, &pcm, 1);
+        assert(pcm == decode_ulaw(code));
+    }
+    for (int i = -32768; i <= 32767; i++) {
+        int16_t pcm = i;
+        uint8_t code;
+        Transcoder_G711_ULAW::encodeBlock(&pcm, &code, 1);
+        assert(code == encode_ulaw(pcm));
+    }
+
+    // Several frames in one pass give the same result as one at a time
+    const unsigned frames = 3;
+    int16_t pcm[frames * BLOCK_SIZE_8K];
+    for (unsigned i = 0; i < frames * BLOCK_SIZE_8K; i++)
+        pcm[i] = 20000.0f * std::sin(2.0f * 3.14159f * (300.0f + 50.0f * i / BLOCK_SIZE_8K) * 
+            (float)i / 8000.0f);
+    uint8_t batch[frames * BLOCK_SIZE_8K];
+    Transcoder_G711_ULAW::encodeBlock(pcm, batch, frames * BLOCK_SIZE_8K);
+    Transcoder_G711_ULAW t;
+    for (unsigned f = 0; f < frames; f++) {
+        uint8_t code[BLOCK_SIZE_8K];
+        t.encode(pcm + f * BLOCK_SIZE_8K, BLOCK_SIZE_8K, code, BLOCK_SIZE_8K);
+        assert(memcmp(code, batch + f * BLOCK_SIZE_8K, BLOCK_SIZE_8K) == 0);
+        int16_t out[BLOCK_SIZE_8K], outBatch[frames * BLOCK_SIZE_8K];
+        t.decode(code, BLOCK_SIZE_8K, out, BLOCK_SIZE_8K);
+        Transcoder_G711_ULAW::decodeBlock(batch, outBatch, frames * BLOCK_SIZE_8K);
+        assert(memcmp(out, outBatch + f * BLOCK_SIZE_8K, sizeof(out)) == 0);
+    }
+}
+
+/**
+ * The real FFT must agree with a direct DFT, and the Welch estimate must 
+ * find a test tone and the hum mixed in with it.
+ */
+static void spectrumTest() {
+
+    const unsigned n = 64;
+    amp::RealFft fft(n);
+    float x[n], re[n / 2 + 1], im[n / 2 + 1];
+    for (unsigned i = 0; i < n; i++)
+        x[i] = std::sin(0.3f * i) + 0.25f * std::cos(1.7f * i) + ((i % 5) == 0 ? 0.5f : 0.0f);
+    fft.transform(x, re, im);
+    for (unsigned k = 0; k <= n / 2; k++) {
+        double dr = 0, di = 0;
+        for (unsigned i = 0; i < n; i++) {
+            dr += x[i] * std::cos(2.0 * M_PI * k * i / n);
+            di -= x[i] * std::sin(2.0 * M_PI * k * i / n);
+        }
+        assert(std::fabs(re[k] - dr) < 1e-3 && std::fabs(im[k] - di) < 1e-3);
+    }
+
+    // 1004 Hz at -6 dBFS with 60 Hz hum at -40 dBFS
+    amp::WelchSpectrum spectrum(8000, 2048, 4);
+    unsigned t = 0;
+    for (unsigned block = 0; block < 400 && !spectrum.isReady(); block++) {
+        int16_t pcm[BLOCK_SIZE_8K];
+        for (unsigned i = 0; i < BLOCK_SIZE_8K; i++, t++)
+            pcm[i] = 16384.0f * std::sin(2.0f * (float)M_PI * 1004.0f * (float)t / 8000.0f) + 
+                327.0f * std::sin(2.0f * (float)M_PI * 60.0f * (float)t / 8000.0f);
+        spectrum.consume(pcm, BLOCK_SIZE_8K);
+    }
+    assert(spectrum.isReady());
+    assert(std::fabs(spectrum.getPeakFrequency() - 1004.0f) < 2.0f);
+    assert(std::fabs(spectrum.getPeakDbfs() + 6.0f) < 0.5f);
+    assert(std::fabs(spectrum.getHumDbfs() + 40.0f) < 1.0f);
+    assert(spectrum.getSinadDb() > 30.0f && spectrum.getSinadDb() < 40.0f);
+
+    spectrum.reset();
+    assert(!spectrum.isReady());
+}
+
+/**
+ * The NCO must track an exact cosine and ramp the amplitude without
+ * a step.
+ */
+static void toneOscillatorTest() {
+    amp::ToneOscillator tone;
+    tone.setFreq(1004);
+    tone.setAmplitude(0.5, true);
+    int16_t pcm[BLOCK_SIZE_48K];
+    for (unsigned block = 0, t = 0; block < 50; block++) {
+        tone.generate(pcm, BLOCK_SIZE_48K);
+        for (unsigned i = 0; i < BLOCK_SIZE_48K; i++, t++) {
+            double expected = 0.5 * 32767.0 * std::cos(2.0 * M_PI * 1004.0 * t / 48000.0);
+            assert(std::fabs(pcm[i] - expected) <= 2.0);
+        }
+    }
+
+    // Ramp down to silence
+    tone.setRampSamples(BLOCK_SIZE_48K);
+    tone.setAmplitude(0);
+    assert(!tone.isSilent());
+    tone.generate(pcm, BLOCK_SIZE_48K);
+    for (unsigned i = 1; i < BLOCK_SIZE_48K; i++)
+        assert(std::abs(pcm[i] - pcm[i - 1]) < 2500);
+    assert(tone.isSilent());
+    tone.generate(pcm, BLOCK_SIZE_48K);
+    for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
+        assert(pcm[i] == 0);
+
+    // Adding saturates rather than wrapping
+    tone.setFreq(0);
+    tone.setAmplitude(1.0, true);
+    int16_t loud[4] = { 32000, 32000, 32000, 32000 };
+    tone.add(loud, 4);
+    for (unsigned i = 0; i < 4; i++)
+        assert(loud[i] == 32767);
+}
+
+/**
+ * The integer log/exp helpers used by the fixed-point profile.
+ */
+static void fixedMathTest() {
+    for (uint64_t x = 1; x < ((uint64_t)1 << 48); x = x * 3 / 2 + 1)
+        assert(std::fabs(amp::log2Q16(x) / 65536.0 - std::log2((double)x)) < 4.0 / 65536.0);
+    // A full-scale 960-sample frame
+    const uint64_t fullScale = (uint64_t)BLOCK_SIZE_48K * 32767 * 32767;
+    for (uint64_t sumSquares = 1; sumSquares < fullScale; sumSquares = sumSquares * 7 / 5 + 3) {
+        double expected = 10.0 * std::log10((double)sumSquares / (double)fullScale);
+        assert(std::fabs(amp::powerRatioDbQ8(sumSquares, fullScale) / 256.0 - expected) < 0.01);
+    }
+    assert(amp::powerRatioDbQ8(0, fullScale) == amp::MIN_DB_Q8);
+    // Half scale is -6.02 dB
+    assert(std::abs(amp::amplitudeRatioDbQ8(16384, 32767) + 1541) <= 1);
+    // Unity gain and the echo gains in Q11
+    assert(amp::dbToGainQ(0, 11) == 2048);
+    for (int db = -40; db <= 20; db++) {
+        double expected = std::pow(10.0, db / 20.0) * 32768.0;
+        assert(std::fabs(amp::dbToGainQ(db * 256, 15) - expected) <= 1.0 + expected * 0.0001);
+    }
+    // Rounding to whole ticks, halfway cases away from zero
+    assert(amp::SequencingBufferStd<MessageCarrier>::roundToTick(29, 20) == 20);
+    assert(amp::SequencingBufferStd<MessageCarrier>::roundToTick(30, 20) == 40);
+    assert(amp::SequencingBufferStd<MessageCarrier>::roundToTick(-30, 20) == -40);
+    assert(amp::SequencingBufferStd<MessageCarrier>::roundToTick(-29, 20) == -20);
+}
+
+template<CODECType C> static void checkCodecTraits() {
+    assert(CodecTraits<C>::RATE == codecSampleRate(C));
+    assert(CodecTraits<C>::BLOCK_SIZE == codecBlockSize(C));
+    if (CodecTraits<C>::RATE < 48000)
+        assert(CodecTraits<C>::FRAME_SIZE == maxVoiceFrameSize(C));
+}
+
+/**
+ * The compile-time CODEC properties must agree with the run-time ones, and
+ * the pipelines must give the same results as the transcoders.
+ */
+static void codecPipelineTest() {
+    checkCodecTraits<CODECType::IAX2_CODEC_G711_ULAW>();
+    checkCodecTraits<CODECType::IAX2_CODEC_SLIN_8K>();
+    checkCodecTraits<CODECType::IAX2_CODEC_G726_AAL2>();
+    checkCodecTraits<CODECType::IAX2_CODEC_SLIN_16K>();
+    checkCodecTraits<CODECType::IAX2_CODEC_SLIN_48K>();
+    checkCodecTraits<CODECType::IAX2_CODEC_PCM_48K>();
+
+    int16_t pcm48k[BLOCK_SIZE_48K];
+    for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
+        pcm48k[i] = 10000.0f * std::sin(2.0f * 3.14159f * 1000.0f * (float)i / 48000.0f);
+
+    // Encoding to u-law matches resampling and transcoding by hand
+    EncodePipeline<CODECType::IAX2_CODEC_G711_ULAW> encoder;
+    amp::Resampler resampler;
+    resampler.setRates(48000, 8000);
+    Transcoder_G711_ULAW t;
+    for (unsigned f = 0; f < 3; f++) {
+        int16_t pcm8k[BLOCK_SIZE_8K], pcm8k2[BLOCK_SIZE_8K];
+        encoder.resample(pcm48k, BLOCK_SIZE_48K, pcm8k);
+        resampler.resample(pcm48k, BLOCK_SIZE_48K, pcm8k2, BLOCK_SIZE_8K);
+        assert(memcmp(pcm8k, pcm8k2, sizeof(pcm8k)) == 0);
+        uint8_t code[BLOCK_SIZE_8K], code2[BLOCK_SIZE_8K];
+        encoder.encode(pcm8k, code);
+        t.encode(pcm8k2, BLOCK_SIZE_8K, code2, BLOCK_SIZE_8K);
+        assert(memcmp(code, code2, sizeof(code)) == 0);
+    }
+
+    // PCM_48K passes straight through, and interpolation is silence 
+    DecodePipeline<CODECType::IAX2_CODEC_PCM_48K> decoder;
+    MessageWrapper frame(Message::Type::AUDIO, CODECType::IAX2_CODEC_PCM_48K,
+        BLOCK_SIZE_48K * 2, (const uint8_t*)pcm48k, 0, 0);
+    uint64_t sumSquares = 0;
+    assert(decoder.frameEnergy(frame, sumSquares));
+    assert(sumSquares > 0);
+    int16_t out[BLOCK_SIZE_48K];
+    decoder.decode(frame, out);
+    assert(memcmp(out, pcm48k, sizeof(out)) == 0);
+    decoder.interpolate(out);
+    for (unsigned i = 0; i < BLOCK_SIZE_48K; i++)
+        assert(out[i] == 0);
+}
+
+static void latencyHistogramTest() {
+    amp::LatencyHistogram h;
+    assert(h.getCount() == 0);
+    assert(h.getPercentile(50) == 0);
+    // Small values are exact
+    for (unsigned i = 1; i <= 4; i++)
+        h.add(i);
+    assert(h.getPercentile(50) == 2);
+    assert(h.getPercentile(100) == 4);
+    // 1..1000 us, larger values are within 12.5%
+    h.reset();
+    for (unsigned i = 1; i <= 1000; i++)
+        h.add(i);
+    assert(h.getCount() == 1000);
+    assert(h.getMax() == 1000);
+    uint32_t p50 = h.getPercentile(50);
+    assert(p50 >= 500 && p50 <= 500 + 500 / 8);
+    uint32_t p99 = h.getPercentile(99);
+    assert(p99 >= 990 && p99 <= 1000);
+    // Never more than the max
+    h.reset();
+    h.add(100000);
+    assert(h.getPercentile(99) == 100000);
+}
+
+static void callIndexTest() {
+
+    CallIndex index(64);
+    unsigned found = 0;
+    auto count = [&found](unsigned) { found++; return true; };
+
+    // The same key can be stored for more than one position
+    index.insert(7, 1);
+    index.insert(7, 2);
+    index.insert(8, 3);
+    found = 0;
+    index.find(7, count);
+    assert(found == 2);
+    assert(index.remove(7, 1));
+    assert(!index.remove(7, 1));
+    found = 0;
+    index.find(7, count);
+    assert(found == 1);
+    index.clear();
+    assert(index.size() == 0);
+
+    // Random churn compared to a brute-force table. Removals shift 
+    // the later entries in a probe run back, which is what this is 
+    // trying to break.
+    const unsigned n = 64;
+    uint64_t keys[n];
+    bool used[n] = { false };
+    srand(1);
+    for (unsigned step = 0; step < 20000; step++) {
+        unsigned pos = rand() % n;
+        if (used[pos]) {
+            assert(index.remove(keys[pos], pos));
+            used[pos] = false;
+        } else {
+            // A small key space so that there are plenty of collisions
+            keys[pos] = rand() % 32;
+            index.insert(keys[pos], pos);
+            used[pos] = true;
+        }
+        uint64_t key = rand() % 32;
+        unsigned expected = 0;
+        for (unsigned i = 0; i < n; i++)
+            if (used[i] && keys[i] == key)
+                expected++;
+        found = 0;
+        index.find(key, [&found, &keys, &used, key](unsigned pos) {
+            assert(used[pos] && keys[pos] == key);
+            found++;
+            return true;
+        });
+        assert(found == expected);
+    }
+}
+
+/**
+ * Lookup time of the call index vs. a scan of the call table as the 
+ * number of calls grows. The keys look like the mini frame keys 
+ * (address and call number).
+ */
+static void callIndexSpeedTest() {
+
+    const unsigned lookups = 1000000;
+
+    for (unsigned calls : { 16, 128, 1024, 4096 }) {
+
+        CallIndex index(calls);
+        std::vector<uint64_t> keys(calls);
+        for (unsigned i = 0; i < calls; i++) {
+            uint64_t addr = 0x0a000000 + i * 7;
+            keys[i] = (addr << 16) ^ ((i * 13) & 0x7fff);
+            index.insert(keys[i], i);
+        }
+
+        unsigned check = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned l = 0; l < lookups; l++) {
+            const uint64_t key = keys[(l * 2654435761U) % calls];
+            index.find(key, [&check](unsigned pos) { check += pos; return false; });
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto indexNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned l = 0; l < lookups; l++) {
+            const uint64_t key = keys[(l * 2654435761U) % calls];
+            for (unsigned i = 0; i < calls; i++)
+                if (keys[i] == key) {
+                    check -= i;
+                    break;
+                }
+        }
+        end = std::chrono::steady_clock::now();
+        auto scanNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        assert(check == 0);
+
+        cout << "Call lookup, " << calls << " calls: index " 
+            << ((double)indexNs / lookups) << " ns, scan " 
+            << ((double)scanNs / lookups) << " ns" << endl;
+    }
+}
+
+/**
+ * Everything pushed by one thread comes out of the other in order, 
+ * through a queue that is much smaller than the total.
+ */
+static void spscQueueTest() {
+    SpscQueue<unsigned> q(64);
+    unsigned item;
+    assert(q.empty());
+    assert(!q.pop(item));
+    for (unsigned i = 0; i < 64; i++)
+        assert(q.push(i));
+    assert(!q.push(64U));
+    assert(q.pop(item) && item == 0);
+    while (q.pop(item));
+
+    const unsigned n = 100000;
+    std::thread producer([&q]() {
+        for (unsigned i = 0; i < n; i++)
+            while (!q.push(i))
+                std::this_thread::yield();
+    });
+    for (unsigned i = 0; i < n; i++) {
+        while (!q.pop(item))
+            std::this_thread::yield();
+        assert(item == i);
+    }
+    producer.join();
+    assert(q.empty());
+}
+
+static void ioUringTest() {
+#ifdef AMP_IO_URING
+    Log log;
+    IoUring ring;
+    // Not every kernel (or container) allows io_uring
+    if (ring.init(log, 8, 64) != 0)
+        return;
+
+    struct Handler : public IoUring::Handler {
+        unsigned count = 0;
+        uint64_t data = 0;
+        int res = 0;
+        uint32_t flags = 0;
+        void ringComplete(uint64_t d, int r, uint32_t f) { count++; data = d; res = r; flags = f; }
+    } handler;
+    int id = ring.addHandler(&handler);
+    assert(id > 0);
+
+    // A short timer
+    __kernel_timespec ts = { 0, 1000000 };
+    io_uring_sqe* sqe = ring.getSqe(id, 7);
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)&ts;
+    sqe->len = 1;
+    ring.submitAndWait();
+    assert(ring.dispatch() == 1);
+    assert(handler.count == 1 && handler.data == 7 && handler.res == -ETIME);
+
+    // A multishot receive into provided buffers. There are more datagrams 
+    // than buffers so they have to be recycled.
+    IoUring::BufferRing buffers;
+    if (buffers.attach(ring, 4, 256) != 0)
+        return;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    assert(bind(fd, (const sockaddr*)&addr, sizeof(addr)) == 0);
+    assert(getsockname(fd, (sockaddr*)&addr, &addrLen) == 0);
+
+    sqe = ring.getSqe(id, 8);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffers.getGroupId();
+    ring.submit();
+
+    for (unsigned i = 0; i < 10; i++) {
+        uint8_t b = i;
+        sendto(fd, &b, 1, 0, (const sockaddr*)&addr, sizeof(addr));
+        handler.count = 0;
+        while (handler.count == 0) {
+            ring.submitAndWait();
+            ring.dispatch();
+        }
+        // Older kernels have buffer rings but not multishot receives
+        if (handler.res == -EINVAL)
+            break;
+        assert(handler.data == 8 && handler.res == 1);
+        assert((handler.flags & IORING_CQE_F_BUFFER) && (handler.flags & IORING_CQE_F_MORE));
+        uint16_t bufferId = handler.flags >> IORING_CQE_BUFFER_SHIFT;
+        assert(buffers.getBuffer(bufferId)[0] == i);
+        buffers.recycle(bufferId);
+    }
+
+    buffers.detach();
+    ::close(fd);
+#endif
+}
+
+static void seqRingTest() {
+    Log log;
+    amp::SequencingBufferRing jb;
+    jb.setPayloadCapacity(160);
+    jb.setInitialMargin(40);
+    // The slab for G.711 is a small fraction of the MessageCarrier slots
+    assert((sizeof(jb) + 160 * amp::SequencingBufferRing::CAPACITY) * 8 < 
+        sizeof(amp::SequencingBufferStd<MessageCarrier>));
+
+    uint8_t body[160];
+    std::vector<uint32_t> played;
+    unsigned interpCount = 0;
+    auto play = [&played](const Message& msg, uint32_t) { 
+        assert(msg.size() == 160);
+        assert(msg.body()[0] == (msg.getOrigMs() & 0xff));
+        assert(msg.getSourceCallId() == 7);
+        played.push_back(msg.getOrigMs()); 
+    };
+    auto interp = [&interpCount](uint32_t, uint32_t, uint32_t) { interpCount++; };
+
+    // Out of order arrival
+    for (uint32_t origMs : { 1000, 1040, 1020 }) {
+        memset(body, origMs & 0xff, sizeof(body));
+        MessageWrapper msg(Message::Type::AUDIO, 0, 160, body, origMs, origMs + 5);
+        msg.setSource(1, 7);
+        assert(jb.consume(log, msg));
+    }
+    assert(jb.size() == 3);
+    // A duplicate is ignored 
+    MessageWrapper dup(Message::Type::AUDIO, 0, 160, body, 1020, 1030);
+    assert(!jb.consume(log, dup));
+    // A frame that doesn't fit is an overflow
+    uint8_t big[320] = { 0 };
+    MessageWrapper tooBig(Message::Type::AUDIO, 0, 320, big, 1060, 1065);
+    assert(!jb.consume(log, tooBig));
+    assert(jb.getOverflowCount() == 1);
+
+    // The cursor starts 40ms before the first frame 
+    uint32_t localMs = 2000;
+    for (unsigned i = 0; i < 5; i++, localMs += 20)
+        jb.playOut(log, localMs, play, interp);
+    assert((played == std::vector<uint32_t> { 1000, 1020, 1040 }));
+    assert(jb.empty());
+    assert(jb.getMaxBufferDepth() == 3);
+
+    // A gap in the talkspurt is interpolated, and a late frame is discarded
+    jb.playOut(log, localMs, play, interp);
+    localMs += 20;
+    assert(interpCount == 1);
+    MessageWrapper late(Message::Type::AUDIO, 0, 160, body, 1040, 1100);
+    assert(jb.consume(log, late));
+    jb.playOut(log, localMs, play, interp);
+    assert(played.size() == 3);
+    assert(jb.empty());
+    assert(jb.inTalkspurt());
+}
+
+static void wsolaTest() {
+    // A 400 Hz tone at 8K repeats every 20 samples, so a splice that
+    // jumps a whole block should be invisible.
+    const unsigned n = BLOCK_SIZE_8K;
+    int16_t x[n * 2], out[n * 2];
+    for (unsigned i = 0; i < n * 2; i++)
+        x[i] = 10000.0f * std::sin(2.0f * 3.14159265f * 400.0f * (float)i / 8000.0f);
+    amp::Wsola::compress(x, n, out);
+    for (unsigned i = 0; i < n; i++)
+        assert(std::abs(out[i] - x[i]) <= 2);
+    amp::Wsola::expand(x, n, out);
+    for (unsigned i = 0; i < n * 2; i++)
+        assert(std::abs(out[i] - x[i]) <= 2);
+}
+
+static void seqRingAdaptiveTest() {
+    Log log;
+    amp::SequencingBufferRing jb;
+    jb.setPayloadCapacity(160);
+    jb.setInitialMargin(200);
+    jb.setAdaptiveDelay(true);
+
+    uint8_t body[160] = { 0 };
+    unsigned playCount = 0, interpCount = 0;
+    uint32_t firstPlayMs = 0;
+    uint32_t localMs = 1000;
+    auto play = [&](const Message&, uint32_t ms) { 
+        if (playCount++ == 0) 
+            firstPlayMs = ms; 
+    };
+    auto interp = [&interpCount](uint32_t, uint32_t, uint32_t) { interpCount++; };
+
+    // A clean link: the frames always take the same time to arrive
+    for (unsigned t = 0; t < 100; t++, localMs += 20) {
+        MessageWrapper msg(Message::Type::AUDIO, 0, 160, body, 20 * t, localMs);
+        jb.consume(log, msg);
+        jb.playOut(log, localMs, play, interp);
+    }
+    // The first talkspurt starts with the initial margin, then gets 
+    // squeezed down once the estimate has some history.
+    assert(firstPlayMs == 1000 + 200);
+    assert(jb.getCompressCount() >= 4);
+    assert(jb.getExpandCount() == 0);
+    // Let the talkspurt finish. Nothing is lost. 
+    for (unsigned t = 0; t < 20; t++, localMs += 20)
+        jb.playOut(log, localMs, play, interp);
+    assert(playCount == 100);
+    assert(!jb.inTalkspurt());
+
+    // The next talkspurt starts with the minimum margin 
+    playCount = 0;
+    uint32_t startMs = localMs;
+    for (unsigned t = 120; t < 130; t++, localMs += 20) {
+        MessageWrapper msg(Message::Type::AUDIO, 0, 160, body, 20 * t, localMs);
+        jb.consume(log, msg);
+        jb.playOut(log, localMs, play, interp);
+    }
+    assert(firstPlayMs == startMs + 40);
+}
+
+/**
+ * Keeps the severity and text of everything that is logged.
+ */
+class SevLog : public Log {
+public:
+
+    std::vector<std::pair<std::string, std::string>> lines;
+
+protected:
+
+    void _out(const char* sev, const char*, const char* msg) { lines.push_back({ sev, msg }); }
+};
+
+static void deferredLogTest() {
+
+    SevLog ref;
+    ref.info("x");
+    ref.error("x");
+    const std::string infoSev = ref.lines[0].first;
+    const std::string errorSev = ref.lines[1].first;
+    assert(infoSev != errorSev);
+
+    SevLog target;
+    DeferredLog log;
+    log.setTarget(&target);
+
+    // Straight through
+    log.error("Error %d", 1);
+    log.info("Info %d", 2);
+    assert(target.lines.size() == 2);
+    assert(target.lines[0].first == errorSev && target.lines[0].second == "Error 1");
+    assert(target.lines[1].first == infoSev && target.lines[1].second == "Info 2");
+
+    // Held until the flush, in order
+    log.beginDeferred();
+    log.info("Info %d", 3);
+    log.error("Error %d", 4);
+    assert(target.lines.size() == 2);
+    log.flush();
+    assert(target.lines.size() == 4);
+    assert(target.lines[2].first == infoSev && target.lines[2].second == "Info 3");
+    assert(target.lines[3].first == errorSev && target.lines[3].second == "Error 4");
+
+    // Back to straight through
+    log.error("Error %d", 5);
+    assert(target.lines.size() == 5);
+    assert(target.lines[4].first == errorSev);
+}
+
+// Large structure kept off stack
+static const unsigned confCallCount = 8;
+static amp::BridgeCall confCallSpace[confCallCount];
+
+/**
+ * One participant in a test conference. A participant with a frequency
+ * sends a steady tone, otherwise it only listens.
+ */
+struct ConfCall {
+    unsigned callId;
+    CODECType codec;
+    float freq = 0;
+    float amplitude = 8000;
+    bool echo = false;
+    bool bypassJitterBuffer = true;
+    // The last frame that was sent
+    std::vector<uint8_t> tx;
+    // Everything that the Bridge has sent to this call
+    std::vector<std::vector<uint8_t>> rx;
+};
+
+static unsigned confEncode(CODECType codec, const int16_t* pcm, uint8_t* code) {
+    if (codec == CODECType::IAX2_CODEC_G711_ULAW) {
+        Transcoder_G711_ULAW tc;
+        tc.encode(pcm, BLOCK_SIZE_8K, code, 160);
+        return 160;
+    } else if (codec == CODECType::IAX2_CODEC_SLIN_16K) {
+        Transcoder_SLIN_16K tc;
+        tc.encode(pcm, BLOCK_SIZE_16K, code, BLOCK_SIZE_16K * 2);
+        return BLOCK_SIZE_16K * 2;
+    } else if (codec == CODECType::IAX2_CODEC_SLIN_8K) {
+        Transcoder_SLIN_8K tc;
+        tc.encode(pcm, BLOCK_SIZE_8K, code, BLOCK_SIZE_8K * 2);
+        return BLOCK_SIZE_8K * 2;
+    } else {
+        assert(false);
+        return 0;
+    }
+}
+
+static unsigned confDecode(CODECType codec, const std::vector<uint8_t>& code, int16_t* pcm) {
+    if (codec == CODECType::IAX2_CODEC_G711_ULAW) {
+        Transcoder_G711_ULAW tc;
+        tc.decode(code.data(), code.size(), pcm, BLOCK_SIZE_8K);
+        return BLOCK_SIZE_8K;
+    } else if (codec == CODECType::IAX2_CODEC_SLIN_16K) {
+        Transcoder_SLIN_16K tc;
+        tc.decode(code.data(), code.size(), pcm, BLOCK_SIZE_16K);
+        return BLOCK_SIZE_16K;
+    } else if (codec == CODECType::IAX2_CODEC_SLIN_8K) {
+        Transcoder_SLIN_8K tc;
+        tc.decode(code.data(), code.size(), pcm, BLOCK_SIZE_8K);
+        return BLOCK_SIZE_8K;
+    } else {
+        assert(false);
+        return 0;
+    }
+}
+
+/**
+ * @returns The amplitude of the freq component of the last frame that
+ * the call received.
+ */
+static float confToneLevel(const ConfCall& call, float freq) {
+    assert(!call.rx.empty());
+    int16_t pcm[BLOCK_SIZE_48K];
+    unsigned n = confDecode(call.codec, call.rx.back(), pcm);
+    float rate = codecSampleRate(call.codec);
+    float re = 0, im = 0;
+    for (unsigned i = 0; i < n; i++) {
+        float phi = 2.0f * 3.14159265f * freq * (float)i / rate;
+        re += pcm[i] * std::cos(phi);
+        im += pcm[i] * std::sin(phi);
+    }
+    return 2.0f * std::sqrt(re * re + im * im) / (float)n;
+}
+
+/**
+ * Keeps everything that is logged.
+ */
+class ConfLog : public Log {
+public:
+
+    std::vector<std::string> lines;
+
+protected:
+
+    void _out(const char*, const char*, const char* msg) { lines.push_back(msg); }
+};
+
+/**
+ * Runs a Bridge in simulated time and routes its output back to the
+ * ConfCalls. Every frame is also kept in the order that it was sent.
+ */
+class ConfDriver : public MessageConsumer {
+public:
+
+    static const unsigned BRIDGE_LINE_ID = 10;
+    static const unsigned LINE_ID = 1;
+
+    ConfDriver()
+    :   _clock(_log),
+        _bridge(_log, _log, _clock, *this, amp::BridgeCall::Mode::NORMAL,
+            BRIDGE_LINE_ID, 0, 0, 0, 1, 0, 0, confCallSpace, confCallCount) {
+        // The call space is shared by all of the tests
+        _bridge.reset();
+        _clock.setTime(1000);
+    }
+
+    amp::Bridge& bridge() { return _bridge; }
+    ConfLog& log() { return _log; }
+
+    void start(ConfCall& call) {
+        PayloadCallStart payload;
+        payload.codec = call.codec;
+        payload.bypassJitterBuffer = call.bypassJitterBuffer;
+        payload.startMs = _clock.time();
+        payload.echo = call.echo;
+        snprintf(payload.localNumber, sizeof(payload.localNumber), "1000");
+        snprintf(payload.remoteNumber, sizeof(payload.remoteNumber), "%u", call.callId);
+        payload.originated = true;
+        MessageWrapper msg(Message::Type::SIGNAL, Message::SignalType::CALL_START,
+            sizeof(payload), (const uint8_t*)&payload, 0, _clock.time());
+        msg.setSource(LINE_ID, call.callId);
+        msg.setDest(BRIDGE_LINE_ID, Message::UNKNOWN_CALL_ID);
+        _bridge.consume(msg);
+        _calls.push_back(&call);
+    }
+
+    void end(ConfCall& call) {
+        PayloadCallEnd payload;
+        snprintf(payload.localNumber, sizeof(payload.localNumber), "1000");
+        snprintf(payload.remoteNumber, sizeof(payload.remoteNumber), "%u", call.callId);
+        MessageWrapper msg(Message::Type::SIGNAL, Message::SignalType::CALL_END,
+            sizeof(payload), (const uint8_t*)&payload, 0, _clock.time());
+        msg.setSource(LINE_ID, call.callId);
+        msg.setDest(BRIDGE_LINE_ID, Message::UNKNOWN_CALL_ID);
+        _bridge.consume(msg);
+        std::erase(_calls, &call);
+    }
+
+    /**
+     * Sends a frame from each of the talkers and then runs one Bridge tick.
+     */
+    void tick() {
+        for (ConfCall* call : _calls) {
+            if (call->freq == 0)
+                continue;
+            const unsigned n = codecBlockSize(call->codec);
+            const float rate = codecSampleRate(call->codec);
+            int16_t pcm[BLOCK_SIZE_48K];
+            for (unsigned i = 0; i < n; i++) {
+                float phi = 2.0f * 3.14159265f * call->freq * (float)(_tickCount * n + i) / rate;
+                pcm[i] = call->amplitude * std::sin(phi);
+            }
+            uint8_t code[BLOCK_SIZE_48K * 2];
+            unsigned codeSize = confEncode(call->codec, pcm, code);
+            call->tx.assign(code, code + codeSize);
+            MessageWrapper msg(Message::Type::AUDIO, call->codec, codeSize, code,
+                _tickCount * 20, _clock.time());
+            msg.setSource(LINE_ID, call->callId);
+            msg.setDest(BRIDGE_LINE_ID, Message::UNKNOWN_CALL_ID);
+            _bridge.consume(msg);
+        }
+        _bridge.audioRateTick(_clock.time());
+        _clock.increment(20);
+        _tickCount++;
+    }
+
+    void consume(const Message& msg) {
+        if (msg.getType() != Message::Type::AUDIO)
+            return;
+        assert(msg.getDestBusId() == LINE_ID);
+        std::vector<uint8_t> frame(msg.body(), msg.body() + msg.size());
+        for (ConfCall* call : _calls)
+            if (call->callId == msg.getDestCallId())
+                call->rx.push_back(frame);
+        sent.push_back({ msg.getDestCallId(), frame });
+    }
+
+    // Every frame sent by the Bridge (destination call ID and body)
+    std::vector<std::pair<unsigned, std::vector<uint8_t>>> sent;
+
+private:
+
+    ConfLog _log;
+    TestClock _clock;
+    amp::Bridge _bridge;
+    std::vector<ConfCall*> _calls;
+    unsigned _tickCount = 0;
+};
+
+/**
+ * Each talker hears everyone but itself, except that a talker with echo
+ * hears itself too. A listener hears everyone.
+ */
+static void bridgeMixMinusTest() {
+
+    ConfDriver d;
+    ConfCall a { .callId = 20, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 400 };
+    ConfCall b { .callId = 21, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 1000 };
+    ConfCall c { .callId = 22, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 1600, .echo = true };
+    ConfCall l { .callId = 23, .codec = CODECType::IAX2_CODEC_G711_ULAW };
+    for (ConfCall* call : { &a, &b, &c, &l })
+        d.start(*call);
+    for (unsigned t = 0; t < 20; t++)
+        d.tick();
+
+    auto hears = [](const ConfCall& call, const ConfCall& talker) {
+        float level = confToneLevel(call, talker.freq);
+        // Three talkers, so each is mixed in at 1/3 (or 1/2 for a talker
+        // that only hears the other two)
+        assert(level > 1500 || level < 150);
+        return level > 1500;
+    };
+    assert(!hears(a, a) && hears(a, b) && hears(a, c));
+    assert(hears(b, a) && !hears(b, b) && hears(b, c));
+    assert(hears(c, a) && hears(c, b) && hears(c, c));
+    assert(hears(l, a) && hears(l, b) && hears(l, c));
+}
+
+/**
+ * Listeners that use the same CODEC get exactly the same frames, even when
+ * one of them is a talker with echo.
+ */
+static void bridgeSharedOutputTest() {
+
+    ConfDriver d;
+    ConfCall a { .callId = 20, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 400 };
+    ConfCall b { .callId = 21, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 1000, .echo = true };
+    ConfCall l1 { .callId = 22, .codec = CODECType::IAX2_CODEC_G711_ULAW };
+    ConfCall l2 { .callId = 23, .codec = CODECType::IAX2_CODEC_G711_ULAW };
+    ConfCall l3 { .callId = 24, .codec = CODECType::IAX2_CODEC_SLIN_16K };
+    ConfCall l4 { .callId = 25, .codec = CODECType::IAX2_CODEC_SLIN_16K };
+    for (ConfCall* call : { &a, &b, &l1, &l2, &l3, &l4 })
+        d.start(*call);
+    for (unsigned t = 0; t < 20; t++)
+        d.tick();
+
+    assert(l1.rx.size() == 20);
+    assert(l1.rx == l2.rx);
+    assert(l1.rx == b.rx);
+    assert(l3.rx.size() == 20);
+    assert(l3.rx == l4.rx);
+    // Everyone hears both talkers
+    for (ConfCall* call : { &b, &l1, &l3 })
+        assert(confToneLevel(*call, a.freq) > 2000 && confToneLevel(*call, b.freq) > 2000);
+}
+
+/**
+ * With a limit of two talkers the quietest of three isn't heard.
+ */
+static void bridgeTopTalkersTest() {
+
+    ConfDriver d;
+    d.bridge().setMaxTalkers(2);
+    ConfCall a { .callId = 20, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 400, .amplitude = 8000 };
+    ConfCall b { .callId = 21, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 1000, .amplitude = 1000 };
+    ConfCall c { .callId = 22, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 1600, .amplitude = 4000 };
+    ConfCall l { .callId = 23, .codec = CODECType::IAX2_CODEC_SLIN_16K };
+    for (ConfCall* call : { &a, &b, &c, &l })
+        d.start(*call);
+    for (unsigned t = 0; t < 20; t++)
+        d.tick();
+
+    // Each of the selected talkers is mixed in at 1/2
+    assert(confToneLevel(l, a.freq) > 3000);
+    assert(confToneLevel(l, b.freq) < 100);
+    assert(confToneLevel(l, c.freq) > 1500);
+    // The quiet talker hears the other two
+    assert(confToneLevel(b, a.freq) > 3000);
+    assert(confToneLevel(b, c.freq) > 1500);
+    // A selected talker only hears the other selected talker
+    assert(confToneLevel(a, b.freq) < 100);
+    assert(confToneLevel(a, c.freq) > 3000);
+
+    json talkers = d.bridge().getStatusDoc()["talkers"];
+    assert(talkers.size() == 2);
+    assert(talkers[0] == "20" && talkers[1] == "22");
+}
+
+/**
+ * With a single talker, the listeners that use the talker's CODEC get the
+ * talker's frames untouched. Everyone else gets a transcoded mix.
+ */
+static void bridgeBypassTest() {
+
+    ConfDriver d;
+    ConfCall a { .callId = 20, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 1000 };
+    ConfCall l1 { .callId = 21, .codec = CODECType::IAX2_CODEC_G711_ULAW };
+    ConfCall l2 { .callId = 22, .codec = CODECType::IAX2_CODEC_G711_ULAW };
+    ConfCall l3 { .callId = 23, .codec = CODECType::IAX2_CODEC_SLIN_16K };
+    for (ConfCall* call : { &a, &l1, &l2, &l3 })
+        d.start(*call);
+    // The first frame is a crossfade into the bypass
+    d.tick();
+    assert(l1.rx.back() != a.tx);
+    for (unsigned t = 0; t < 10; t++) {
+        d.tick();
+        assert(l1.rx.back() == a.tx);
+        assert(l2.rx.back() == a.tx);
+    }
+    assert(l3.rx.back().size() == BLOCK_SIZE_16K * 2);
+    assert(confToneLevel(l3, a.freq) > 6000);
+
+    // A second talker ends the bypass
+    ConfCall b { .callId = 24, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 400 };
+    d.start(b);
+    for (unsigned t = 0; t < 10; t++)
+        d.tick();
+    assert(l1.rx.back() != a.tx);
+    assert(confToneLevel(l1, a.freq) > 3000 && confToneLevel(l1, b.freq) > 3000);
+}
+
+/**
+ * The bypass talker hangs up and a talker with a different CODEC takes 
+ * over its slot before the next tick. The listener that was getting the 
+ * bypass must not crossfade out of the new talker's frame.
+ */
+static void bridgeBypassSlotReuseTest() {
+
+    ConfDriver d;
+    ConfCall a { .callId = 20, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 1000 };
+    ConfCall l { .callId = 21, .codec = CODECType::IAX2_CODEC_G711_ULAW };
+    ConfCall c { .callId = 22, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 400 };
+    d.start(a);
+    d.start(l);
+    for (unsigned t = 0; t < 10; t++)
+        d.tick();
+    assert(l.rx.back() == a.tx);
+
+    d.end(a);
+    d.start(c);
+    for (unsigned t = 0; t < 3; t++) {
+        d.tick();
+        assert(l.rx.back().size() == 160);
+        assert(confToneLevel(l, c.freq) > 6000);
+        assert(confToneLevel(l, a.freq) < 200);
+    }
+}
+
+/**
+ * A conference with talkers coming and going, run with the given number
+ * of worker threads.
+ */
+static void bridgeWorkerScript(unsigned threads, 
+    std::vector<std::pair<unsigned, std::vector<uint8_t>>>& sent,
+    std::vector<std::string>& logLines) {
+
+    ConfDriver d;
+    d.bridge().setWorkerThreads(threads);
+    d.bridge().setMaxTalkers(3);
+    ConfCall a { .callId = 20, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 400, .amplitude = 6000 };
+    ConfCall b { .callId = 21, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 1000, .amplitude = 3000,
+        .bypassJitterBuffer = false };
+    ConfCall c { .callId = 22, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 1600, .amplitude = 5000, 
+        .echo = true };
+    ConfCall e { .callId = 23, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 2200, .amplitude = 2000 };
+    ConfCall l1 { .callId = 24, .codec = CODECType::IAX2_CODEC_G711_ULAW };
+    ConfCall l2 { .callId = 25, .codec = CODECType::IAX2_CODEC_SLIN_16K };
+    // Only what happens after the setup is compared
+    d.log().lines.clear();
+
+    for (ConfCall* call : { &a, &b, &l1 })
+        d.start(*call);
+    for (unsigned t = 0; t < 20; t++)
+        d.tick();
+    for (ConfCall* call : { &c, &e, &l2 })
+        d.start(*call);
+    for (unsigned t = 0; t < 20; t++)
+        d.tick();
+    // The talker that is using the jitter buffer goes quiet
+    b.freq = 0;
+    for (unsigned t = 0; t < 20; t++)
+        d.tick();
+    d.end(c);
+    d.end(l1);
+    for (unsigned t = 0; t < 20; t++)
+        d.tick();
+    b.freq = 1000;
+    for (unsigned t = 0; t < 20; t++)
+        d.tick();
+
+    sent = d.sent;
+    logLines = d.log().lines;
+}
+
+/**
+ * Spreading the calls across worker threads doesn't change anything that
+ * is sent or logged.
+ */
+static void bridgeWorkerTest() {
+
+    std::vector<std::pair<unsigned, std::vector<uint8_t>>> sent1, sent4;
+    std::vector<std::string> log1, log4;
+    bridgeWorkerScript(1, sent1, log1);
+    bridgeWorkerScript(4, sent4, log4);
+    assert(sent1.size() > 400);
+    assert(sent1 == sent4);
+    assert(log1 == log4);
+}
+
+/**
+ * A conference with the same four calls throughout, plus (optionally) 
+ * listeners that come and go in the middle of the call list.
+ */
+static void bridgeChurnScript(bool churn, unsigned threads, 
+    std::vector<std::vector<uint8_t>>* rx) {
+
+    ConfDriver d;
+    d.bridge().setWorkerThreads(threads);
+    ConfCall a { .callId = 20, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 400 };
+    ConfCall b { .callId = 21, .codec = CODECType::IAX2_CODEC_G711_ULAW, .freq = 1000 };
+    ConfCall c { .callId = 22, .codec = CODECType::IAX2_CODEC_SLIN_16K, .freq = 1600, .echo = true };
+    ConfCall l { .callId = 23, .codec = CODECType::IAX2_CODEC_G711_ULAW };
+    // Listeners on a CODEC that nobody else uses
+    ConfCall x1 { .callId = 30, .codec = CODECType::IAX2_CODEC_SLIN_8K };
+    ConfCall x2 { .callId = 31, .codec = CODECType::IAX2_CODEC_SLIN_8K };
+    ConfCall x3 { .callId = 32, .codec = CODECType::IAX2_CODEC_SLIN_8K };
+
+    // The first extra listener lands between the first two calls
+    d.start(a);
+    if (churn)
+        d.start(x1);
+    for (ConfCall* call : { &b, &c, &l })
+        d.start(*call);
+
+    for (unsigned t = 0; t < 30; t++)
+        d.tick();
+    if (churn) {
+        assert(confToneLevel(x1, a.freq) > 2000);
+        assert(confToneLevel(x1, b.freq) > 2000);
+        assert(confToneLevel(x1, c.freq) > 2000);
+        d.end(x1);
+    }
+    unsigned endSent = d.sent.size();
+
+    // Another listener takes over the same slot
+    for (unsigned t = 30; t < 50; t++)
+        d.tick();
+    if (churn)
+        d.start(x2);
+    for (unsigned t = 50; t < 70; t++)
+        d.tick();
+    // And is replaced before the next tick
+    if (churn) {
+        assert(confToneLevel(x2, b.freq) > 2000);
+        d.end(x2);
+        d.start(x3);
+    }
+    for (unsigned t = 70; t < 90; t++)
+        d.tick();
+    if (churn) {
+        assert(x2.rx.size() == 20);
+        assert(x3.rx.size() == 20);
+        assert(confToneLevel(x3, c.freq) > 2000);
+    }
+
+    // Nothing goes to a call once it has ended
+    for (unsigned i = endSent; i < d.sent.size(); i++)
+        assert(d.sent[i].first != x1.callId);
+
+    ConfCall* calls[] = { &a, &b, &c, &l };
+    for (unsigned i = 0; i < 4; i++) {
+        assert(calls[i]->rx.size() == 90);
+        rx[i] = calls[i]->rx;
+    }
+}
+
+/**
+ * Calls joining and leaving the conference doesn't change what anyone 
+ * else hears.
+ */
+static void bridgeChurnTest() {
+    std::vector<std::vector<uint8_t>> rx0[4], rx1[4], rx2[4];
+    bridgeChurnScript(false, 1, rx0);
+    bridgeChurnScript(true, 1, rx1);
+    bridgeChurnScript(true, 4, rx2);
+    for (unsigned i = 0; i < 4; i++) {
+        assert(rx0[i] == rx1[i]);
+        assert(rx0[i] == rx2[i]);
+    }
+}
+
+/**
+ * Records the lines and counts the ones that come from another thread.
+ */
+class ShardTestLog : public Log {
+public:
+
+    std::vector<std::string> lines;
+    unsigned otherThreadLines = 0;
+
+    bool has(const char* prefix, const char* text) const {
+        for (const std::string& line : lines)
+            if (line.starts_with(prefix) && line.find(text) != std::string::npos)
+                return true;
+        return false;
+    }
+
+protected:
+
+    void _out(const char*, const char*, const char* msg) { 
+        if (std::this_thread::get_id() != _thread)
+            otherThreadLines++;
+        lines.push_back(msg); 
+    }
+
+private:
+
+    const std::thread::id _thread = std::this_thread::get_id();
+};
+
+class ShardTestAuthenticator : public LocalAuthenticator {
+public:
+
+    fixedstring getSecret(const char*, const char* username) const {
+        fixedstring secret;
+        if (strcmp(username, "test") == 0)
+            secret = "secret";
+        return secret;
+    }
+};
+
+/**
+ * Stands in for the Bridge on one side and for the peer's Bridge on 
+ * the other.
+ */
+class ShardTestRecorder : public MessageConsumer {
+public:
+
+    struct Start {
+        unsigned busId;
+        unsigned callId;
+        CODECType codec;
+        bool originated;
+    };
+
+    std::vector<Start> starts;
+    unsigned voiceFrames = 0;
+    unsigned voiceBusId = 0;
+    uint8_t voiceByte = 0;
+
+    void consume(const Message& msg) {
+        if (msg.isSignal(Message::SignalType::CALL_START)) {
+            PayloadCallStart payload;
+            assert(msg.size() == sizeof(payload));
+            memcpy(&payload, msg.body(), sizeof(payload));
+            starts.push_back({ msg.getSourceBusId(), msg.getSourceCallId(), 
+                payload.codec, payload.originated });
+        }
+        else if (msg.getType() == Message::Type::AUDIO) {
+            voiceFrames++;
+            voiceBusId = msg.getSourceBusId();
+            voiceByte = msg.body()[0];
+        }
+    }
+};
+
+/**
+ * Two steered shards on loopback. A peer on 127.0.0.1 always lands on
+ * shard 1, so its call in is reported by shard 1 and a call out to it 
+ * (which goes to shard 0 first) is handed over to shard 1. Voice has 
+ * to get through the queues in both directions and everything that 
+ * the shards log has to reach the Log on this thread.
+ */
+static void lineIAX2ShardsTest() {
+
+    const unsigned BRIDGE_LINE_ID = 10;
+    const unsigned SHARDS_LINE_ID = 50;
+    const unsigned FIRST_SHARD_LINE_ID = 51;
+    const unsigned PEER_LINE_ID = 60;
+    const unsigned PEER_BRIDGE_LINE_ID = 61;
+
+    ShardTestLog log;
+    ConfLog peerLog;
+    StdClock clock;
+    ShardTestAuthenticator auth;
+    ShardTestRecorder bridge, peerBridge;
+    threadsafequeue2<MessageCarrier> auxQueue;
+    MultiRouter router(auxQueue);
+    router.addRoute(&bridge, BRIDGE_LINE_ID);
+
+    LineIAX2Shards shards(log, clock, 2, SHARDS_LINE_ID, FIRST_SHARD_LINE_ID, router,
+        0, 0, 0, &auth, BRIDGE_LINE_ID, "radio", 4);
+    shards.addRoutes(router);
+    assert(shards.start(AF_INET, 14580, true) == 0);
+
+    LineIAX2::Call peerCalls[4];
+    LineIAX2 peer(peerLog, peerLog, clock, PEER_LINE_ID, peerBridge, 0, 0, 0, &auth, 
+        PEER_BRIDGE_LINE_ID, "radio", peerCalls, 4);
+    assert(peer.open(AF_INET, 14581) == 0);
+    assert(peer.call("1001", "iax:test@127.0.0.1:14580/2000,secret", 
+        CODECType::IAX2_CODEC_G711_ULAW) == 0);
+
+    const uint32_t endMs = clock.time() + 5000;
+    uint32_t lastVoiceMs = 0;
+    bool callOutRequested = false;
+    Runnable2* tasks[] = { &router, &shards, &peer };
+
+    EventLoop::run(log, clock, 0, 0, tasks, std::size(tasks), 
+        [&](Log&, Clock&) {
+            const uint32_t now = clock.time();
+            // Voice both ways once the call in is up
+            if (!callOutRequested && !bridge.starts.empty() && !peerBridge.starts.empty() &&
+                now - lastVoiceMs >= 20) {
+                lastVoiceMs = now;
+                const ShardTestRecorder::Start& start = bridge.starts[0];
+                std::vector<uint8_t> frame(maxVoiceFrameSize(start.codec));
+
+                memset(frame.data(), 0x2a, frame.size());
+                MessageWrapper in(Message::Type::AUDIO, start.codec, frame.size(), 
+                    frame.data(), 0, now);
+                in.setSource(PEER_BRIDGE_LINE_ID, Message::UNKNOWN_CALL_ID);
+                in.setDest(PEER_LINE_ID, peerBridge.starts[0].callId);
+                peer.consume(in);
+
+                memset(frame.data(), 0x55, frame.size());
+                MessageWrapper out(Message::Type::AUDIO, start.codec, frame.size(), 
+                    frame.data(), 0, now);
+                out.setSource(BRIDGE_LINE_ID, Message::UNKNOWN_CALL_ID);
+                out.setDest(start.busId, start.callId);
+                router.consume(out);
+            }
+            // Then a call out from the rest of the system. The first voice 
+            // frame of a call is a full frame, the ones after are mini frames.
+            if (!callOutRequested && bridge.voiceFrames >= 3 && peerBridge.voiceFrames >= 3) {
+                callOutRequested = true;
+                PayloadCall payload;
+                strcpyLimited(payload.localNumber, "2001", sizeof(payload.localNumber));
+                strcpyLimited(payload.targetNumber, "iax:test@127.0.0.1:14581/1002,secret", 
+                    sizeof(payload.targetNumber));
+                MessageWrapper msg(Message::Type::SIGNAL, Message::SignalType::CALL_NODE, 
+                    sizeof(payload), (const uint8_t*)&payload, 0, now);
+                msg.setSource(BRIDGE_LINE_ID, Message::UNKNOWN_CALL_ID);
+                msg.setDest(SHARDS_LINE_ID, Message::UNKNOWN_CALL_ID);
+                router.consume(msg);
+            }
+            return bridge.starts.size() < 2 && (int32_t)(endMs - now) > 0;
+        }
+    );
+
+    shards.stop();
+    peer.close();
+
+    // The call in
+    assert(bridge.starts.size() == 2);
+    assert(bridge.starts[0].busId == FIRST_SHARD_LINE_ID + 1);
+    assert(!bridge.starts[0].originated);
+    // The voice
+    assert(bridge.voiceFrames >= 3);
+    assert(bridge.voiceBusId == FIRST_SHARD_LINE_ID + 1);
+    assert(bridge.voiceByte == 0x2a);
+    assert(peerBridge.voiceFrames >= 3);
+    assert(peerBridge.voiceByte == 0x55);
+    // The call out, handed from shard 0 to shard 1
+    assert(bridge.starts[1].busId == FIRST_SHARD_LINE_ID + 1);
+    assert(bridge.starts[1].originated);
+    assert(log.has("Shard 0: ", "handed to shard 1"));
+    assert(log.has("Shard 1: ", "Initiating a call 2001"));
+    assert(log.otherThreadLines == 0);
+}
+
 int main(int, const char**) {
     crcTest1();
     wrapTest1();
@@ -444,6 +1962,8 @@ int main(int, const char**) {
     snprintfCheck();
     testRound();
     resampler_1();
+    resampler_2();
+    resampler_3();
     pack1();
     bufferTest1();
     clockTest1();
@@ -453,5 +1973,30 @@ int main(int, const char**) {
     iaxParseTest1();
     parseTest1();
     courtesyToneTest();
+    mixKernelTest();
+    firKernelTest();
+    //firKernelSpeedTest();
+    ulawTableTest();
+    spectrumTest();
+    toneOscillatorTest();
+    fixedMathTest();
+    codecPipelineTest();
+    latencyHistogramTest();
+    callIndexTest();
+    //callIndexSpeedTest();
+    spscQueueTest();
+    ioUringTest();
+    seqRingTest();
+    seqRingAdaptiveTest();
+    wsolaTest();
+    deferredLogTest();
+    bridgeMixMinusTest();
+    bridgeSharedOutputTest();
+    bridgeTopTalkersTest();
+    bridgeBypassTest();
+    bridgeBypassSlotReuseTest();
+    bridgeWorkerTest();
+    bridgeChurnTest();
+    lineIAX2ShardsTest();
     return 0;
 }